@@ -1,15 +1,11 @@
 #include "compilium.h"
 
-static struct Node *in_function;  // ASTFuncDef
-static int reg_used_table[NUM_OF_SCRATCH_REGS];
-static struct Node *reg_node_table[NUM_OF_SCRATCH_REGS];
-
 static void AllocReg(struct Node *n) {
   assert(n);
   for (int i = 1; i <= NUM_OF_SCRATCH_REGS; i++) {
-    if (!reg_used_table[i]) {
-      reg_used_table[i] = 1;
-      reg_node_table[i] = n;
+    if (!compiler->reg_used_table[i]) {
+      compiler->reg_used_table[i] = 1;
+      compiler->reg_node_table[i] = n;
       n->reg = i;
       return;
     }
@@ -17,8 +13,8 @@ static void AllocReg(struct Node *n) {
   fprintf(stderr, "\n**** Allocated regs ****\n");
   for (int i = 1; i <= NUM_OF_SCRATCH_REGS; i++) {
     fprintf(stderr, "reg[%d]:\n", i);
-    if (reg_node_table[i]->op) {
-      PrintTokenLine(reg_node_table[i]->op);
+    if (compiler->reg_node_table[i]->op) {
+      PrintTokenLine(compiler->reg_node_table[i]->op);
     } else {
       fprintf(stderr, "Op info not found\n");
     }
@@ -30,34 +26,41 @@ static void AllocReg(struct Node *n) {
 
 static void FreeReg(int reg) {
   assert(1 <= reg && reg <= NUM_OF_SCRATCH_REGS);
-  reg_used_table[reg] = 0;
-  reg_node_table[reg] = NULL;
+  compiler->reg_used_table[reg] = 0;
+  compiler->reg_node_table[reg] = NULL;
 }
 
-static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
+static bool AnalyzeStep(struct TraverseFrame *f, void *arg) {
+  struct SymbolTable *ctx = arg;
+  struct Node *node = f->node;
   assert(node);
   if (node->type == kASTList && !node->op) {
-    for (int i = 0; i < GetSizeOfList(node); i++) {
-      AnalyzeNode(GetNodeAt(node, i), ctx);
-    }
-    return;
+    return VisitNextElement(f, 1, node, 0);
   }
   if (node->type == kASTExprFuncCall) {
-    node->stack_size_needed = (GetLastLocalVarOffset(*ctx) + 0xF) & ~0xF;
-    AllocReg(node);
-    AnalyzeNode(node->func_expr, ctx);
-    FreeReg(node->func_expr->reg);
-    node->expr_type =
-        GetReturnTypeOfFunction(GetTypeWithoutAttr(node->func_expr->expr_type));
-    for (int i = 0; i < GetSizeOfList(node->arg_expr_list); i++) {
-      struct Node *n = GetNodeAt(node->arg_expr_list, i);
-      AnalyzeNode(n, ctx);
-      FreeReg(n->reg);
+    switch (f->step) {
+      case 0:
+        node->stack_size_needed = (GetLastLocalVarOffset(ctx) + 0xF) & ~0xF;
+        AllocReg(node);
+        return VisitChild(f, 1, node->func_expr, 0);
+      case 1:
+        FreeReg(node->func_expr->reg);
+        node->expr_type = GetReturnTypeOfFunction(
+            GetTypeWithoutAttr(node->func_expr->expr_type));
+        break;
+      case 2:
+        FreeReg(f->child->reg);
+        break;
     }
-    return;
+    return VisitNextElement(f, 2, GetFuncCallArgs(node), 0);
   } else if (node->type == kASTFuncDef) {
-    AddFuncDef(ctx, CreateTokenStr(node->func_name_token), node);
-    struct SymbolEntry *saved_ctx = *ctx;
+    if (f->step) {
+      compiler->in_function = NULL;
+      PopSymbolScope(ctx);
+      return false;
+    }
+    AddFuncDef(ctx, node->func_name_token->atom, node);
+    PushSymbolScope(ctx);
     struct Node *arg_type_list = GetArgTypeList(node->func_type);
     assert(arg_type_list);
     node->arg_var_list = AllocList();
@@ -72,15 +75,12 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
       struct Node *arg_type = GetTypeWithoutAttr(arg_type_with_attr);
       assert(arg_type);
       struct Node *local_var =
-          AddLocalVar(ctx, CreateTokenStr(arg_ident_token), arg_type);
+          AddLocalVar(ctx, arg_ident_token->atom, arg_type);
       PushToList(node->arg_var_list, local_var);
     }
-    assert(!in_function);
-    in_function = node;
-    AnalyzeNode(node->func_body, ctx);
-    in_function = NULL;
-    *ctx = saved_ctx;
-    return;
+    assert(!compiler->in_function);
+    compiler->in_function = node;
+    return VisitChild(f, 1, GetFuncDefBody(node), 0);
   }
   assert(node->op);
   if (node->type == kASTExpr) {
@@ -88,19 +88,23 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
         IsTokenWithType(node->op, kTokenCharLiteral)) {
       AllocReg(node);
       node->expr_type = CreateTypeBase(CreateToken("int"));
-      return;
+      return false;
     } else if (IsTokenWithType(node->op, kTokenStringLiteral)) {
       AllocReg(node);
       node->expr_type = CreateTypePointer(CreateTypeBase(CreateToken("char")));
-      return;
-    } else if (IsEqualTokenWithCStr(node->op, "(")) {
-      AnalyzeNode(node->right, ctx);
+      return false;
+    } else if (IsPunctuator(node->op, kPunctLParen)) {
+      if (!f->step) return VisitChild(f, 1, node->right, 0);
       node->reg = node->right->reg;
       node->expr_type = node->right->expr_type;
-      return;
-    } else if (IsEqualTokenWithCStr(node->op, "[")) {
-      AnalyzeNode(node->left, ctx);
-      AnalyzeNode(node->right, ctx);
+      return false;
+    } else if (IsPunctuator(node->op, kPunctLBracket)) {
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->left, 0);
+        case 1:
+          return VisitChild(f, 2, node->right, 0);
+      }
       node->reg = node->left->reg;
       FreeReg(node->right->reg);
       assert(node->left->expr_type);
@@ -112,23 +116,23 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
       } else {
         assert(false);
       }
-      return;
-    } else if (IsEqualTokenWithCStr(node->op, ".") ||
-               IsEqualTokenWithCStr(node->op, "->")) {
-      AnalyzeNode(node->left, ctx);
+      return false;
+    } else if (IsPunctuator(node->op, kPunctDot) ||
+               IsPunctuator(node->op, kPunctArrow)) {
+      if (!f->step) return VisitChild(f, 1, node->left, 0);
       node->reg = node->left->reg;
-      PrintASTNode(node->left->expr_type);
+      TRACE_AST(kTraceAnalyze, node->left->expr_type);
       assert(node->right && node->right->type == kNodeToken);
       struct Node *struct_type = NULL;
-      if (IsEqualTokenWithCStr(node->op, ".")) {
+      if (IsPunctuator(node->op, kPunctDot)) {
         if (GetTypeWithoutAttr(node->left->expr_type)->type != kTypeStruct) {
           ErrorWithToken(node->op, "left operand is not a struct");
         }
         struct_type = node->left->expr_type;
       }
-      if (IsEqualTokenWithCStr(node->op, "->")) {
+      if (IsPunctuator(node->op, kPunctArrow)) {
         struct Node *left_type = GetTypeWithoutAttr(node->left->expr_type);
-        PrintASTNode(left_type);
+        TRACE_AST(kTraceAnalyze, left_type);
         assert(left_type->type == kTypePointer);
         struct Node *left_deref_type = left_type->right;
         assert(left_deref_type->type == kTypeStruct);
@@ -139,132 +143,144 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
       if (!member) {
         ErrorWithToken(node->right, "Member name not found in struct");
       }
-      PrintASTNode(member);
+      TRACE_AST(kTraceAnalyze, member);
       node->byte_offset = member->struct_member_ent_ofs;
       node->expr_type =
           CreateTypeLValue(GetTypeWithoutAttr(member->struct_member_ent_type));
-      return;
+      return false;
     } else if (IsTokenWithType(node->op, kTokenIdent)) {
-      struct Node *ident_info = FindLocalVar(*ctx, node->op);
+      struct Node *ident_info = FindLocalVar(ctx, node->op);
       if (ident_info) {
-        node->byte_offset = ident_info->byte_offset;
+        node->byte_offset = GetLocalVarOffset(ident_info);
         AllocReg(node);
         enum NodeType expr_type =
             GetTypeWithoutAttr(ident_info->expr_type)->type;
         if (expr_type == kTypeStruct || expr_type == kTypeArray) {
           node->expr_type = ident_info->expr_type;
-          return;
+          return false;
         }
         node->expr_type = CreateTypeLValue(ident_info->expr_type);
-        return;
+        return false;
       }
-      struct Node *global_var_type = FindGlobalVar(*ctx, node->op);
+      struct Node *global_var_type = FindGlobalVar(ctx, node->op);
       if (global_var_type) {
         AllocReg(node);
         node->expr_type = CreateTypeLValue(global_var_type);
-        return;
+        return false;
       }
-      struct Node *external_var_type = FindExternVar(*ctx, node->op);
+      struct Node *external_var_type = FindExternVar(ctx, node->op);
       if (external_var_type) {
         AllocReg(node);
         node->expr_type = CreateTypeLValue(external_var_type);
-        return;
+        return false;
       }
-      struct Node *func_def = FindFuncDef(*ctx, node->op);
+      struct Node *func_def = FindFuncDef(ctx, node->op);
       if (func_def) {
         AllocReg(node);
         node->expr_type = func_def->func_type;
-        return;
+        return false;
       }
-      struct Node *func_decl_type = FindFuncDeclType(*ctx, node->op);
+      struct Node *func_decl_type = FindFuncDeclType(ctx, node->op);
       if (func_decl_type) {
         AllocReg(node);
         node->expr_type = GetTypeWithoutAttr(func_decl_type);
-        return;
+        return false;
       }
       ErrorWithToken(node->op, "Unknown identifier");
     } else if (node->cond) {
-      AnalyzeNode(node->cond, ctx);
-      AnalyzeNode(node->left, ctx);
-      AnalyzeNode(node->right, ctx);
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->cond, 0);
+        case 1:
+          return VisitChild(f, 2, node->left, 0);
+        case 2:
+          return VisitChild(f, 3, node->right, 0);
+      }
       FreeReg(node->left->reg);
       FreeReg(node->right->reg);
       assert(
           IsSameTypeExceptAttr(node->left->expr_type, node->right->expr_type));
       node->reg = node->cond->reg;
       node->expr_type = GetRValueType(node->right->expr_type);
-      return;
+      return false;
     } else if (!node->left && node->right) {
-      AnalyzeNode(node->right, ctx);
-      if (IsEqualTokenWithCStr(node->op, "--") ||
-          IsEqualTokenWithCStr(node->op, "++")) {
+      if (!f->step) return VisitChild(f, 1, node->right, 0);
+      if (IsPunctuator(node->op, kPunctDec) ||
+          IsPunctuator(node->op, kPunctInc)) {
         assert(IsLValueType(node->right->expr_type));
         node->reg = node->right->reg;
         node->expr_type = GetRValueType(node->right->expr_type);
-        return;
+        return false;
       }
       if (IsTokenWithType(node->op, kTokenKwSizeof)) {
         FreeReg(node->right->reg);
         AllocReg(node);
         node->expr_type = CreateTypeBase(CreateToken("int"));
-        return;
+        return false;
       }
       node->reg = node->right->reg;
-      if (IsEqualTokenWithCStr(node->op, "&")) {
+      if (IsPunctuator(node->op, kPunctAnd)) {
         node->expr_type =
             CreateTypePointer(GetRValueType(node->right->expr_type));
-        return;
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "*")) {
+      if (IsPunctuator(node->op, kPunctStar)) {
         struct Node *rtype = GetRValueType(node->right->expr_type);
         assert(rtype && rtype->type == kTypePointer);
         node->expr_type = CreateTypeLValue(rtype->right);
-        return;
+        return false;
       }
       node->expr_type = GetRValueType(node->right->expr_type);
-      return;
+      return false;
     } else if (node->left && !node->right) {
       // Postfix op
-      if (IsEqualTokenWithCStr(node->op, "++") ||
-          IsEqualTokenWithCStr(node->op, "--")) {
-        AnalyzeNode(node->left, ctx);
+      if (IsPunctuator(node->op, kPunctInc) ||
+          IsPunctuator(node->op, kPunctDec)) {
+        if (!f->step) return VisitChild(f, 1, node->left, 0);
         assert(IsLValueType(node->left->expr_type));
         node->reg = node->left->reg;
         node->expr_type = GetRValueType(node->left->expr_type);
-        return;
+        return false;
       }
     } else if (node->left && node->right) {
-      AnalyzeNode(node->left, ctx);
-      AnalyzeNode(node->right, ctx);
-      if (IsEqualTokenWithCStr(node->op, "=") ||
-          IsEqualTokenWithCStr(node->op, ",")) {
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->left, 0);
+        case 1:
+          return VisitChild(f, 2, node->right, 0);
+      }
+      if (IsPunctuator(node->op, kPunctAssign) ||
+          IsPunctuator(node->op, kPunctComma)) {
         FreeReg(node->left->reg);
         node->reg = node->right->reg;
         node->expr_type = GetRValueType(node->right->expr_type);
-        return;
+        return false;
       }
       FreeReg(node->right->reg);
       node->reg = node->left->reg;
       node->expr_type = GetRValueType(node->left->expr_type);
-      return;
+      return false;
     }
     assert(false);
   }
   if (node->type == kASTExprStmt) {
-    if (!node->left) return;
-    AnalyzeNode(node->left, ctx);
+    if (!node->left) return false;
+    if (!f->step) return VisitChild(f, 1, node->left, 0);
     if (node->left->reg) FreeReg(node->left->reg);
-    return;
+    return false;
   } else if (node->type == kASTList) {
-    struct SymbolEntry *saved_ctx = *ctx;
-    for (int i = 0; i < GetSizeOfList(node); i++) {
-      AnalyzeNode(GetNodeAt(node, i), ctx);
-    }
-    *ctx = saved_ctx;
-    return;
+    if (!f->step) PushSymbolScope(ctx);
+    if (VisitNextElement(f, 1, node, 0)) return true;
+    PopSymbolScope(ctx);
+    return false;
   } else if (node->type == kASTDecl) {
-    struct Node *raw_type = CreateTypeInContext(*ctx, node->op, node->right);
-    PrintASTNode(raw_type);
+    if (f->step) {
+      // Returned from the init expr
+      FreeReg(GetDecltorInitExpr(node->right)->reg);
+      return false;
+    }
+    struct Node *raw_type = CreateTypeInContext(ctx, node->op, node->right);
+    TRACE_AST(kTraceAnalyze, raw_type);
     assert(raw_type);
     struct Node *type_ident = NULL;
     if (raw_type && raw_type->type == kTypeAttrIdent) {
@@ -273,95 +289,107 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
     struct Node *type = GetTypeWithoutAttr(raw_type);
     assert(type);
 
-    if (!in_function) {
+    if (!compiler->in_function) {
       // Top-level definitions
       if (IsASTDeclOfTypedef(node)) {
-        return;
+        return false;
       }
       if (type_ident && type->type == kTypeFunction) {
-        AddFuncDeclType(ctx, CreateTokenStr(type_ident), raw_type);
-        return;
+        AddFuncDeclType(ctx, type_ident->atom, raw_type);
+        return false;
       }
       if (!type_ident && type->type == kTypeStruct) {
         struct Node *spec = type->type_struct_spec;
-        ResolveTypesOfMembersOfStruct(*ctx, spec);
+        ResolveTypesOfMembersOfStruct(ctx, spec);
         assert(type->tag);
-        AddStructType(ctx, CreateTokenStr(type->tag), type);
-        return;
+        AddStructType(ctx, type->tag->atom, type);
+        return false;
       }
       assert(type_ident);
       if (IsASTDeclOfExtern(node)) {
-        AddExternVar(ctx, CreateTokenStr(type_ident), type);
+        AddExternVar(ctx, type_ident->atom, type);
       } else {
-        AddGlobalVar(ctx, CreateTokenStr(type_ident), type);
+        AddGlobalVar(ctx, type_ident->atom, type);
       }
       assert(node->right->type == kASTDecltor);
-      if (node->right->decltor_init_expr) {
+      if (GetDecltorInitExpr(node->right)) {
         assert(false);
       }
-      return;
+      return false;
     }
     // Local definitions
     assert(type_ident);
-    AddLocalVar(ctx, CreateTokenStr(type_ident), type);
+    AddLocalVar(ctx, type_ident->atom, type);
     assert(node->right->type == kASTDecltor);
-    if (node->right->decltor_init_expr) {
+    struct Node *init_expr = GetDecltorInitExpr(node->right);
+    if (init_expr) {
       struct Node *left_expr = AllocNode(kASTExpr);
       left_expr->op = type_ident;
-      node->right->decltor_init_expr->left = left_expr;
-      AnalyzeNode(node->right->decltor_init_expr, ctx);
-      FreeReg(node->right->decltor_init_expr->reg);
+      init_expr->left = left_expr;
+      return VisitChild(f, 1, init_expr, 0);
     }
-    return;
+    return false;
   } else if (node->type == kASTJumpStmt) {
     if (IsTokenWithType(node->op, kTokenKwBreak) ||
         IsTokenWithType(node->op, kTokenKwContinue)) {
-      return;
+      return false;
     }
     if (IsTokenWithType(node->op, kTokenKwReturn)) {
-      if (!node->right) return;
-      AnalyzeNode(node->right, ctx);
+      if (!node->right) return false;
+      if (!f->step) return VisitChild(f, 1, node->right, 0);
       FreeReg(node->right->reg);
-      return;
+      return false;
     }
   } else if (node->type == kASTSelectionStmt) {
     if (IsTokenWithType(node->op, kTokenKwIf)) {
-      AnalyzeNode(node->cond, ctx);
-      FreeReg(node->cond->reg);
-      AnalyzeNode(node->if_true_stmt, ctx);
-      if (node->if_else_stmt) {
-        AnalyzeNode(node->if_else_stmt, ctx);
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->cond, 0);
+        case 1:
+          FreeReg(node->cond->reg);
+          return VisitChild(f, 2, node->if_true_stmt, 0);
+        case 2:
+          if (node->if_else_stmt) {
+            return VisitChild(f, 3, node->if_else_stmt, 0);
+          }
       }
-      return;
+      return false;
     }
   } else if (node->type == kASTForStmt) {
-    if (node->init) {
-      AnalyzeNode(node->init, ctx);
-      if (node->init->reg) FreeReg(node->init->reg);
+    switch (f->step) {
+      case 0:
+        if (node->init) return VisitChild(f, 1, node->init, 0);
+        // fallthrough
+      case 1:
+        if (node->init && node->init->reg) FreeReg(node->init->reg);
+        if (node->cond) return VisitChild(f, 2, node->cond, 0);
+        // fallthrough
+      case 2:
+        if (node->cond) FreeReg(node->cond->reg);
+        if (node->updt) return VisitChild(f, 3, node->updt, 0);
+        // fallthrough
+      case 3:
+        if (node->updt) FreeReg(node->updt->reg);
+        return VisitChild(f, 4, node->body, 0);
     }
-    if (node->cond) {
-      AnalyzeNode(node->cond, ctx);
-      FreeReg(node->cond->reg);
-    }
-    if (node->updt) {
-      AnalyzeNode(node->updt, ctx);
-      FreeReg(node->updt->reg);
-    }
-    AnalyzeNode(node->body, ctx);
-    return;
+    return false;
   } else if (node->type == kASTWhileStmt) {
-    AnalyzeNode(node->cond, ctx);
-    FreeReg(node->cond->reg);
-    AnalyzeNode(node->body, ctx);
-    return;
+    switch (f->step) {
+      case 0:
+        return VisitChild(f, 1, node->cond, 0);
+      case 1:
+        FreeReg(node->cond->reg);
+        return VisitChild(f, 2, node->body, 0);
+    }
+    return false;
   }
   ErrorWithToken(node->op, "AnalyzeNode: Not implemented");
 }
 
-struct SymbolEntry *Analyze(struct Node *ast) {
+struct SymbolTable *Analyze(struct Node *ast) {
   // Returns root context of symbols (including global vars)
-  struct SymbolEntry *root_ctx = NULL;
-  in_function = NULL;
-  AnalyzeNode(ast, &root_ctx);
+  struct SymbolTable *root_ctx = AllocSymbolTable();
+  compiler->in_function = NULL;
+  Traverse(ast, 0, AnalyzeStep, root_ctx);
   return root_ctx;
 }
@@ -0,0 +1,152 @@
+#include "compilium.h"
+
+// Bump-pointer arenas, one for each phase of the compilation.
+// Objects are never freed one by one; all of them are released at once
+// by ReleaseAllArenas() when the compilation is finished.
+// The compile server empties the arenas by RecycleArenas() instead, and
+// keeps kArenaCache (interned strings and cached headers) between
+// compilations. Recycled chunks are reused without being allocated again.
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 8
+
+struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size;
+  size_t used;
+  char data[];
+};
+
+static const char *arena_names[kNumOfArenas] = {
+    [kArenaLex] = "lex",
+    [kArenaParse] = "parse",
+    [kArenaAnalysis] = "analysis",
+    [kArenaCodegen] = "codegen",
+    [kArenaCache] = "cache",
+};
+
+enum ArenaKind SetCurrentArena(enum ArenaKind kind) {
+  // Returns the arena which was current before the call.
+  assert(0 <= kind && kind < kNumOfArenas);
+  enum ArenaKind prev = compiler->current_arena;
+  compiler->current_arena = kind;
+  return prev;
+}
+
+static struct ArenaChunk *AllocArenaChunk(struct Arena *a, size_t size) {
+  if (size == ARENA_CHUNK_SIZE && a->free_chunks) {
+    struct ArenaChunk *c = a->free_chunks;
+    a->free_chunks = c->next;
+    c->next = NULL;
+    return c;
+  }
+  struct ArenaChunk *c = calloc(1, sizeof(struct ArenaChunk) + size);
+  assert(c);
+  c->size = size;
+  a->num_of_reserved += size;
+  return c;
+}
+
+void *ArenaAlloc(size_t size) {
+  // Returns zero-initialized memory from the current arena.
+  struct Arena *a = &compiler->arenas[compiler->current_arena];
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  STAT_CALL(kStatArenaAlloc);
+  STAT_STEPS(kStatArenaAlloc, size);
+  a->num_of_bytes += size;
+  a->num_of_objects++;
+  struct ArenaChunk *c = a->chunks;
+  if (!c || c->size - c->used < size) {
+    if (size > ARENA_CHUNK_SIZE / 4) {
+      // Large objects get their own chunk behind the current one
+      // so that the rest of the current chunk is still used.
+      struct ArenaChunk *large = AllocArenaChunk(a, size);
+      large->used = size;
+      if (c) {
+        large->next = c->next;
+        c->next = large;
+      } else {
+        a->chunks = large;
+      }
+      return large->data;
+    }
+    c = AllocArenaChunk(a, ARENA_CHUNK_SIZE);
+    c->next = a->chunks;
+    a->chunks = c;
+  }
+  void *p = c->data + c->used;
+  c->used += size;
+  return p;
+}
+
+char *ArenaStrndup(const char *s, size_t n) {
+  size_t len = 0;
+  while (len < n && s[len]) len++;
+  char *d = ArenaAlloc(len + 1);
+  memcpy(d, s, len);
+  return d;
+}
+
+char *ArenaStrdup(const char *s) { return ArenaStrndup(s, strlen(s)); }
+
+static void FreeArenaChunks(struct ArenaChunk *c) {
+  struct ArenaChunk *next;
+  for (; c; c = next) {
+    next = c->next;
+    free(c);
+  }
+}
+
+void ReleaseAllArenas(void) {
+  for (int i = 0; i < kNumOfArenas; i++) {
+    struct Arena *a = &compiler->arenas[i];
+    FreeArenaChunks(a->chunks);
+    FreeArenaChunks(a->free_chunks);
+    *a = (struct Arena){0};
+  }
+  compiler->current_arena = kArenaLex;
+}
+
+void RecycleArenas(void) {
+  // Empties the arenas except kArenaCache. Chunks of the default size are
+  // cleared and kept for the next compilation, and larger ones are freed.
+  for (int i = 0; i < kNumOfArenas; i++) {
+    if (i == kArenaCache) continue;
+    struct Arena *a = &compiler->arenas[i];
+    struct ArenaChunk *next;
+    for (struct ArenaChunk *c = a->chunks; c; c = next) {
+      next = c->next;
+      if (c->size != ARENA_CHUNK_SIZE) {
+        a->num_of_reserved -= c->size;
+        free(c);
+        continue;
+      }
+      memset(c->data, 0, c->used);
+      c->used = 0;
+      c->next = a->free_chunks;
+      a->free_chunks = c;
+    }
+    a->chunks = NULL;
+    a->num_of_bytes = 0;
+    a->num_of_objects = 0;
+  }
+  compiler->current_arena = kArenaLex;
+}
+
+void PrintAllocReport(FILE *fp) {
+  size_t total_bytes = 0;
+  size_t total_reserved = 0;
+  int total_objects = 0;
+  fprintf(fp, "%-10s %10s %12s %12s\n", "arena", "objects", "bytes",
+          "reserved");
+  for (int i = 0; i < kNumOfArenas; i++) {
+    struct Arena *a = &compiler->arenas[i];
+    fprintf(fp, "%-10s %10d %12lu %12lu\n", arena_names[i], a->num_of_objects,
+            a->num_of_bytes, a->num_of_reserved);
+    total_objects += a->num_of_objects;
+    total_bytes += a->num_of_bytes;
+    total_reserved += a->num_of_reserved;
+  }
+  fprintf(fp, "%-10s %10d %12lu %12lu\n", "total", total_objects, total_bytes,
+          total_reserved);
+}
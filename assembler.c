@@ -0,0 +1,791 @@
+#include "compilium.h"
+
+// In-process assembler for -c.
+// Encodes the Intel-syntax assembly emitted by the generator into an
+// ELFObject, so that an object file is written without running an external
+// assembler. Only the instructions, operand forms and directives which the
+// generator uses are supported; anything else is an error.
+// A reference to a label is encoded as a 32-bit field and fixed up after
+// the whole text is read: jumps to local labels in .text are resolved here,
+// and the others become relocations. Jumps are always encoded with rel32.
+
+#define ASM_SYMBOL_HASH_SIZE 4096
+#define ASM_MAX_OPERANDS 3
+#define ASM_MAX_INSTRUCTION_SIZE 15
+#define ASM_REG_RIP 16  // base register of [rip + symbol]
+
+enum AsmOperandKind {
+  kAsmOperandReg,
+  kAsmOperandMem,
+  kAsmOperandImm,
+  kAsmOperandLabel,
+};
+
+struct AsmSymbol {
+  const char *name;              // atom
+  enum ELFSectionIndex section;  // kELFSectionUndef until defined
+  int offset;
+  bool is_global;
+  int elf_index;           // in ELFObject.symbols, or -1
+  struct AsmSymbol *next;  // in the same bucket
+};
+
+struct AsmOperand {
+  enum AsmOperandKind kind;
+  int size;    // in bytes, or 0 for a memory operand without "ptr"
+  int reg;     // register, or base register of a memory operand
+  long value;  // immediate, or displacement of a memory operand
+  struct AsmSymbol *symbol;  // label, or symbol of [rip + symbol]
+  bool is_gotpcrel;
+};
+
+struct AsmFixup {
+  int offset;  // of the 32-bit field in .text
+  int type;    // of the relocation if it is not resolved
+  long addend;
+  struct AsmSymbol *symbol;
+};
+
+struct Assembler {
+  struct ELFObject obj;
+  enum ELFSectionIndex section;  // current
+  struct AsmSymbol *buckets[ASM_SYMBOL_HASH_SIZE];
+  struct ObjBuffer symbols;  // of struct AsmSymbol *, in order of appearance
+  struct ObjBuffer fixups;   // of struct AsmFixup
+  // The line being assembled
+  const char *line;
+  const char *p;
+  int line_number;
+  // The instruction being encoded
+  unsigned char code[ASM_MAX_INSTRUCTION_SIZE];
+  int code_size;
+};
+
+struct AsmRegister {
+  const char *name;
+  int reg;
+  int size;
+};
+
+static const struct AsmRegister asm_registers[] = {
+    {"rax", 0, 8},   {"rcx", 1, 8},   {"rdx", 2, 8},   {"rbx", 3, 8},
+    {"rsp", 4, 8},   {"rbp", 5, 8},   {"rsi", 6, 8},   {"rdi", 7, 8},
+    {"r8", 8, 8},    {"r9", 9, 8},    {"r10", 10, 8},  {"r11", 11, 8},
+    {"r12", 12, 8},  {"r13", 13, 8},  {"r14", 14, 8},  {"r15", 15, 8},
+    {"eax", 0, 4},   {"ecx", 1, 4},   {"edx", 2, 4},   {"ebx", 3, 4},
+    {"esp", 4, 4},   {"ebp", 5, 4},   {"esi", 6, 4},   {"edi", 7, 4},
+    {"r8d", 8, 4},   {"r9d", 9, 4},   {"r10d", 10, 4}, {"r11d", 11, 4},
+    {"r12d", 12, 4}, {"r13d", 13, 4}, {"r14d", 14, 4}, {"r15d", 15, 4},
+    {"al", 0, 1},    {"cl", 1, 1},    {"dl", 2, 1},    {"bl", 3, 1},
+    {"spl", 4, 1},   {"bpl", 5, 1},   {"sil", 6, 1},   {"dil", 7, 1},
+    {"r8b", 8, 1},   {"r9b", 9, 1},   {"r10b", 10, 1}, {"r11b", 11, 1},
+    {"r12b", 12, 1}, {"r13b", 13, 1}, {"r14b", 14, 1}, {"r15b", 15, 1},
+};
+
+static const struct {
+  const char *name;
+  int code;
+} asm_condition_codes[] = {
+    {"o", 0x0},   {"no", 0x1}, {"b", 0x2},  {"c", 0x2},   {"nae", 0x2},
+    {"ae", 0x3},  {"nb", 0x3}, {"nc", 0x3}, {"e", 0x4},   {"z", 0x4},
+    {"ne", 0x5},  {"nz", 0x5}, {"be", 0x6}, {"na", 0x6},  {"a", 0x7},
+    {"nbe", 0x7}, {"s", 0x8},  {"ns", 0x9}, {"p", 0xA},   {"pe", 0xA},
+    {"np", 0xB},  {"po", 0xB}, {"l", 0xC},  {"nge", 0xC}, {"ge", 0xD},
+    {"nl", 0xD},  {"le", 0xE}, {"ng", 0xE}, {"g", 0xF},   {"nle", 0xF},
+};
+
+// Instructions which are told apart by the opcode extension in the reg
+// field of ModRM. opcode is for operands of 2 bytes or more; the byte form
+// is opcode - 1.
+struct AsmExtInstruction {
+  const char *name;
+  int opcode;
+  int ext;
+};
+
+static const struct AsmExtInstruction asm_unary_instructions[] = {
+    {"inc", 0xFF, 0}, {"dec", 0xFF, 1}, {"not", 0xF7, 2},  {"neg", 0xF7, 3},
+    {"mul", 0xF7, 4}, {"div", 0xF7, 6}, {"idiv", 0xF7, 7},
+};
+
+static const struct AsmExtInstruction asm_alu_instructions[] = {
+    {"add", 0x81, 0}, {"or", 0x81, 1},  {"and", 0x81, 4},
+    {"sub", 0x81, 5}, {"xor", 0x81, 6}, {"cmp", 0x81, 7},
+};
+
+static const struct AsmExtInstruction asm_shift_instructions[] = {
+    {"shl", 0xD3, 4}, {"sal", 0xD3, 4}, {"shr", 0xD3, 5}, {"sar", 0xD3, 7},
+};
+
+static _Noreturn void ErrorInAssembly(struct Assembler *as, const char *msg) {
+  const char *end = as->line;
+  while (*end && *end != '\n') end++;
+  Error("Assembler: %s at line %d: %.*s", msg, as->line_number,
+        (int)(end - as->line), as->line);
+}
+
+static struct ObjBuffer *GetCurrentSection(struct Assembler *as) {
+  return as->section == kELFSectionData ? &as->obj.data : &as->obj.text;
+}
+
+static struct AsmSymbol *GetAsmSymbol(struct Assembler *as, const char *begin,
+                                      int length) {
+  const char *name = InternStr(begin, length);
+  struct AsmSymbol **bucket =
+      &as->buckets[((unsigned long)name >> 3) % ASM_SYMBOL_HASH_SIZE];
+  for (struct AsmSymbol *s = *bucket; s; s = s->next) {
+    if (s->name == name) return s;
+  }
+  struct AsmSymbol *s = ArenaAlloc(sizeof(*s));
+  s->name = name;
+  s->elf_index = -1;
+  s->next = *bucket;
+  *bucket = s;
+  AppendToObjBuffer(&as->symbols, &s, sizeof(s));
+  return s;
+}
+
+static bool IsLocalAsmLabel(struct AsmSymbol *s) {
+  // Labels generated for jumps and strings (L<number>) are not exported.
+  return !s->is_global && s->name[0] == 'L' && '0' <= s->name[1] &&
+         s->name[1] <= '9';
+}
+
+// Lexer
+
+static void SkipAsmSpaces(struct Assembler *as) {
+  while (*as->p == ' ' || *as->p == '\t') as->p++;
+}
+
+static bool IsAsmNameChar(char c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+         ('0' <= c && c <= '9') || c == '_' || c == '.' || c == '$';
+}
+
+static int ReadAsmName(struct Assembler *as, const char **begin) {
+  // Returns the length of the name, or 0 if there is no name at as->p.
+  SkipAsmSpaces(as);
+  *begin = as->p;
+  while (IsAsmNameChar(*as->p)) as->p++;
+  return as->p - *begin;
+}
+
+static bool IsAsmWord(const char *begin, int length, const char *word) {
+  return (int)strlen(word) == length && strncmp(begin, word, length) == 0;
+}
+
+static bool ConsumeAsmChar(struct Assembler *as, char c) {
+  SkipAsmSpaces(as);
+  if (*as->p != c) return false;
+  as->p++;
+  return true;
+}
+
+static void ExpectAsmChar(struct Assembler *as, char c) {
+  if (!ConsumeAsmChar(as, c)) ErrorInAssembly(as, "Unexpected character");
+}
+
+static bool IsEndOfAsmLine(struct Assembler *as) {
+  SkipAsmSpaces(as);
+  char c = *as->p;
+  return !c || c == '\n' || c == '#' || (c == '/' && as->p[1] == '/');
+}
+
+static long ReadAsmNumber(struct Assembler *as) {
+  SkipAsmSpaces(as);
+  char *end;
+  long value = strtol(as->p, &end, 0);
+  if (end == as->p) ErrorInAssembly(as, "Number expected");
+  as->p = end;
+  return value;
+}
+
+// Operands
+
+static const struct AsmRegister *FindAsmRegister(const char *begin,
+                                                 int length) {
+  for (int i = 0; i < (int)(sizeof(asm_registers) / sizeof(asm_registers[0]));
+       i++) {
+    if (IsAsmWord(begin, length, asm_registers[i].name)) {
+      return &asm_registers[i];
+    }
+  }
+  return NULL;
+}
+
+static void ParseAsmMemory(struct Assembler *as, struct AsmOperand *op) {
+  // [base], [base + disp], [base - disp] or [rip + symbol(@GOTPCREL)]
+  // after '['.
+  op->kind = kAsmOperandMem;
+  const char *begin;
+  int length = ReadAsmName(as, &begin);
+  const struct AsmRegister *r = FindAsmRegister(begin, length);
+  if (IsAsmWord(begin, length, "rip")) {
+    op->reg = ASM_REG_RIP;
+    ExpectAsmChar(as, '+');
+    length = ReadAsmName(as, &begin);
+    if (!length) ErrorInAssembly(as, "Symbol expected");
+    op->symbol = GetAsmSymbol(as, begin, length);
+    if (ConsumeAsmChar(as, '@')) {
+      length = ReadAsmName(as, &begin);
+      if (!IsAsmWord(begin, length, "GOTPCREL")) {
+        ErrorInAssembly(as, "Unsupported relocation");
+      }
+      op->is_gotpcrel = true;
+    }
+  } else if (r && r->size == 8) {
+    op->reg = r->reg;
+    if (ConsumeAsmChar(as, '+')) {
+      op->value = ReadAsmNumber(as);
+    } else if (ConsumeAsmChar(as, '-')) {
+      op->value = -ReadAsmNumber(as);
+    }
+  } else {
+    ErrorInAssembly(as, "Base register expected");
+  }
+  ExpectAsmChar(as, ']');
+}
+
+static void ParseAsmOperand(struct Assembler *as, struct AsmOperand *op) {
+  *op = (struct AsmOperand){0};
+  SkipAsmSpaces(as);
+  char c = *as->p;
+  if (c == '-' || ('0' <= c && c <= '9')) {
+    op->kind = kAsmOperandImm;
+    op->value = ReadAsmNumber(as);
+    return;
+  }
+  if (ConsumeAsmChar(as, '[')) {
+    ParseAsmMemory(as, op);
+    return;
+  }
+  const char *begin;
+  int length = ReadAsmName(as, &begin);
+  if (!length) ErrorInAssembly(as, "Operand expected");
+  int size = IsAsmWord(begin, length, "qword")   ? 8
+             : IsAsmWord(begin, length, "dword") ? 4
+             : IsAsmWord(begin, length, "byte")  ? 1
+                                                 : 0;
+  if (size) {
+    length = ReadAsmName(as, &begin);
+    if (!IsAsmWord(begin, length, "ptr")) ErrorInAssembly(as, "ptr expected");
+    ExpectAsmChar(as, '[');
+    ParseAsmMemory(as, op);
+    op->size = size;
+    return;
+  }
+  const struct AsmRegister *r = FindAsmRegister(begin, length);
+  if (r) {
+    op->kind = kAsmOperandReg;
+    op->reg = r->reg;
+    op->size = r->size;
+    return;
+  }
+  op->kind = kAsmOperandLabel;
+  op->symbol = GetAsmSymbol(as, begin, length);
+}
+
+static int GetAsmOperandSize(struct Assembler *as, struct AsmOperand *op) {
+  if (!op->size) ErrorInAssembly(as, "Operand size is not specified");
+  return op->size;
+}
+
+static void ExpectAsmOperand(struct Assembler *as, struct AsmOperand *op,
+                             enum AsmOperandKind kind) {
+  if (op->kind != kind) ErrorInAssembly(as, "Unsupported operand");
+}
+
+static bool FitsInInt8(long v) { return -128 <= v && v <= 127; }
+
+static bool FitsInInt32(long v) {
+  return -2147483648L <= v && v <= 2147483647L;
+}
+
+// Encoder
+
+static void EmitCode(struct Assembler *as, int byte) {
+  assert(as->code_size < ASM_MAX_INSTRUCTION_SIZE);
+  as->code[as->code_size++] = byte;
+}
+
+static void EmitCodeValue(struct Assembler *as, long value, int size) {
+  for (int i = 0; i < size; i++) {
+    EmitCode(as, ((unsigned long)value >> (i * 8)) & 0xFF);
+  }
+}
+
+static void EmitCodeFixup(struct Assembler *as, struct AsmSymbol *symbol,
+                          int type, long addend) {
+  // Emits a 32-bit field which refers symbol relative to the field + addend.
+  if (as->section != kELFSectionText) {
+    ErrorInAssembly(as, "Labels can be referred only from .text");
+  }
+  struct AsmFixup fixup = {as->obj.text.size + as->code_size, type, addend,
+                           symbol};
+  AppendToObjBuffer(&as->fixups, &fixup, sizeof(fixup));
+  EmitCodeValue(as, 0, 4);
+}
+
+static bool NeedsREXForByteReg(struct AsmOperand *op) {
+  // spl, bpl, sil and dil are encoded as ah, ch, dh and bh without REX.
+  return op && op->kind == kAsmOperandReg && op->size == 1 && 4 <= op->reg &&
+         op->reg <= 7;
+}
+
+static void EmitREX(struct Assembler *as, int rex, bool is_rex_required) {
+  if (rex || is_rex_required) EmitCode(as, 0x40 | rex);
+}
+
+static void EncodeModRM(struct Assembler *as, int size, int opcode, int reg,
+                        struct AsmOperand *reg_op, struct AsmOperand *rm,
+                        int imm_size) {
+  // Encodes [REX] opcode ModRM [SIB] [disp] for operands of size bytes.
+  // reg is the register or the opcode extension in the reg field, and
+  // reg_op is its operand (NULL for an extension). opcode is 0x0Fxx for
+  // two-byte opcodes. imm_size is the size of the immediate which follows,
+  // which a rip-relative displacement has to skip.
+  if (rm->kind != kAsmOperandReg && rm->kind != kAsmOperandMem) {
+    ErrorInAssembly(as, "Register or memory operand expected");
+  }
+  int rex = (size == 8 ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm->reg & 8 ? 1 : 0);
+  EmitREX(as, rex, NeedsREXForByteReg(reg_op) || NeedsREXForByteReg(rm));
+  if (opcode > 0xFF) EmitCode(as, opcode >> 8);
+  EmitCode(as, opcode & 0xFF);
+  int reg_field = (reg & 7) << 3;
+  if (rm->kind == kAsmOperandReg) {
+    EmitCode(as, 0xC0 | reg_field | (rm->reg & 7));
+    return;
+  }
+  if (rm->reg == ASM_REG_RIP) {
+    EmitCode(as, reg_field | 5);
+    int type = R_X86_64_PC32;
+    if (rm->is_gotpcrel) {
+      // A load from the GOT which the linker may relax into lea.
+      type = opcode == 0x8B && rex ? R_X86_64_REX_GOTPCRELX : R_X86_64_GOTPCREL;
+    }
+    EmitCodeFixup(as, rm->symbol, type, -4 - imm_size);
+    return;
+  }
+  int base = rm->reg & 7;
+  // rbp and r13 as a base always need a displacement.
+  int mod = rm->value == 0 && base != 5 ? 0 : FitsInInt8(rm->value) ? 1 : 2;
+  if (!FitsInInt32(rm->value)) ErrorInAssembly(as, "Displacement too large");
+  EmitCode(as, mod << 6 | reg_field | base);
+  // rsp and r12 as a base need a SIB byte without index.
+  if (base == 4) EmitCode(as, 0x24);
+  if (mod == 1) EmitCodeValue(as, rm->value, 1);
+  if (mod == 2) EmitCodeValue(as, rm->value, 4);
+}
+
+static void AssembleMov(struct Assembler *as, struct AsmOperand *dst,
+                        struct AsmOperand *src) {
+  if (src->kind == kAsmOperandImm) {
+    int size = GetAsmOperandSize(as, dst);
+    if (dst->kind == kAsmOperandReg &&
+        (size != 8 || !FitsInInt32(src->value))) {
+      // B0+r ib, B8+r id, or REX.W B8+r iq (movabs)
+      EmitREX(as, (size == 8 ? 8 : 0) | (dst->reg & 8 ? 1 : 0),
+              NeedsREXForByteReg(dst));
+      EmitCode(as, (size == 1 ? 0xB0 : 0xB8) + (dst->reg & 7));
+      EmitCodeValue(as, src->value, size);
+      return;
+    }
+    int imm_size = size == 1 ? 1 : 4;
+    EncodeModRM(as, size, size == 1 ? 0xC6 : 0xC7, 0, NULL, dst, imm_size);
+    EmitCodeValue(as, src->value, imm_size);
+    return;
+  }
+  if (src->kind == kAsmOperandReg) {
+    EncodeModRM(as, src->size, src->size == 1 ? 0x88 : 0x89, src->reg, src,
+                dst, 0);
+    return;
+  }
+  ExpectAsmOperand(as, dst, kAsmOperandReg);
+  EncodeModRM(as, dst->size, dst->size == 1 ? 0x8A : 0x8B, dst->reg, dst, src,
+              0);
+}
+
+static void AssembleALU(struct Assembler *as, int ext, struct AsmOperand *dst,
+                        struct AsmOperand *src) {
+  if (src->kind == kAsmOperandImm) {
+    int size = GetAsmOperandSize(as, dst);
+    if (!FitsInInt32(src->value)) ErrorInAssembly(as, "Immediate too large");
+    int imm_size = size == 1 || FitsInInt8(src->value) ? 1 : 4;
+    if (imm_size == 4 && dst->kind == kAsmOperandReg && dst->reg == 0) {
+      // Short form for rax and eax
+      EmitREX(as, size == 8 ? 8 : 0, false);
+      EmitCode(as, ext << 3 | 5);
+    } else {
+      int opcode = size == 1 ? 0x80 : imm_size == 1 ? 0x83 : 0x81;
+      EncodeModRM(as, size, opcode, ext, NULL, dst, imm_size);
+    }
+    EmitCodeValue(as, src->value, imm_size);
+    return;
+  }
+  if (src->kind == kAsmOperandReg) {
+    EncodeModRM(as, src->size, ext << 3 | (src->size == 1 ? 0 : 1), src->reg,
+                src, dst, 0);
+    return;
+  }
+  ExpectAsmOperand(as, dst, kAsmOperandReg);
+  EncodeModRM(as, dst->size, ext << 3 | (dst->size == 1 ? 2 : 3), dst->reg,
+              dst, src, 0);
+}
+
+static void AssembleShift(struct Assembler *as, int ext,
+                          struct AsmOperand *dst, struct AsmOperand *src) {
+  int size = GetAsmOperandSize(as, dst);
+  int byte_form = size == 1 ? 1 : 0;
+  if (src->kind == kAsmOperandReg && src->reg == 1 && src->size == 1) {
+    EncodeModRM(as, size, 0xD3 - byte_form, ext, NULL, dst, 0);
+  } else if (src->kind == kAsmOperandImm && src->value == 1) {
+    EncodeModRM(as, size, 0xD1 - byte_form, ext, NULL, dst, 0);
+  } else if (src->kind == kAsmOperandImm && FitsInInt8(src->value)) {
+    EncodeModRM(as, size, 0xC1 - byte_form, ext, NULL, dst, 1);
+    EmitCodeValue(as, src->value, 1);
+  } else {
+    ErrorInAssembly(as, "Shift count should be cl or an immediate");
+  }
+}
+
+static void AssembleIMul(struct Assembler *as, struct AsmOperand *ops, int n) {
+  if (n == 1) {
+    int size = GetAsmOperandSize(as, &ops[0]);
+    EncodeModRM(as, size, size == 1 ? 0xF6 : 0xF7, 5, NULL, &ops[0], 0);
+    return;
+  }
+  ExpectAsmOperand(as, &ops[0], kAsmOperandReg);
+  if (n == 2) {
+    EncodeModRM(as, ops[0].size, 0x0FAF, ops[0].reg, &ops[0], &ops[1], 0);
+    return;
+  }
+  ExpectAsmOperand(as, &ops[2], kAsmOperandImm);
+  if (!FitsInInt32(ops[2].value)) ErrorInAssembly(as, "Immediate too large");
+  int imm_size = FitsInInt8(ops[2].value) ? 1 : 4;
+  EncodeModRM(as, ops[0].size, imm_size == 1 ? 0x6B : 0x69, ops[0].reg,
+              &ops[0], &ops[1], imm_size);
+  EmitCodeValue(as, ops[2].value, imm_size);
+}
+
+static void AssembleMovExtend(struct Assembler *as, int opcode, int src_size,
+                              struct AsmOperand *dst, struct AsmOperand *src) {
+  // movzx, movsx and movsxd
+  ExpectAsmOperand(as, dst, kAsmOperandReg);
+  if (src->size && src->size != src_size) {
+    ErrorInAssembly(as, "Unsupported operand size");
+  }
+  EncodeModRM(as, dst->size, opcode, dst->reg, dst, src, 0);
+}
+
+static void AssemblePushPop(struct Assembler *as, int opcode,
+                            struct AsmOperand *op) {
+  ExpectAsmOperand(as, op, kAsmOperandReg);
+  if (op->size != 8) ErrorInAssembly(as, "64-bit register expected");
+  EmitREX(as, op->reg & 8 ? 1 : 0, false);
+  EmitCode(as, opcode + (op->reg & 7));
+}
+
+static void AssembleBranch(struct Assembler *as, int opcode, int ext,
+                           struct AsmOperand *op) {
+  // call, jmp (opcode) and jcc (0x0F8x) to a label with rel32, or call and
+  // jmp to a register (FF /ext).
+  if (op->kind == kAsmOperandReg) {
+    if (op->size != 8) ErrorInAssembly(as, "64-bit register expected");
+    EncodeModRM(as, 4, 0xFF, ext, NULL, op, 0);
+    return;
+  }
+  ExpectAsmOperand(as, op, kAsmOperandLabel);
+  if (opcode > 0xFF) EmitCode(as, opcode >> 8);
+  EmitCode(as, opcode & 0xFF);
+  EmitCodeFixup(as, op->symbol, R_X86_64_PLT32, -4);
+}
+
+static int FindAsmConditionCode(const char *cc) {
+  for (int i = 0;
+       i < (int)(sizeof(asm_condition_codes) / sizeof(asm_condition_codes[0]));
+       i++) {
+    if (strcmp(asm_condition_codes[i].name, cc) == 0) {
+      return asm_condition_codes[i].code;
+    }
+  }
+  return -1;
+}
+
+static const struct AsmExtInstruction *FindAsmExtInstruction(
+    const struct AsmExtInstruction *table, int size, const char *mnemonic) {
+  for (int i = 0; i < size; i++) {
+    if (strcmp(table[i].name, mnemonic) == 0) return &table[i];
+  }
+  return NULL;
+}
+
+#define FIND_ASM_EXT_INSTRUCTION(table, mnemonic) \
+  FindAsmExtInstruction(table, sizeof(table) / sizeof(table[0]), mnemonic)
+
+static void ExpectNumOfAsmOperands(struct Assembler *as, int n, int expected) {
+  if (n != expected) ErrorInAssembly(as, "Wrong number of operands");
+}
+
+static void AssembleInstruction(struct Assembler *as, const char *begin,
+                                int length) {
+  char mnemonic[16];
+  if (length >= (int)sizeof(mnemonic)) {
+    ErrorInAssembly(as, "Unknown instruction");
+  }
+  memcpy(mnemonic, begin, length);
+  mnemonic[length] = 0;
+  struct AsmOperand ops[ASM_MAX_OPERANDS];
+  int n = 0;
+  if (!IsEndOfAsmLine(as)) {
+    do {
+      if (n == ASM_MAX_OPERANDS) ErrorInAssembly(as, "Too many operands");
+      ParseAsmOperand(as, &ops[n++]);
+    } while (ConsumeAsmChar(as, ','));
+  }
+  const struct AsmExtInstruction *ins;
+  int cc;
+  if (strcmp(mnemonic, "mov") == 0) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    AssembleMov(as, &ops[0], &ops[1]);
+  } else if ((ins = FIND_ASM_EXT_INSTRUCTION(asm_alu_instructions,
+                                             mnemonic))) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    AssembleALU(as, ins->ext, &ops[0], &ops[1]);
+  } else if ((ins = FIND_ASM_EXT_INSTRUCTION(asm_unary_instructions,
+                                             mnemonic))) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    int size = GetAsmOperandSize(as, &ops[0]);
+    EncodeModRM(as, size, size == 1 ? ins->opcode - 1 : ins->opcode,
+                ins->ext, NULL, &ops[0], 0);
+  } else if ((ins = FIND_ASM_EXT_INSTRUCTION(asm_shift_instructions,
+                                             mnemonic))) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    AssembleShift(as, ins->ext, &ops[0], &ops[1]);
+  } else if (strcmp(mnemonic, "imul") == 0) {
+    if (!n) ErrorInAssembly(as, "Wrong number of operands");
+    AssembleIMul(as, ops, n);
+  } else if (strcmp(mnemonic, "lea") == 0) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    ExpectAsmOperand(as, &ops[0], kAsmOperandReg);
+    ExpectAsmOperand(as, &ops[1], kAsmOperandMem);
+    EncodeModRM(as, ops[0].size, 0x8D, ops[0].reg, &ops[0], &ops[1], 0);
+  } else if (strcmp(mnemonic, "movzx") == 0) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    AssembleMovExtend(as, 0x0FB6, 1, &ops[0], &ops[1]);
+  } else if (strcmp(mnemonic, "movsx") == 0 ||
+             strcmp(mnemonic, "movsxb") == 0) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    AssembleMovExtend(as, 0x0FBE, 1, &ops[0], &ops[1]);
+  } else if (strcmp(mnemonic, "movsxd") == 0) {
+    ExpectNumOfAsmOperands(as, n, 2);
+    AssembleMovExtend(as, 0x63, 4, &ops[0], &ops[1]);
+  } else if (strcmp(mnemonic, "push") == 0) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    AssemblePushPop(as, 0x50, &ops[0]);
+  } else if (strcmp(mnemonic, "pop") == 0) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    AssemblePushPop(as, 0x58, &ops[0]);
+  } else if (strcmp(mnemonic, "call") == 0) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    AssembleBranch(as, 0xE8, 2, &ops[0]);
+  } else if (strcmp(mnemonic, "jmp") == 0) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    AssembleBranch(as, 0xE9, 4, &ops[0]);
+  } else if (mnemonic[0] == 'j' &&
+             (cc = FindAsmConditionCode(mnemonic + 1)) >= 0) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    ExpectAsmOperand(as, &ops[0], kAsmOperandLabel);
+    AssembleBranch(as, 0x0F80 | cc, 0, &ops[0]);
+  } else if (strncmp(mnemonic, "set", 3) == 0 &&
+             (cc = FindAsmConditionCode(mnemonic + 3)) >= 0) {
+    ExpectNumOfAsmOperands(as, n, 1);
+    if (GetAsmOperandSize(as, &ops[0]) != 1) {
+      ErrorInAssembly(as, "Byte operand expected");
+    }
+    EncodeModRM(as, 1, 0x0F90 | cc, 0, NULL, &ops[0], 0);
+  } else if (strcmp(mnemonic, "ret") == 0) {
+    ExpectNumOfAsmOperands(as, n, 0);
+    EmitCode(as, 0xC3);
+  } else {
+    ErrorInAssembly(as, "Unknown instruction");
+  }
+  AppendToObjBuffer(&as->obj.text, as->code, as->code_size);
+  as->code_size = 0;
+}
+
+// Directives
+
+static char ReadAsmEscapedChar(struct Assembler *as) {
+  // Reads the escape sequence after a backslash, as in C.
+  char c = *as->p++;
+  switch (c) {
+    case 'a':
+      return '\a';
+    case 'b':
+      return '\b';
+    case 'f':
+      return '\f';
+    case 'n':
+      return '\n';
+    case 'r':
+      return '\r';
+    case 't':
+      return '\t';
+    case 'v':
+      return '\v';
+    case 'x': {
+      char *end;
+      long value = strtol(as->p, &end, 16);
+      if (end == as->p) ErrorInAssembly(as, "Hex digits expected");
+      as->p = end;
+      return value;
+    }
+  }
+  if ('0' <= c && c <= '7') {
+    int value = c - '0';
+    for (int i = 0; i < 2 && '0' <= *as->p && *as->p <= '7'; i++) {
+      value = value * 8 + (*as->p++ - '0');
+    }
+    return value;
+  }
+  if (c == '\n' || !c) ErrorInAssembly(as, "Unterminated string");
+  return c;
+}
+
+static void AssembleString(struct Assembler *as) {
+  // .asciz "..."
+  struct ObjBuffer *section = GetCurrentSection(as);
+  ExpectAsmChar(as, '"');
+  for (;;) {
+    char c = *as->p++;
+    if (c == '"') break;
+    if (c == '\n' || !c) ErrorInAssembly(as, "Unterminated string");
+    if (c == '\\') c = ReadAsmEscapedChar(as);
+    AppendToObjBuffer(section, &c, 1);
+  }
+  AppendToObjBuffer(section, "", 1);
+}
+
+static void AssembleDirective(struct Assembler *as, const char *begin,
+                              int length) {
+  if (IsAsmWord(begin, length, ".intel_syntax")) {
+    ReadAsmName(as, &begin);
+  } else if (IsAsmWord(begin, length, ".text")) {
+    as->section = kELFSectionText;
+  } else if (IsAsmWord(begin, length, ".data")) {
+    as->section = kELFSectionData;
+  } else if (IsAsmWord(begin, length, ".global") ||
+             IsAsmWord(begin, length, ".globl")) {
+    length = ReadAsmName(as, &begin);
+    if (!length) ErrorInAssembly(as, "Symbol expected");
+    GetAsmSymbol(as, begin, length)->is_global = true;
+  } else if (IsAsmWord(begin, length, ".asciz")) {
+    AssembleString(as);
+  } else if (IsAsmWord(begin, length, ".byte")) {
+    do {
+      char c = ReadAsmNumber(as);
+      AppendToObjBuffer(GetCurrentSection(as), &c, 1);
+    } while (ConsumeAsmChar(as, ','));
+  } else {
+    ErrorInAssembly(as, "Unknown directive");
+  }
+}
+
+static void DefineAsmLabel(struct Assembler *as, const char *begin,
+                           int length) {
+  struct AsmSymbol *s = GetAsmSymbol(as, begin, length);
+  if (s->section != kELFSectionUndef) {
+    ErrorInAssembly(as, "Label is already defined");
+  }
+  s->section = as->section;
+  s->offset = GetCurrentSection(as)->size;
+}
+
+static void AssembleLine(struct Assembler *as) {
+  // A line has labels followed by an instruction or a directive, all of
+  // which are optional.
+  while (!IsEndOfAsmLine(as)) {
+    const char *begin;
+    int length = ReadAsmName(as, &begin);
+    if (!length) ErrorInAssembly(as, "Unexpected character");
+    if (ConsumeAsmChar(as, ':')) {
+      DefineAsmLabel(as, begin, length);
+      continue;
+    }
+    if (begin[0] == '.') {
+      AssembleDirective(as, begin, length);
+    } else {
+      AssembleInstruction(as, begin, length);
+    }
+    if (!IsEndOfAsmLine(as)) ErrorInAssembly(as, "Unexpected character");
+    return;
+  }
+}
+
+// Symbols and relocations
+
+static void AddELFSymbols(struct Assembler *as) {
+  struct AsmSymbol **symbols = (struct AsmSymbol **)as->symbols.data;
+  int num_of_symbols = as->symbols.size / sizeof(*symbols);
+  for (int i = 0; i < num_of_symbols; i++) {
+    struct AsmSymbol *s = symbols[i];
+    if (IsLocalAsmLabel(s)) {
+      if (s->section == kELFSectionUndef) {
+        Error("Assembler: Undefined label %s", s->name);
+      }
+      continue;
+    }
+    // Undefined symbols are global, to be resolved by the linker.
+    struct ELFSymbol es = {s->name, s->section, s->offset,
+                           s->is_global || s->section == kELFSectionUndef};
+    s->elf_index = as->obj.symbols.size / sizeof(es);
+    AppendToObjBuffer(&as->obj.symbols, &es, sizeof(es));
+  }
+}
+
+static void ResolveAsmFixups(struct Assembler *as) {
+  struct AsmFixup *fixups = (struct AsmFixup *)as->fixups.data;
+  int num_of_fixups = as->fixups.size / sizeof(*fixups);
+  for (int i = 0; i < num_of_fixups; i++) {
+    struct AsmFixup *f = &fixups[i];
+    struct AsmSymbol *s = f->symbol;
+    bool is_got = f->type != R_X86_64_PC32 && f->type != R_X86_64_PLT32;
+    if (!is_got && !s->is_global && s->section == kELFSectionText) {
+      int rel = s->offset + f->addend - f->offset;
+      memcpy(as->obj.text.data + f->offset, &rel, 4);
+      continue;
+    }
+    struct ELFRelocation r = {f->offset, f->type, s->elf_index,
+                              kELFSectionUndef, f->addend};
+    if (!is_got && !s->is_global && s->section != kELFSectionUndef) {
+      // Refer a local label by the section symbol and the offset.
+      r.symbol = -1;
+      r.section = s->section;
+      r.addend += s->offset;
+    } else if (s->elf_index < 0) {
+      Error("Assembler: %s can not be referred via GOT", s->name);
+    }
+    AppendToObjBuffer(&as->obj.relocations, &r, sizeof(r));
+  }
+}
+
+void AssembleToObjectFile(const char *text, int size, struct ObjBuffer *file) {
+  // Writes the object file assembled from text, which should be terminated
+  // by a NUL, to file.
+  struct Assembler *as = calloc(1, sizeof(*as));
+  assert(as);
+  as->section = kELFSectionText;
+  for (const char *p = text; p < text + size; p = as->p + 1) {
+    as->line = as->p = p;
+    as->line_number++;
+    AssembleLine(as);
+    while (*as->p && *as->p != '\n') as->p++;  // comment
+  }
+  AddELFSymbols(as);
+  ResolveAsmFixups(as);
+  WriteELFObject(&as->obj, file);
+  ReleaseELFObject(&as->obj);
+  free(as->symbols.data);
+  free(as->fixups.data);
+  free(as);
+}
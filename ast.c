@@ -11,9 +11,55 @@ bool IsASTDeclOfExtern(struct Node *n) {
           IsTokenWithType(GetNodeAt(n->op, 0), kTokenKwExtern));
 }
 
+int GetSizeOfNode(enum NodeType type) {
+  // Returns bytes needed for a node of the type.
+  // Should be updated together with the layout of struct Node.
+  switch (type) {
+    case kNodeToken:
+      return TOKEN_NODE_SIZE;
+    case kASTExpr:
+    case kASTLocalVar:
+      return NODE_SIZE_UNTIL(label_number);
+    case kASTForStmt:
+      return NODE_SIZE_UNTIL(updt);
+    case kASTWhileStmt:
+      return NODE_SIZE_UNTIL(body);
+    case kASTSelectionStmt:
+      return NODE_SIZE_UNTIL(if_else_stmt);
+    case kASTDecltor:
+      return NODE_SIZE_UNTIL(decltor_init_expr);
+    case kASTList:
+      return NODE_SIZE_UNTIL(nodes);
+    case kASTKeyValue:
+      return NODE_SIZE_UNTIL(key);
+    case kASTDirectDecltor:
+      return NODE_SIZE_UNTIL(value);
+    case kNodeMacroReplacement:
+      return NODE_SIZE_UNTIL(arg_expr_list);
+    case kASTExprFuncCall:
+      return NODE_SIZE_UNTIL(stack_size_needed);
+    case kASTFuncDef:
+      return NODE_SIZE_UNTIL(arg_var_list);
+    case kNodeStructMember:
+      return NODE_SIZE_UNTIL(struct_member_ent_ofs);
+    case kASTStructSpec:
+      return NODE_SIZE_UNTIL(struct_member_dict);
+    case kTypeStruct:
+      return NODE_SIZE_UNTIL(type_struct_spec);
+    case kTypeArray:
+      return NODE_SIZE_UNTIL(type_array_index_decl);
+    default:
+      return NODE_SIZE_UNTIL(cond);
+  }
+}
+
 struct Node *AllocNode(enum NodeType type) {
-  struct Node *node = calloc(1, sizeof(struct Node));
+  int size = GetSizeOfNode(type);
+  STAT_CALL(kStatNodeAlloc);
+  STAT_STEPS(kStatNodeAlloc, size);
+  struct Node *node = ArenaAlloc(size);
   node->type = type;
+  compiler->num_of_nodes++;
   return node;
 }
 
@@ -155,144 +201,210 @@ struct Node *CreateMacroReplacement(struct Node *args_tokens,
   return n;
 }
 
+struct Node *GetDecltorInitExpr(struct Node *decltor) {
+  assert(decltor && decltor->type == kASTDecltor);
+  return decltor->decltor_init_expr;
+}
+
+int GetLocalVarOffset(struct Node *local_var) {
+  assert(local_var && local_var->type == kASTLocalVar);
+  return local_var->byte_offset;
+}
+
+struct Node *GetFuncCallArgs(struct Node *func_call) {
+  assert(func_call && func_call->type == kASTExprFuncCall);
+  return func_call->arg_expr_list;
+}
+
+struct Node *GetFuncDefBody(struct Node *func_def) {
+  assert(func_def && func_def->type == kASTFuncDef);
+  return func_def->func_body;
+}
+
 static void PrintPadding(int depth) {
   for (int i = 0; i < depth; i++) {
     fputc(' ', stderr);
   }
 }
 
-static void PrintASTNodeSub(struct Node *n, int depth) {
+static bool PrintASTNodeStep(struct TraverseFrame *f, void *arg) {
+  (void)arg;
+  struct Node *n = f->node;
+  int depth = f->param;
   if (!n) {
     fprintf(stderr, "(null)");
-    return;
+    return false;
   }
   if (IsToken(n)) {
     PrintTokenBrief(n);
-    return;
+    return false;
   }
   if (n->type == kASTList) {
-    fprintf(stderr, "[");
-    if (GetSizeOfList(n) == 0) {
-      fprintf(stderr, "]");
-      return;
+    if (!f->step) {
+      fprintf(stderr, "[");
+      if (GetSizeOfList(n) == 0) {
+        fprintf(stderr, "]");
+        return false;
+      }
     }
-    for (int i = 0; i < GetSizeOfList(n); i++) {
-      fprintf(stderr, "%s\n", i ? "," : "");
+    if (f->i < GetSizeOfList(n)) {
+      fprintf(stderr, "%s\n", f->i ? "," : "");
       PrintPadding(depth + 1);
-      PrintASTNodeSub(GetNodeAt(n, i), depth + 1);
+      return VisitNextElement(f, 1, n, depth + 1);
     }
     fprintf(stderr, "\n");
     PrintPadding(depth);
     fprintf(stderr, "]");
-    return;
+    return false;
   } else if (n->type == kASTStructSpec) {
+    if (f->step) return false;
     fprintf(stderr, "StructSpec: ");
-    PrintASTNodeSub(n->struct_member_dict, depth);
-    return;
+    return VisitChild(f, 1, n->struct_member_dict, depth);
   } else if (n->type == kASTKeyValue) {
+    if (f->step) return false;
     fprintf(stderr, "%s: ", n->key);
-    PrintASTNodeSub(n->value, depth);
-    return;
+    return VisitChild(f, 1, n->value, depth);
   } else if (n->type == kNodeStructMember) {
+    if (f->step) return false;
     fprintf(stderr, "Member +%d: ", n->struct_member_ent_ofs);
-    PrintASTNodeSub(n->struct_member_ent_type, depth);
-    return;
+    return VisitChild(f, 1, n->struct_member_ent_type, depth);
   } else if (n->type == kNodeMacroReplacement) {
-    fprintf(stderr, "MacroReplacement<args: ");
-    PrintASTNodeSub(n->arg_expr_list, depth);
+    if (!f->step) {
+      fprintf(stderr, "MacroReplacement<args: ");
+      return VisitChild(f, 1, n->arg_expr_list, depth);
+    }
     fprintf(stderr, ", rep: ");
     PrintTokenSequence(n->value);
     fprintf(stderr, ">");
-    return;
+    return false;
   } else if (n->type == kTypeBase) {
     PrintTokenStrToFile(n->op, stderr);
-    return;
+    return false;
   } else if (n->type == kTypeLValue) {
-    fprintf(stderr, "lvalue<");
-    PrintASTNodeSub(n->right, depth);
+    if (!f->step) {
+      fprintf(stderr, "lvalue<");
+      return VisitChild(f, 1, n->right, depth);
+    }
     fprintf(stderr, ">");
-    return;
+    return false;
   } else if (n->type == kTypePointer) {
-    fprintf(stderr, "pointer_of<");
-    PrintASTNodeSub(n->right, depth);
+    if (!f->step) {
+      fprintf(stderr, "pointer_of<");
+      return VisitChild(f, 1, n->right, depth);
+    }
     fprintf(stderr, ">");
-    return;
+    return false;
   } else if (n->type == kTypeFunction) {
-    fprintf(stderr, "function<returns: ");
-    PrintASTNodeSub(n->left, depth);
-    fprintf(stderr, ", args: ");
-    PrintASTNodeSub(n->right, depth);
+    switch (f->step) {
+      case 0:
+        fprintf(stderr, "function<returns: ");
+        return VisitChild(f, 1, n->left, depth);
+      case 1:
+        fprintf(stderr, ", args: ");
+        return VisitChild(f, 2, n->right, depth);
+    }
     fprintf(stderr, ">");
-    return;
+    return false;
   } else if (n->type == kTypeStruct) {
-    fprintf(stderr, "struct<tag: ");
-    PrintASTNodeSub(n->tag, depth);
+    if (!f->step) {
+      fprintf(stderr, "struct<tag: ");
+      return VisitChild(f, 1, n->tag, depth);
+    }
     if (!n->type_struct_spec) {
       fprintf(stderr, ", incomplete");
     }
     fprintf(stderr, ">");
-    return;
+    return false;
   } else if (n->type == kTypeArray) {
-    fprintf(stderr, "array_of<");
-    PrintASTNodeSub(n->type_array_type_of, depth);
-    fprintf(stderr, ">[");
-    PrintASTNodeSub(n->type_array_index_decl, depth);
+    switch (f->step) {
+      case 0:
+        fprintf(stderr, "array_of<");
+        return VisitChild(f, 1, n->type_array_type_of, depth);
+      case 1:
+        fprintf(stderr, ">[");
+        return VisitChild(f, 2, n->type_array_index_decl, depth);
+    }
     fprintf(stderr, "]");
-    return;
+    return false;
   } else if (n->type == kTypeAttrIdent) {
+    if (f->step) return false;
     fputc('`', stderr);
     PrintTokenStrToFile(n->left, stderr);
     fputc('`', stderr);
     fprintf(stderr, " has a type: ");
-    PrintASTNodeSub(n->right, depth);
-    return;
+    return VisitChild(f, 1, n->right, depth);
   } else if (n->type == kASTFuncDef) {
-    fprintf(stderr, "FuncDef ");
-    PrintASTNodeSub(n->func_name_token, depth);
-    fprintf(stderr, " : ");
-    PrintASTNodeSub(n->func_type, depth);
-    fprintf(stderr, "{\n");
-    PrintPadding(depth + 1);
-    PrintASTNodeSub(n->func_body, depth + 1);
+    switch (f->step) {
+      case 0:
+        fprintf(stderr, "FuncDef ");
+        return VisitChild(f, 1, n->func_name_token, depth);
+      case 1:
+        fprintf(stderr, " : ");
+        return VisitChild(f, 2, n->func_type, depth);
+      case 2:
+        fprintf(stderr, "{\n");
+        PrintPadding(depth + 1);
+        return VisitChild(f, 3, n->func_body, depth + 1);
+    }
     fprintf(stderr, "\n");
     PrintPadding(depth);
     fprintf(stderr, "}");
-    return;
+    return false;
   } else if (n->type == kASTExprStmt) {
-    PrintASTNodeSub(n->left, depth);
+    if (!f->step) return VisitChild(f, 1, n->left, depth);
     fprintf(stderr, ";");
-    return;
+    return false;
   } else if (n->type == kASTExprFuncCall) {
-    fprintf(stderr, "FuncCall<");
-    PrintASTNodeSub(n->func_expr, depth);
-    fprintf(stderr, ">(");
-    PrintASTNodeSub(n->arg_expr_list, depth);
+    switch (f->step) {
+      case 0:
+        fprintf(stderr, "FuncCall<");
+        return VisitChild(f, 1, n->func_expr, depth);
+      case 1:
+        fprintf(stderr, ">(");
+        return VisitChild(f, 2, n->arg_expr_list, depth);
+    }
     fprintf(stderr, ")");
-    return;
-  }
-  fprintf(stderr, "(op=");
-  if (n->op) PrintTokenBrief(n->op);
-  if (n->expr_type) {
-    fprintf(stderr, ":");
-    PrintASTNodeSub(n->expr_type, depth + 1);
-  }
-  if (n->reg) fprintf(stderr, " reg: %d", n->reg);
-  if (n->cond) {
-    fprintf(stderr, " cond=");
-    PrintASTNodeSub(n->cond, depth + 1);
-  }
-  if (n->left) {
-    fprintf(stderr, " L=");
-    PrintASTNodeSub(n->left, depth + 1);
+    return false;
   }
-  if (n->right) {
-    fprintf(stderr, " R=");
-    PrintASTNodeSub(n->right, depth + 1);
+  switch (f->step) {
+    case 0:
+      fprintf(stderr, "(op=");
+      if (IsToken(n->op)) {
+        PrintTokenBrief(n->op);
+      } else if (n->op) {
+        return VisitChild(f, 1, n->op, depth + 1);
+      }
+      // fallthrough
+    case 1:
+      if (n->expr_type) {
+        fprintf(stderr, ":");
+        return VisitChild(f, 2, n->expr_type, depth + 1);
+      }
+      // fallthrough
+    case 2:
+      if (n->reg) fprintf(stderr, " reg: %d", n->reg);
+      if (n->cond) {
+        fprintf(stderr, " cond=");
+        return VisitChild(f, 3, n->cond, depth + 1);
+      }
+      // fallthrough
+    case 3:
+      if (n->left) {
+        fprintf(stderr, " L=");
+        return VisitChild(f, 4, n->left, depth + 1);
+      }
+      // fallthrough
+    case 4:
+      if (n->right) {
+        fprintf(stderr, " R=");
+        return VisitChild(f, 5, n->right, depth + 1);
+      }
   }
   fprintf(stderr, ")");
+  return false;
 }
 
 void PrintASTNode(struct Node *n) {
-  PrintASTNodeSub(n, 0);
+  Traverse(n, 0, PrintASTNodeStep, NULL);
   fputc('\n', stderr);
 }
@@ -0,0 +1,267 @@
+// Compile-throughput benchmark of compilium.
+// Generates C sources of synthetic workloads in a sweep of sizes, compiles
+// each of them with compilium, and reports the time and the peak RSS of the
+// compiler for each size. The exponent column is the slope of the time on a
+// log-log scale from the previous size: about 1 for linear behaviour, and 2
+// for quadratic behaviour (e.g. a linear search in a table of N entries).
+// This is a host program, built with the host compiler (see Makefile).
+//
+// usage: compile_bench [--compilium <path>] [--sizes <n>,<n>...]
+//                      [--runs <n>] [<workload>...]
+//        compile_bench --gen <workload> <n>   (prints the source)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SIZES 32
+
+static void GenFuncs(FILE *fp, int n) {
+  // n functions, each calling the previous one
+  fprintf(fp, "int f0(int x) { return x; }\n");
+  for (int i = 1; i < n; i++) {
+    fprintf(fp, "int f%d(int x) { return f%d(x) + %d; }\n", i, i - 1, i % 7);
+  }
+  fprintf(fp, "int main() { return f%d(0) %% 256; }\n", n - 1);
+}
+
+static void GenGlobals(FILE *fp, int n) {
+  // n global variables, each assigned in main
+  for (int i = 0; i < n; i++) fprintf(fp, "int g%d;\n", i);
+  fprintf(fp, "int main() {\n");
+  for (int i = 0; i < n; i++) fprintf(fp, "  g%d = %d;\n", i, i % 7);
+  fprintf(fp, "  return g%d;\n}\n", n - 1);
+}
+
+static void GenNesting(FILE *fp, int n) {
+  // n-deep nested if statements with blocks
+  fprintf(fp, "int main() {\n  int a;\n  a = 0;\n");
+  for (int i = 0; i < n; i++) fprintf(fp, "if (a == %d) { a = a + 1;\n", i);
+  for (int i = 0; i < n; i++) fprintf(fp, "}\n");
+  fprintf(fp, "  return a %% 256;\n}\n");
+}
+
+static void GenMacros(FILE *fp, int n) {
+  // n object-like macros, each used once
+  for (int i = 0; i < n; i++) fprintf(fp, "#define M%d %d\n", i, i % 7);
+  fprintf(fp, "int main() {\n  int s;\n  s = 0;\n");
+  for (int i = 0; i < n; i++) fprintf(fp, "  s = s + M%d;\n", i);
+  fprintf(fp, "  return s %% 256;\n}\n");
+}
+
+static void GenMembers(FILE *fp, int n) {
+  // a struct with n members, each assigned through a pointer
+  fprintf(fp, "struct S {\n");
+  for (int i = 0; i < n; i++) fprintf(fp, "  int m%d;\n", i);
+  fprintf(fp, "};\nstruct S s;\nint main() {\n  struct S *p;\n  p = &s;\n");
+  for (int i = 0; i < n; i++) fprintf(fp, "  p->m%d = %d;\n", i, i % 7);
+  fprintf(fp, "  return p->m%d;\n}\n", n - 1);
+}
+
+static void GenTypedefs(FILE *fp, int n) {
+  // n typedefs, each used for a local variable
+  for (int i = 0; i < n; i++) fprintf(fp, "typedef int T%d;\n", i);
+  fprintf(fp, "int main() {\n");
+  for (int i = 0; i < n; i++) fprintf(fp, "  T%d v%d;\n", i, i);
+  fprintf(fp, "  v0 = 0;\n  return v0;\n}\n");
+}
+
+static void GenExpr(FILE *fp, int n) {
+  // an expression of n terms
+  fprintf(fp, "int main() {\n  int a;\n  a = 1;\n  return a");
+  for (int i = 1; i < n; i++) fprintf(fp, "%s", i % 16 ? " + a" : "\n + a");
+  fprintf(fp, ";\n}\n");
+}
+
+struct Workload {
+  const char *name;
+  void (*gen)(FILE *fp, int n);
+  int default_sizes[MAX_SIZES];  // terminated by 0
+};
+
+static const struct Workload workloads[] = {
+    {"funcs", GenFuncs, {1000, 2000, 4000, 8000, 16000}},
+    {"globals", GenGlobals, {1000, 2000, 4000, 8000, 16000}},
+    {"nesting", GenNesting, {250, 500, 1000, 2000, 4000}},
+    {"macros", GenMacros, {1000, 2000, 4000, 8000, 16000}},
+    {"members", GenMembers, {1000, 2000, 4000, 8000, 16000}},
+    {"typedefs", GenTypedefs, {1000, 2000, 4000, 8000, 16000}},
+    {"expr", GenExpr, {1000, 2000, 4000, 8000, 16000}},
+};
+#define NUM_OF_WORKLOADS ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+static const struct Workload *FindWorkload(const char *name) {
+  for (int i = 0; i < NUM_OF_WORKLOADS; i++) {
+    if (strcmp(workloads[i].name, name) == 0) return &workloads[i];
+  }
+  fprintf(stderr, "Unknown workload: %s\n", name);
+  exit(EXIT_FAILURE);
+}
+
+struct Measurement {
+  double wall;  // in seconds
+  double cpu;   // user + system, in seconds
+  long peak_rss_kb;
+  int status;
+};
+
+static double GetTimeInSec(struct timeval tv) {
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static double GetMonotonicTimeInSec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static struct Measurement RunCompilium(const char *compilium,
+                                       const char *target_os,
+                                       const char *src_path) {
+  // The output is discarded, and errors are shown.
+  struct Measurement m = {0};
+  double begin = GetMonotonicTimeInSec();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0) dup2(fd, 1);
+    execl(compilium, compilium, "--target-os", target_os, src_path,
+          (char *)NULL);
+    perror(compilium);
+    _exit(127);
+  }
+  int status;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) < 0) {
+    if (errno != EINTR) {
+      perror("wait4");
+      exit(EXIT_FAILURE);
+    }
+  }
+  m.wall = GetMonotonicTimeInSec() - begin;
+  m.cpu = GetTimeInSec(usage.ru_utime) + GetTimeInSec(usage.ru_stime);
+#ifdef __APPLE__
+  m.peak_rss_kb = usage.ru_maxrss / 1024;  // in bytes
+#else
+  m.peak_rss_kb = usage.ru_maxrss;
+#endif
+  m.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  return m;
+}
+
+static int ParseSizes(const char *list, int *sizes) {
+  // Returns the number of sizes in list, which is comma-separated.
+  int n = 0;
+  const char *p = list;
+  while (*p && n < MAX_SIZES - 1) {
+    char *end;
+    long v = strtol(p, &end, 10);
+    if (end == p || v <= 0) {
+      fprintf(stderr, "Invalid sizes: %s\n", list);
+      exit(EXIT_FAILURE);
+    }
+    sizes[n++] = v;
+    p = *end == ',' ? end + 1 : end;
+  }
+  sizes[n] = 0;
+  return n;
+}
+
+static int RunWorkload(const struct Workload *w, const int *sizes,
+                       int num_of_runs, const char *compilium,
+                       const char *target_os) {
+  // Returns the number of failed compilations.
+  char src_path[64];
+  snprintf(src_path, sizeof(src_path), "/tmp/compile_bench.%d.c", getpid());
+  int num_of_failed = 0;
+  double prev_wall = 0;
+  int prev_size = 0;
+  for (int i = 0; sizes[i]; i++) {
+    FILE *fp = fopen(src_path, "w");
+    if (!fp) {
+      perror(src_path);
+      exit(EXIT_FAILURE);
+    }
+    w->gen(fp, sizes[i]);
+    fclose(fp);
+    // The fastest run is reported, which is the least disturbed one.
+    struct Measurement best = {0};
+    for (int r = 0; r < num_of_runs; r++) {
+      struct Measurement m = RunCompilium(compilium, target_os, src_path);
+      if (r == 0 || m.status || m.wall < best.wall) best = m;
+      if (m.status) break;
+    }
+    printf("%-10s %8d %10.2f %10.2f %12ld", w->name, sizes[i],
+           best.wall * 1e3, best.cpu * 1e3, best.peak_rss_kb);
+    if (best.status) {
+      printf("  FAIL (status %d)\n", best.status);
+      num_of_failed++;
+      prev_size = 0;
+      continue;
+    }
+    if (prev_size && prev_wall > 0 && best.wall > 0) {
+      printf(" %9.2f", log(best.wall / prev_wall) /
+                           log((double)sizes[i] / prev_size));
+    }
+    printf("\n");
+    fflush(stdout);
+    prev_wall = best.wall;
+    prev_size = sizes[i];
+  }
+  unlink(src_path);
+  return num_of_failed;
+}
+
+int main(int argc, char **argv) {
+  const char *compilium = "../compilium";
+  int sizes[MAX_SIZES] = {0};
+  int num_of_runs = 3;
+  const struct Workload *selected[NUM_OF_WORKLOADS];
+  int num_of_selected = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--compilium") == 0 && i + 1 < argc) {
+      compilium = argv[++i];
+    } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+      ParseSizes(argv[++i], sizes);
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      num_of_runs = atoi(argv[++i]);
+      if (num_of_runs <= 0) num_of_runs = 1;
+    } else if (strcmp(argv[i], "--gen") == 0 && i + 2 < argc) {
+      FindWorkload(argv[i + 1])->gen(stdout, atoi(argv[i + 2]));
+      return EXIT_SUCCESS;
+    } else if (argv[i][0] != '-' && num_of_selected < NUM_OF_WORKLOADS) {
+      selected[num_of_selected++] = FindWorkload(argv[i]);
+    } else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!num_of_selected) {
+    for (int i = 0; i < NUM_OF_WORKLOADS; i++) selected[i] = &workloads[i];
+    num_of_selected = NUM_OF_WORKLOADS;
+  }
+  struct utsname uts;
+  const char *target_os = uname(&uts) == 0 ? uts.sysname : "Linux";
+  printf("%-10s %8s %10s %10s %12s %9s\n", "workload", "size", "wall ms",
+         "cpu ms", "peak RSS KB", "exponent");
+  int num_of_failed = 0;
+  for (int i = 0; i < num_of_selected; i++) {
+    const struct Workload *w = selected[i];
+    num_of_failed += RunWorkload(w, sizes[0] ? sizes : w->default_sizes,
+                                 num_of_runs, compilium, target_os);
+  }
+  return num_of_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
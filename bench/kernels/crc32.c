@@ -0,0 +1,73 @@
+// CRC-32 (IEEE 802.3) of a pseudo-random buffer, computed bit by bit and
+// with a table. The CRC is kept in an int, so right shifts are masked to
+// be logical, and POLYNOMIAL is 0xedb88320 as an int.
+#include <stdio.h>
+
+#define SIZE 1000000
+#define ROUNDS 10
+#define POLYNOMIAL -306674912
+
+char data[1000000];  // SIZE
+int table[256];
+int seed;
+
+int Random() {
+  // Park-Miller generator with the method of Schrage not to overflow.
+  int hi = seed / 127773;
+  int lo = seed % 127773;
+  seed = 16807 * lo - 2836 * hi;
+  if (seed <= 0) seed += 2147483647;
+  return seed;
+}
+
+int ShiftRight(int v, int n) { return (v >> n) & (0x7fffffff >> (n - 1)); }
+
+int UpdateBitwise(int crc, char *p, int size) {
+  for (int i = 0; i < size; i++) {
+    crc = crc ^ (p[i] & 0xff);
+    for (int k = 0; k < 8; k++) {
+      int mask = -(crc & 1);
+      crc = ShiftRight(crc, 1) ^ (POLYNOMIAL & mask);
+    }
+  }
+  return crc;
+}
+
+void InitTable() {
+  for (int i = 0; i < 256; i++) {
+    int crc = i;
+    for (int k = 0; k < 8; k++) {
+      int mask = -(crc & 1);
+      crc = ShiftRight(crc, 1) ^ (POLYNOMIAL & mask);
+    }
+    table[i] = crc;
+  }
+}
+
+int UpdateTable(int crc, char *p, int size) {
+  for (int i = 0; i < size; i++) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ ShiftRight(crc, 8);
+  }
+  return crc;
+}
+
+int main() {
+  InitTable();
+  // The check value of CRC-32 is cbf43926.
+  char *check = "123456789";
+  printf("check: %08x %08x\n", ~UpdateBitwise(-1, check, 9),
+         ~UpdateTable(-1, check, 9));
+  seed = 777;
+  for (int i = 0; i < SIZE; i++) data[i] = Random() % 256;
+  printf("bitwise: %08x\n", ~UpdateBitwise(-1, data, SIZE));
+  for (int r = 0; r < ROUNDS; r++) {
+    // Each round flips a byte, and takes the CRC of the buffer and of its
+    // halves.
+    int pos = Random() % SIZE;
+    data[pos] = Random() % 256;
+    int whole = ~UpdateTable(-1, data, SIZE);
+    int half = ~UpdateTable(-1, data, SIZE / 2);
+    printf("round %d: %08x %08x\n", r, whole, half);
+  }
+  return 0;
+}
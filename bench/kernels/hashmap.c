@@ -0,0 +1,112 @@
+// Open-addressing hash map from int keys to counts, with linear probing
+// and deletion by backward shift (no tombstones). CAPACITY is a power of 2.
+#include <stdio.h>
+
+#define CAPACITY 262144
+#define MASK (CAPACITY - 1)
+#define EMPTY -1
+#define ROUNDS 8
+#define OPS 1000000
+
+int keys[CAPACITY];
+int counts[CAPACITY];
+int size;
+int probes;
+int seed;
+
+int Random() {
+  // Park-Miller generator with the method of Schrage not to overflow.
+  int hi = seed / 127773;
+  int lo = seed % 127773;
+  seed = 16807 * lo - 2836 * hi;
+  if (seed <= 0) seed += 2147483647;
+  return seed;
+}
+
+int Hash(int key) {
+  int h = key ^ (key >> 15);
+  h = (h % 65521) * 32749 + (h >> 16);
+  return h & MASK;
+}
+
+int FindSlot(int key) {
+  // Returns the slot of key, or the empty slot to insert it.
+  int i = Hash(key);
+  while (keys[i] != EMPTY && keys[i] != key) {
+    i = (i + 1) & MASK;
+    probes++;
+  }
+  return i;
+}
+
+void Add(int key) {
+  int i = FindSlot(key);
+  if (keys[i] == EMPTY) {
+    keys[i] = key;
+    counts[i] = 0;
+    size++;
+  }
+  counts[i]++;
+}
+
+int Get(int key) {
+  int i = FindSlot(key);
+  return keys[i] == EMPTY ? 0 : counts[i];
+}
+
+void Remove(int key) {
+  int i = FindSlot(key);
+  if (keys[i] == EMPTY) return;
+  size--;
+  // Entries after i are shifted back unless their home slot is between
+  // the hole and themselves.
+  int j = i;
+  while (1) {
+    keys[i] = EMPTY;
+    int is_moved = 0;
+    while (!is_moved) {
+      j = (j + 1) & MASK;
+      if (keys[j] == EMPTY) return;
+      int home = Hash(keys[j]);
+      if (i <= j ? (home <= i || j < home) : (home <= i && j < home)) {
+        is_moved = 1;
+      }
+    }
+    keys[i] = keys[j];
+    counts[i] = counts[j];
+    i = j;
+  }
+}
+
+int main() {
+  seed = 12345;
+  for (int i = 0; i < CAPACITY; i++) keys[i] = EMPTY;
+  for (int r = 0; r < ROUNDS; r++) {
+    // Keys of each round are drawn from a range which grows, so the map
+    // fills up and is drained by the removals of the odd rounds. They are
+    // spread not to be consecutive.
+    int range = 20000 + r * 20000;
+    int found = 0;
+    for (int i = 0; i < OPS; i++) {
+      int key = Random() % range * 7919;
+      if (r % 2 && key % 3 == 0) {
+        Remove(key);
+      } else if (i % 4 == 0) {
+        found += Get(key) > 0;
+      } else {
+        Add(key);
+      }
+    }
+    int total = 0;
+    int max = 0;
+    for (int i = 0; i < CAPACITY; i++) {
+      if (keys[i] != EMPTY) {
+        total += counts[i];
+        if (counts[i] > max) max = counts[i];
+      }
+    }
+    printf("round %d: size=%d total=%d max=%d ", r, size, total, max);
+    printf("found=%d probes=%d\n", found, probes);
+  }
+  return 0;
+}
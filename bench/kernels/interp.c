@@ -0,0 +1,235 @@
+// Bytecode interpreter of a stack machine, with a dispatch loop running
+// programs assembled below: primes by trial division and Collatz steps.
+#include <stdio.h>
+
+#define kOpPush 0
+#define kOpLoad 1
+#define kOpStore 2
+#define kOpAdd 3
+#define kOpSub 4
+#define kOpMul 5
+#define kOpDiv 6
+#define kOpMod 7
+#define kOpLt 8
+#define kOpEq 9
+#define kOpJmp 10
+#define kOpJz 11
+#define kOpPrint 12
+#define kOpHalt 13
+
+int code[1024];  // pairs of an op and its arg
+int code_size;
+int stack[256];
+int vars[16];
+
+int Emit(int op, int arg) {
+  // Returns the index of arg, to patch the target of a jump.
+  code[code_size] = op;
+  code[code_size + 1] = arg;
+  code_size += 2;
+  return code_size - 1;
+}
+
+int Run() {
+  // Returns the number of executed instructions.
+  int pc = 0;
+  int sp = 0;
+  int steps = 0;
+  while (1) {
+    int op = code[pc];
+    int arg = code[pc + 1];
+    pc += 2;
+    steps++;
+    if (op == kOpPush) {
+      stack[sp++] = arg;
+    } else if (op == kOpLoad) {
+      stack[sp++] = vars[arg];
+    } else if (op == kOpStore) {
+      vars[arg] = stack[--sp];
+    } else if (op == kOpAdd) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] + stack[sp];
+    } else if (op == kOpSub) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] - stack[sp];
+    } else if (op == kOpMul) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] * stack[sp];
+    } else if (op == kOpDiv) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] / stack[sp];
+    } else if (op == kOpMod) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] % stack[sp];
+    } else if (op == kOpLt) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] < stack[sp];
+    } else if (op == kOpEq) {
+      sp--;
+      stack[sp - 1] = stack[sp - 1] == stack[sp];
+    } else if (op == kOpJmp) {
+      pc = arg;
+    } else if (op == kOpJz) {
+      if (!stack[--sp]) pc = arg;
+    } else if (op == kOpPrint) {
+      printf("%d\n", stack[--sp]);
+    } else {
+      return steps;  // kOpHalt
+    }
+  }
+}
+
+#define kVarN 0
+#define kVarD 1
+#define kVarIsPrime 2
+#define kVarCount 3
+
+void AssemblePrimes(int limit) {
+  // Prints the number of primes below limit.
+  code_size = 0;
+  Emit(kOpPush, 0);
+  Emit(kOpStore, kVarCount);
+  Emit(kOpPush, 2);
+  Emit(kOpStore, kVarN);
+  int loop_n = code_size;
+  Emit(kOpLoad, kVarN);
+  Emit(kOpPush, limit);
+  Emit(kOpLt, 0);
+  int to_end = Emit(kOpJz, 0);
+  Emit(kOpPush, 2);
+  Emit(kOpStore, kVarD);
+  Emit(kOpPush, 1);
+  Emit(kOpStore, kVarIsPrime);
+  // while (d * d < n + 1)
+  int loop_d = code_size;
+  Emit(kOpLoad, kVarD);
+  Emit(kOpLoad, kVarD);
+  Emit(kOpMul, 0);
+  Emit(kOpLoad, kVarN);
+  Emit(kOpPush, 1);
+  Emit(kOpAdd, 0);
+  Emit(kOpLt, 0);
+  int to_done_d = Emit(kOpJz, 0);
+  // if (n % d == 0) { is_prime = 0; break; }
+  Emit(kOpLoad, kVarN);
+  Emit(kOpLoad, kVarD);
+  Emit(kOpMod, 0);
+  Emit(kOpPush, 0);
+  Emit(kOpEq, 0);
+  int to_next_d = Emit(kOpJz, 0);
+  Emit(kOpPush, 0);
+  Emit(kOpStore, kVarIsPrime);
+  int to_break_d = Emit(kOpJmp, 0);
+  code[to_next_d] = code_size;
+  Emit(kOpLoad, kVarD);
+  Emit(kOpPush, 1);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarD);
+  Emit(kOpJmp, loop_d);
+  code[to_done_d] = code_size;
+  code[to_break_d] = code_size;
+  Emit(kOpLoad, kVarCount);
+  Emit(kOpLoad, kVarIsPrime);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarCount);
+  Emit(kOpLoad, kVarN);
+  Emit(kOpPush, 1);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarN);
+  Emit(kOpJmp, loop_n);
+  code[to_end] = code_size;
+  Emit(kOpLoad, kVarCount);
+  Emit(kOpPrint, 0);
+  Emit(kOpHalt, 0);
+}
+
+#define kVarI 0
+#define kVarX 1
+#define kVarSteps 2
+#define kVarTotal 3
+#define kVarMax 4
+
+void AssembleCollatz(int limit) {
+  // Prints the total and the max of the Collatz steps of 1 to limit.
+  code_size = 0;
+  Emit(kOpPush, 0);
+  Emit(kOpStore, kVarTotal);
+  Emit(kOpPush, 0);
+  Emit(kOpStore, kVarMax);
+  Emit(kOpPush, 1);
+  Emit(kOpStore, kVarI);
+  int loop_i = code_size;
+  Emit(kOpLoad, kVarI);
+  Emit(kOpPush, limit + 1);
+  Emit(kOpLt, 0);
+  int to_end = Emit(kOpJz, 0);
+  Emit(kOpLoad, kVarI);
+  Emit(kOpStore, kVarX);
+  Emit(kOpPush, 0);
+  Emit(kOpStore, kVarSteps);
+  // while (1 < x)
+  int loop_x = code_size;
+  Emit(kOpPush, 1);
+  Emit(kOpLoad, kVarX);
+  Emit(kOpLt, 0);
+  int to_done_x = Emit(kOpJz, 0);
+  // x = x % 2 ? x * 3 + 1 : x / 2
+  Emit(kOpLoad, kVarX);
+  Emit(kOpPush, 2);
+  Emit(kOpMod, 0);
+  int to_even = Emit(kOpJz, 0);
+  Emit(kOpLoad, kVarX);
+  Emit(kOpPush, 3);
+  Emit(kOpMul, 0);
+  Emit(kOpPush, 1);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarX);
+  int to_next_x = Emit(kOpJmp, 0);
+  code[to_even] = code_size;
+  Emit(kOpLoad, kVarX);
+  Emit(kOpPush, 2);
+  Emit(kOpDiv, 0);
+  Emit(kOpStore, kVarX);
+  code[to_next_x] = code_size;
+  Emit(kOpLoad, kVarSteps);
+  Emit(kOpPush, 1);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarSteps);
+  Emit(kOpJmp, loop_x);
+  code[to_done_x] = code_size;
+  Emit(kOpLoad, kVarTotal);
+  Emit(kOpLoad, kVarSteps);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarTotal);
+  // if (max < steps) max = steps
+  Emit(kOpLoad, kVarMax);
+  Emit(kOpLoad, kVarSteps);
+  Emit(kOpLt, 0);
+  int to_skip = Emit(kOpJz, 0);
+  Emit(kOpLoad, kVarSteps);
+  Emit(kOpStore, kVarMax);
+  code[to_skip] = code_size;
+  Emit(kOpLoad, kVarI);
+  Emit(kOpPush, 1);
+  Emit(kOpAdd, 0);
+  Emit(kOpStore, kVarI);
+  Emit(kOpJmp, loop_i);
+  code[to_end] = code_size;
+  Emit(kOpLoad, kVarTotal);
+  Emit(kOpPrint, 0);
+  Emit(kOpLoad, kVarMax);
+  Emit(kOpPrint, 0);
+  Emit(kOpHalt, 0);
+}
+
+int main() {
+  printf("primes below 30000:\n");
+  AssemblePrimes(30000);
+  int steps = Run();
+  printf("%d instructions\n", steps);
+  printf("collatz of 1 to 20000:\n");
+  AssembleCollatz(20000);
+  steps = Run();
+  printf("%d instructions\n", steps);
+  return 0;
+}
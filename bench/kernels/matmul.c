@@ -0,0 +1,60 @@
+// Matrix multiplication of int matrices, in the naive i-j-k order and in
+// the cache-friendly i-k-j order.
+#include <stdio.h>
+
+#define N 200
+
+int a[40000];  // N * N
+int b[40000];
+int c[40000];
+int d[40000];
+
+void MultiplyIJK(int *x, int *y, int *z) {
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      int sum = 0;
+      for (int k = 0; k < N; k++) sum += x[i * N + k] * y[k * N + j];
+      z[i * N + j] = sum;
+    }
+  }
+}
+
+void MultiplyIKJ(int *x, int *y, int *z) {
+  for (int i = 0; i < N * N; i++) z[i] = 0;
+  for (int i = 0; i < N; i++) {
+    for (int k = 0; k < N; k++) {
+      int v = x[i * N + k];
+      int row = k * N;
+      int out = i * N;
+      for (int j = 0; j < N; j++) z[out + j] += v * y[row + j];
+    }
+  }
+}
+
+int Checksum(int *x) {
+  int sum = 0;
+  for (int i = 0; i < N * N; i++) sum = (sum * 31 + x[i] % 65536) % 1000003;
+  return sum;
+}
+
+int main() {
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      a[i * N + j] = (i * 7 + j * 13) % 101;
+      b[i * N + j] = (i * 11 + j * 3 + i * j) % 97;
+    }
+  }
+  for (int r = 0; r < 5; r++) {
+    MultiplyIJK(a, b, c);
+    MultiplyIKJ(a, b, d);
+    int is_same = 1;
+    for (int i = 0; i < N * N; i++) {
+      if (c[i] != d[i]) is_same = 0;
+    }
+    printf("round %d: same=%d checksum=%d c[0]=%d c[last]=%d\n", r, is_same,
+           Checksum(c), c[0], c[N * N - 1]);
+    // The next round multiplies the result scaled down, to keep it small.
+    for (int i = 0; i < N * N; i++) a[i] = c[i] % 100;
+  }
+  return 0;
+}
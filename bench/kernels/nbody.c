@@ -0,0 +1,159 @@
+// Integer n-body simulation in 3D with fixed-point positions and velocities
+// in a box with reflecting walls. Divisions are done on absolute values and
+// the signs are applied after, so that rounding does not depend on them.
+// A unit is ONE in fixed point, and the box is 20000 units on a side.
+#include <stdio.h>
+
+#define N 48
+#define STEPS 1000
+#define ONE 256
+#define SIZE 5120000
+#define G 20000
+#define SOFTENING 100
+#define MAX_SPEED 2000
+
+int x[N];
+int y[N];
+int z[N];
+int vx[N];
+int vy[N];
+int vz[N];
+int acc_x[N];
+int acc_y[N];
+int acc_z[N];
+int mass[N];
+int seed;
+
+int Random() {
+  // Park-Miller generator with the method of Schrage not to overflow.
+  int hi = seed / 127773;
+  int lo = seed % 127773;
+  seed = 16807 * lo - 2836 * hi;
+  if (seed <= 0) seed += 2147483647;
+  return seed;
+}
+
+int Abs(int v) { return v < 0 ? -v : v; }
+
+int Sign(int v) { return v < 0 ? -1 : 1; }
+
+int Isqrt(int n) {
+  // Bit by bit, for 0 <= n < 2^31.
+  int root = 0;
+  int bit = 1 << 30;
+  while (bit > n) bit >>= 2;
+  while (bit) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+int Clamp(int v, int limit) {
+  if (v > limit) return limit;
+  if (v < -limit) return -limit;
+  return v;
+}
+
+void Accelerate() {
+  for (int i = 0; i < N; i++) {
+    acc_x[i] = 0;
+    acc_y[i] = 0;
+    acc_z[i] = 0;
+  }
+  for (int i = 0; i < N; i++) {
+    for (int j = i + 1; j < N; j++) {
+      int dx = x[j] - x[i];
+      int dy = y[j] - y[i];
+      int dz = z[j] - z[i];
+      int adx = Abs(dx) / ONE;
+      int ady = Abs(dy) / ONE;
+      int adz = Abs(dz) / ONE;
+      int d2 = adx * adx + ady * ady + adz * adz + SOFTENING;
+      int r = Isqrt(d2);
+      // Components of the direction, scaled by 1024.
+      int cx = adx * 1024 / r;
+      int cy = ady * 1024 / r;
+      int cz = adz * 1024 / r;
+      int fi = G * mass[j] / (d2 / 256 + 1);
+      int fj = G * mass[i] / (d2 / 256 + 1);
+      acc_x[i] += Sign(dx) * (fi * cx / 1024);
+      acc_y[i] += Sign(dy) * (fi * cy / 1024);
+      acc_z[i] += Sign(dz) * (fi * cz / 1024);
+      acc_x[j] -= Sign(dx) * (fj * cx / 1024);
+      acc_y[j] -= Sign(dy) * (fj * cy / 1024);
+      acc_z[j] -= Sign(dz) * (fj * cz / 1024);
+    }
+  }
+}
+
+int Move(int p, int *v) {
+  // Returns the position p moved by *v, reflected by the walls.
+  p += *v;
+  if (p < 0) {
+    p = -p;
+    *v = -*v;
+  } else if (p >= SIZE) {
+    p = 2 * (SIZE - 1) - p;
+    *v = -*v;
+  }
+  return p;
+}
+
+void Step() {
+  Accelerate();
+  for (int i = 0; i < N; i++) {
+    vx[i] = Clamp(vx[i] + acc_x[i], MAX_SPEED);
+    vy[i] = Clamp(vy[i] + acc_y[i], MAX_SPEED);
+    vz[i] = Clamp(vz[i] + acc_z[i], MAX_SPEED);
+    x[i] = Move(x[i], &vx[i]);
+    y[i] = Move(y[i], &vy[i]);
+    z[i] = Move(z[i], &vz[i]);
+  }
+}
+
+void PrintState(int step) {
+  int energy = 0;
+  int total_mass = 0;
+  int cx = 0;
+  int cy = 0;
+  int cz = 0;
+  int checksum = 0;
+  for (int i = 0; i < N; i++) {
+    energy += (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]) / 64;
+    total_mass += mass[i];
+    cx += mass[i] * (x[i] / ONE);
+    cy += mass[i] * (y[i] / ONE);
+    cz += mass[i] * (z[i] / ONE);
+    checksum = (checksum * 31 + x[i] % 65521) % 1000003;
+    checksum = (checksum * 31 + y[i] % 65521) % 1000003;
+    checksum = (checksum * 31 + z[i] % 65521) % 1000003;
+  }
+  printf("step %4d: energy=%d ", step, energy);
+  printf("center=(%d,%d,%d) ", cx / total_mass, cy / total_mass,
+         cz / total_mass);
+  printf("checksum=%d\n", checksum);
+}
+
+int main() {
+  seed = 31337;
+  for (int i = 0; i < N; i++) {
+    x[i] = Random() % SIZE;
+    y[i] = Random() % SIZE;
+    z[i] = Random() % SIZE;
+    vx[i] = Random() % 201 - 100;
+    vy[i] = Random() % 201 - 100;
+    vz[i] = Random() % 201 - 100;
+    mass[i] = 1 + Random() % 8;
+  }
+  for (int s = 0; s <= STEPS; s++) {
+    if (s % 100 == 0) PrintState(s);
+    Step();
+  }
+  return 0;
+}
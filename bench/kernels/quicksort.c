@@ -0,0 +1,85 @@
+// Quicksort of pseudo-random ints, with insertion sort for short ranges.
+#include <stdio.h>
+
+#define N 200000
+#define ROUNDS 6
+
+int a[N];
+int seed;
+
+int Random() {
+  // Park-Miller generator with the method of Schrage not to overflow.
+  int hi = seed / 127773;
+  int lo = seed % 127773;
+  seed = 16807 * lo - 2836 * hi;
+  if (seed <= 0) seed += 2147483647;
+  return seed;
+}
+
+void InsertionSort(int *v, int lo, int hi) {
+  for (int i = lo + 1; i <= hi; i++) {
+    int x = v[i];
+    int j = i - 1;
+    while (j >= lo && v[j] > x) {
+      v[j + 1] = v[j];
+      j--;
+    }
+    v[j + 1] = x;
+  }
+}
+
+int MedianOf3(int x, int y, int z) {
+  if (x < y) {
+    if (y < z) return y;
+    return x < z ? z : x;
+  }
+  if (x < z) return x;
+  return y < z ? z : y;
+}
+
+void QuickSort(int *v, int lo, int hi) {
+  while (hi - lo > 16) {
+    int pivot = MedianOf3(v[lo], v[(lo + hi) / 2], v[hi]);
+    int i = lo;
+    int j = hi;
+    while (i <= j) {
+      while (v[i] < pivot) i++;
+      while (v[j] > pivot) j--;
+      if (i <= j) {
+        int t = v[i];
+        v[i] = v[j];
+        v[j] = t;
+        i++;
+        j--;
+      }
+    }
+    // Recurse into the shorter part to bound the depth.
+    if (j - lo < hi - i) {
+      QuickSort(v, lo, j);
+      lo = i;
+    } else {
+      QuickSort(v, i, hi);
+      hi = j;
+    }
+  }
+  InsertionSort(v, lo, hi);
+}
+
+int main() {
+  seed = 42;
+  for (int r = 0; r < ROUNDS; r++) {
+    // Rounds alternate random values and values with many duplicates.
+    int range = r % 2 ? 1000 : 1000000000;
+    for (int i = 0; i < N; i++) a[i] = Random() % range;
+    QuickSort(a, 0, N - 1);
+    int is_sorted = 1;
+    int sum = 0;
+    for (int i = 0; i < N; i++) {
+      if (i && a[i - 1] > a[i]) is_sorted = 0;
+      sum = (sum * 31 + a[i] % 65536) % 1000003;
+    }
+    printf("round %d: sorted=%d sum=%d ", r, is_sorted, sum);
+    printf("min=%d median=%d max=%d\n", a[0], a[N / 2], a[N - 1]);
+  }
+  return 0;
+}
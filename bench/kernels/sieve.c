@@ -0,0 +1,44 @@
+// Sieve of Eratosthenes, counting the primes below powers of 10.
+#include <stdio.h>
+
+#define LIMIT 10000000
+#define ROUNDS 3
+
+char is_composite[10000001];  // LIMIT + 1
+
+int Sieve(int limit) {
+  // Returns the number of primes up to limit.
+  for (int i = 0; i <= limit; i++) is_composite[i] = 0;
+  is_composite[0] = 1;
+  is_composite[1] = 1;
+  for (int i = 2; i * i <= limit; i++) {
+    if (!is_composite[i]) {
+      for (int j = i * i; j <= limit; j += i) is_composite[j] = 1;
+    }
+  }
+  int count = 0;
+  for (int i = 2; i <= limit; i++) count += !is_composite[i];
+  return count;
+}
+
+int main() {
+  for (int r = 0; r < ROUNDS; r++) {
+    int count = Sieve(LIMIT);
+    printf("round %d: pi(%d)=%d\n", r, LIMIT, count);
+  }
+  // Counts below powers of 10, from the last sieve.
+  int count = 0;
+  int next = 10;
+  int largest = 0;
+  for (int i = 2; i <= LIMIT; i++) {
+    if (!is_composite[i]) {
+      count++;
+      largest = i;
+    }
+    if (i == next) {
+      printf("pi(%d)=%d largest=%d\n", next, count, largest);
+      next *= 10;
+    }
+  }
+  return 0;
+}
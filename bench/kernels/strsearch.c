@@ -0,0 +1,85 @@
+// String search in a pseudo-random DNA-like text, with the naive algorithm
+// and with Boyer-Moore-Horspool. Both have to find the same matches.
+#include <stdio.h>
+
+#define TEXT_LENGTH 1000000
+#define NUM_OF_PATTERNS 24
+#define MAX_PATTERN_LENGTH 24
+
+char text[1000001];  // TEXT_LENGTH + 1
+char pattern[25];    // MAX_PATTERN_LENGTH + 1
+int shift[256];
+int seed;
+
+int Random() {
+  // Park-Miller generator with the method of Schrage not to overflow.
+  int hi = seed / 127773;
+  int lo = seed % 127773;
+  seed = 16807 * lo - 2836 * hi;
+  if (seed <= 0) seed += 2147483647;
+  return seed;
+}
+
+int RandomBase() {
+  int r = Random() % 4;
+  if (r == 0) return 'a';
+  if (r == 1) return 'c';
+  if (r == 2) return 'g';
+  return 't';
+}
+
+int SearchNaive(int m, int *first) {
+  int count = 0;
+  *first = -1;
+  for (int i = 0; i + m <= TEXT_LENGTH; i++) {
+    int j = 0;
+    while (j < m && text[i + j] == pattern[j]) j++;
+    if (j == m) {
+      if (*first < 0) *first = i;
+      count++;
+    }
+  }
+  return count;
+}
+
+int SearchHorspool(int m) {
+  for (int i = 0; i < 256; i++) shift[i] = m;
+  for (int i = 0; i < m - 1; i++) {
+    int c = pattern[i];
+    shift[c] = m - 1 - i;
+  }
+  int count = 0;
+  int i = 0;
+  while (i + m <= TEXT_LENGTH) {
+    int j = m - 1;
+    while (j >= 0 && text[i + j] == pattern[j]) j--;
+    if (j < 0) count++;
+    int c = text[i + m - 1];
+    i += shift[c];
+  }
+  return count;
+}
+
+int main() {
+  seed = 2024;
+  for (int i = 0; i < TEXT_LENGTH; i++) text[i] = RandomBase();
+  text[TEXT_LENGTH] = 0;
+  int total = 0;
+  int num_of_mismatches = 0;
+  for (int p = 0; p < NUM_OF_PATTERNS; p++) {
+    // Even patterns are taken from the text, and odd ones are random.
+    int m = 4 + p % (MAX_PATTERN_LENGTH - 3);
+    int pos = Random() % (TEXT_LENGTH - m);
+    for (int i = 0; i < m; i++) {
+      pattern[i] = p % 2 ? RandomBase() : text[pos + i];
+    }
+    pattern[m] = 0;
+    int first;
+    int count = SearchNaive(m, &first);
+    if (SearchHorspool(m) != count) num_of_mismatches++;
+    printf("%-24s length=%2d count=%6d first=%d\n", pattern, m, count, first);
+    total += count;
+  }
+  printf("total=%d mismatches=%d\n", total, num_of_mismatches);
+  return 0;
+}
@@ -0,0 +1,305 @@
+// Runtime benchmark of the code generated by compilium.
+// Each benchmark <prefix> is run as three builds: <prefix>.bin by compilium,
+// <prefix>.host.bin by the host compiler with -O0 and <prefix>.host_o3.bin
+// with -O3 (see the rules in examples/Makefile). Each build is run for the
+// given number of trials, and the min and the median of the wall time are
+// reported with a checksum (FNV-1a) of its stdout. The reference output is
+// <prefix>.expected if it exists, or the output of the -O0 build, and a
+// build printing something else is reported as WRONG.
+// The results are written as TSV (--output), which can be given as the
+// baseline of a later run (--baseline). Then a compilium build whose min
+// time is slower than the baseline by more than the threshold (in percent)
+// is reported as REGRESSION. Baselines are meaningful only on the machine
+// they are recorded.
+// This is a host program, built with the host compiler (see Makefile).
+//
+// usage: runtime_bench [--trials <n>] [--threshold <percent>]
+//                      [--baseline <results.tsv>] [--output <results.tsv>]
+//                      <prefix>...
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_TRIALS 64
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325UL
+#define FNV_PRIME 0x100000001b3UL
+
+struct Build {
+  const char *name;
+  const char *suffix;
+};
+
+static const struct Build builds[] = {
+    {"compilium", ".bin"},
+    {"host_O0", ".host.bin"},
+    {"host_O3", ".host_o3.bin"},
+};
+#define NUM_OF_BUILDS ((int)(sizeof(builds) / sizeof(builds[0])))
+#define COMPILIUM_BUILD 0
+#define REFERENCE_BUILD 1  // host_O0
+
+struct Result {
+  char benchmark[64];
+  char build[32];
+  int trials;
+  double min_ms;
+  double median_ms;
+  unsigned long checksum;
+  char status[32];
+};
+
+static double GetMonotonicTimeInSec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long HashBytes(unsigned long h, const char *p, long size) {
+  for (long i = 0; i < size; i++) {
+    h ^= (unsigned char)p[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+static int RunBinary(const char *path, double *wall,
+                     unsigned long *checksum) {
+  // Runs path with its stdout read through a pipe, and returns its exit
+  // status. Reading is included in the time, which is the same for builds.
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  double begin = GetMonotonicTimeInSec();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], 1);
+    close(fds[1]);
+    execl(path, path, (char *)NULL);
+    perror(path);
+    _exit(127);
+  }
+  close(fds[1]);
+  unsigned long h = FNV_OFFSET_BASIS;
+  char buf[65536];
+  ssize_t size;
+  while ((size = read(fds[0], buf, sizeof(buf))) != 0) {
+    if (size < 0) {
+      if (errno == EINTR) continue;
+      perror("read");
+      exit(EXIT_FAILURE);
+    }
+    h = HashBytes(h, buf, size);
+  }
+  close(fds[0]);
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      perror("waitpid");
+      exit(EXIT_FAILURE);
+    }
+  }
+  *wall = GetMonotonicTimeInSec() - begin;
+  *checksum = h;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static int CompareDouble(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void RunBuild(struct Result *r, const char *path, int trials) {
+  double times[MAX_TRIALS];
+  r->trials = 0;
+  strcpy(r->status, "OK");
+  for (int i = 0; i < trials; i++) {
+    unsigned long checksum;
+    int status = RunBinary(path, &times[i], &checksum);
+    if (status) {
+      snprintf(r->status, sizeof(r->status), "FAIL(%d)", status);
+      r->checksum = checksum;
+      break;
+    }
+    if (i && checksum != r->checksum) {
+      strcpy(r->status, "UNSTABLE");  // output differs between trials
+    }
+    r->checksum = checksum;
+    r->trials++;
+  }
+  if (!r->trials) return;
+  qsort(times, r->trials, sizeof(double), CompareDouble);
+  r->min_ms = times[0] * 1e3;
+  r->median_ms = r->trials % 2 ? times[r->trials / 2] * 1e3
+                               : (times[r->trials / 2 - 1] +
+                                  times[r->trials / 2]) * 1e3 / 2;
+}
+
+static bool ReadExpectedChecksum(const char *prefix, unsigned long *checksum) {
+  // Returns false if there is no <prefix>.expected.
+  char path[4096];
+  snprintf(path, sizeof(path), "%s.expected", prefix);
+  FILE *fp = fopen(path, "rb");
+  if (!fp) return false;
+  unsigned long h = FNV_OFFSET_BASIS;
+  char buf[65536];
+  size_t size;
+  while ((size = fread(buf, 1, sizeof(buf), fp)) != 0) {
+    h = HashBytes(h, buf, size);
+  }
+  fclose(fp);
+  *checksum = h;
+  return true;
+}
+
+static const char *GetBaseName(const char *path) {
+  const char *p = strrchr(path, '/');
+  return p ? p + 1 : path;
+}
+
+static struct Result *ReadResults(const char *path, int *num_of_results) {
+  // Reads a TSV written by WriteResults.
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  int capacity = 16;
+  struct Result *results = malloc(sizeof(struct Result) * capacity);
+  int n = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#') continue;
+    if (n == capacity) {
+      capacity *= 2;
+      results = realloc(results, sizeof(struct Result) * capacity);
+    }
+    struct Result *r = &results[n];
+    if (sscanf(line, "%63s %31s %d %lf %lf %lx %31s", r->benchmark, r->build,
+               &r->trials, &r->min_ms, &r->median_ms, &r->checksum,
+               r->status) == 7) {
+      n++;
+    }
+  }
+  fclose(fp);
+  *num_of_results = n;
+  return results;
+}
+
+static void WriteResults(const char *path, struct Result *results, int n) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(fp, "# benchmark\tbuild\ttrials\tmin_ms\tmedian_ms\tchecksum\t"
+              "status\n");
+  for (int i = 0; i < n; i++) {
+    struct Result *r = &results[i];
+    fprintf(fp, "%s\t%s\t%d\t%.3f\t%.3f\t%016lx\t%s\n", r->benchmark,
+            r->build, r->trials, r->min_ms, r->median_ms, r->checksum,
+            r->status);
+  }
+  fclose(fp);
+}
+
+static struct Result *FindResult(struct Result *results, int n,
+                                 const char *benchmark, const char *build) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(results[i].benchmark, benchmark) == 0 &&
+        strcmp(results[i].build, build) == 0) {
+      return &results[i];
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int trials = 5;
+  double threshold = 10;
+  const char *baseline_path = NULL;
+  const char *output_path = NULL;
+  const char **prefixes = malloc(sizeof(const char *) * argc);
+  int num_of_prefixes = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc) {
+      trials = atoi(argv[++i]);
+      if (trials <= 0) trials = 1;
+      if (trials > MAX_TRIALS) trials = MAX_TRIALS;
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+      output_path = argv[++i];
+    } else if (argv[i][0] != '-') {
+      prefixes[num_of_prefixes++] = argv[i];
+    } else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  struct Result *baseline = NULL;
+  int num_of_baseline = 0;
+  if (baseline_path) baseline = ReadResults(baseline_path, &num_of_baseline);
+  struct Result *results =
+      calloc(num_of_prefixes * NUM_OF_BUILDS, sizeof(struct Result));
+  int num_of_results = 0;
+  int num_of_failed = 0;
+  printf("%-12s %-10s %6s %10s %10s %8s %-16s %s\n", "benchmark", "build",
+         "trials", "min ms", "median ms", "/host_O0", "checksum", "status");
+  for (int i = 0; i < num_of_prefixes; i++) {
+    const char *benchmark = GetBaseName(prefixes[i]);
+    // The reference is run first to check the others against it.
+    int order[NUM_OF_BUILDS] = {REFERENCE_BUILD};
+    for (int k = 0, j = 1; k < NUM_OF_BUILDS; k++) {
+      if (k != REFERENCE_BUILD) order[j++] = k;
+    }
+    struct Result *reference = &results[num_of_results];
+    unsigned long expected;
+    bool has_expected = ReadExpectedChecksum(prefixes[i], &expected);
+    for (int k = 0; k < NUM_OF_BUILDS; k++) {
+      const struct Build *b = &builds[order[k]];
+      struct Result *r = &results[num_of_results++];
+      snprintf(r->benchmark, sizeof(r->benchmark), "%s", benchmark);
+      snprintf(r->build, sizeof(r->build), "%s", b->name);
+      char path[4096];
+      snprintf(path, sizeof(path), "%s%s", prefixes[i], b->suffix);
+      RunBuild(r, path, trials);
+      bool is_wrong = has_expected ? r->checksum != expected
+                                   : r->checksum != reference->checksum;
+      if (strcmp(r->status, "OK") == 0 && is_wrong) {
+        strcpy(r->status, "WRONG");
+      }
+      struct Result *base =
+          FindResult(baseline, num_of_baseline, benchmark, b->name);
+      if (strcmp(r->status, "OK") == 0 && order[k] == COMPILIUM_BUILD && base &&
+          r->min_ms > base->min_ms * (1 + threshold / 100)) {
+        snprintf(r->status, sizeof(r->status), "REGRESSION(+%.0f%%)",
+                 (r->min_ms / base->min_ms - 1) * 100);
+      }
+      if (strcmp(r->status, "OK") != 0) num_of_failed++;
+      printf("%-12s %-10s %6d %10.2f %10.2f %7.2fx %016lx %s\n", r->benchmark,
+             r->build, r->trials, r->min_ms, r->median_ms,
+             reference->min_ms > 0 ? r->min_ms / reference->min_ms : 0,
+             r->checksum, r->status);
+      fflush(stdout);
+    }
+  }
+  if (output_path) WriteResults(output_path, results, num_of_results);
+  return num_of_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,9 +1,5 @@
 #include "compilium.h"
 
-const char *symbol_prefix;
-const char *include_path;
-bool is_preprocess_only = false;
-
 _Noreturn void Error(const char *fmt, ...) {
   fflush(stdout);
   fprintf(stderr, "Error: ");
@@ -12,6 +8,7 @@ _Noreturn void Error(const char *fmt, ...) {
   vfprintf(stderr, fmt, ap);
   va_end(ap);
   fputc('\n', stderr);
+  if (compiler && compiler->error_jmp) longjmp(*compiler->error_jmp, 1);
   exit(EXIT_FAILURE);
 }
 
@@ -19,50 +16,11 @@ _Noreturn void __assert(const char *expr_str, const char *file, int line) {
   Error("Assertion failed: %s at %s:%d\n", expr_str, file, line);
 }
 
-void TestList(void);
-void TestType(void);
-static struct Node *ParseCompilerArgs(int argc, char **argv) {
-  // returns replacement_list: ASTList which contains macro replacement
-  struct Node *replacement_list = AllocList();
-  symbol_prefix = "_";
-  for (int i = 1; i < argc; i++) {
-    if (strcmp(argv[i], "--target-os") == 0) {
-      i++;
-      if (strcmp(argv[i], "Darwin") == 0) {
-        symbol_prefix = "_";
-        // Define __APPLE__ macro
-        PushKeyValueToList(replacement_list, "__APPLE__",
-                           CreateMacroReplacement(NULL, NULL));
-      } else if (strcmp(argv[i], "Linux") == 0) {
-        symbol_prefix = "";
-      } else {
-        Error("Unknown os type %s", argv[i]);
-      }
-    } else if (strcmp(argv[i], "-I") == 0) {
-      i++;
-      include_path = argv[i];
-      assert(include_path);
-      if (include_path[strlen(include_path) - 1] != '/') {
-        Error("Include path (-I <path>) should be ended with '/'");
-      }
-      fprintf(stderr, "Include path: %s\n", include_path);
-    } else if (strcmp(argv[i], "--run-unittest=List") == 0) {
-      TestList();
-    } else if (strcmp(argv[i], "--run-unittest=Type") == 0) {
-      TestType();
-    } else if (strcmp(argv[i], "-E") == 0) {
-      is_preprocess_only = true;
-    } else {
-      Error("Unknown argument: %s", argv[i]);
-    }
-  }
-  return replacement_list;
-}
-
 void PrintTokenLine(struct Node *t) {
   assert(t);
   const char *line_begin = t->begin;
-  while (t->src_str < line_begin) {
+  const char *src_begin = FindSourceBegin(t->begin);
+  while (src_begin && src_begin < line_begin) {
     if (line_begin[-1] == '\n') break;
     line_begin--;
   }
@@ -96,6 +54,7 @@ _Noreturn void ErrorWithToken(struct Node *t, const char *fmt, ...) {
   vfprintf(stderr, fmt, ap);
   va_end(ap);
   fputc('\n', stderr);
+  if (compiler && compiler->error_jmp) longjmp(*compiler->error_jmp, 1);
   exit(EXIT_FAILURE);
 }
 
@@ -106,8 +65,10 @@ struct Node *AllocList() {
 void ExpandListSizeIfNeeded(struct Node *list) {
   if (list->size < list->capacity) return;
   list->capacity = (list->capacity + 1) * 2;
-  list->nodes = realloc(list->nodes, sizeof(struct Node *) * list->capacity);
-  assert(list->nodes);
+  struct Node **nodes = ArenaAlloc(sizeof(struct Node *) * list->capacity);
+  if (list->size)
+    memcpy(nodes, list->nodes, sizeof(struct Node *) * list->size);
+  list->nodes = nodes;
   assert(list->size < list->capacity);
 }
 
@@ -118,9 +79,10 @@ void PushToList(struct Node *list, struct Node *node) {
 
 void PushKeyValueToList(struct Node *list, const char *key,
                         struct Node *value) {
+  // key is interned so that GetNodeByTokenKey can compare it with atoms.
   assert(key && value);
   ExpandListSizeIfNeeded(list);
-  list->nodes[list->size++] = CreateASTKeyValue(key, value);
+  list->nodes[list->size++] = CreateASTKeyValue(InternCStr(key), value);
 }
 
 int GetSizeOfList(struct Node *list) {
@@ -136,10 +98,13 @@ struct Node *GetNodeAt(struct Node *list, int index) {
 
 struct Node *GetNodeByTokenKey(struct Node *list, struct Node *key) {
   assert(list && list->type == kASTList);
+  if (!IsToken(key) || !key->atom) return NULL;
+  STAT_CALL(kStatListKeyLookup);
   for (int i = 0; i < list->size; i++) {
     struct Node *n = list->nodes[i];
+    STAT_STEPS(kStatListKeyLookup, 1);
     if (n->type != kASTKeyValue) continue;
-    if (IsEqualTokenWithCStr(key, n->key)) return n->value;
+    if (n->key == key->atom) return n->value;
   }
   return NULL;
 }
@@ -250,48 +215,65 @@ const char *param_reg_names_8[NUM_OF_PARAM_REGISTERS] = {"dl", "sil", "dl",
                                                          "cl", "r8b", "r9b"};
 
 #define INITIAL_INPUT_SIZE 8192
-const char *ReadFile(FILE *fp) {
+static const char *ReadStream(FILE *fp) {
+  // Fallback for pipes and ttys whose size is not known in advance.
   int buf_size = INITIAL_INPUT_SIZE;
   char *input = malloc(buf_size);
+  assert(input);
   int input_size = 0;
-  int c;
-  while ((c = fgetc(fp)) != EOF) {
-    input[input_size++] = c;
-    if (input_size == buf_size) {
-      buf_size <<= 1;
-      assert((input = realloc(input, buf_size)));
-    }
+  for (;;) {
+    input_size += fread(input + input_size, 1, buf_size - input_size - 1, fp);
+    if (input_size < buf_size - 1) break;
+    buf_size <<= 1;
+    assert((input = realloc(input, buf_size)));
   }
-  assert(input_size < buf_size);
   input[input_size] = 0;
-  return input;
+  char *s = ArenaAlloc(input_size + 1);
+  memcpy(s, input, input_size + 1);
+  free(input);
+  return s;
 }
 
-int main(int argc, char *argv[]) {
-  struct Node *replacement_list = ParseCompilerArgs(argc, argv);
-  const char *input = ReadFile(stdin);
-
-  struct Node *tokens = Tokenize(input);
-
-  fputs("Preprocess begin\n", stderr);
-  Preprocess(&tokens, replacement_list);
-  if (is_preprocess_only) {
-    OutputTokenSequenceAsCSource(tokens);
-    return 0;
+const char *ReadFile(FILE *fp) {
+  // Reads whole contents of fp with a single fread when the size is known.
+  // Returned buffer is NUL-terminated and lives until the end of compilation,
+  // so tokens can point into it directly.
+  long size;
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET) != 0) {
+    return ReadStream(fp);
   }
+  char *input = ArenaAlloc(size + 1);
+  long input_size = fread(input, 1, size, fp);
+  input[input_size] = 0;
+  return input;
+}
 
-  fputs("Parse begin\n", stderr);
-  struct Node *ast = Parse(&tokens);
-  PrintASTNode(ast);
-  fputc('\n', stderr);
-
-  Optimize(ast);
-
-  fputs("Analyze begin\n", stderr);
-  struct SymbolEntry *ctx = Analyze(ast);
-  PrintASTNode(ast);
-  fputc('\n', stderr);
-
-  Generate(ast, ctx);
-  return 0;
+const char *ReadFileFromPath(const char *path) {
+  // Returns NULL if the file could not be opened.
+  // "-" is treated as stdin. A regular file is sized with fstat and read
+  // with a single read(2); others (pipes, devices) are read as a stream.
+  if (strcmp(path, "-") == 0) return ReadFile(stdin);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+    close(fd);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    const char *input = ReadFile(fp);
+    fclose(fp);
+    return input;
+  }
+  char *input = ArenaAlloc(st.st_size + 1);
+  long input_size = 0;
+  while (input_size < st.st_size) {
+    // Short reads happen only for files changed while being read.
+    long size = read(fd, input + input_size, st.st_size - input_size);
+    if (size <= 0) break;
+    input_size += size;
+  }
+  close(fd);
+  input[input_size] = 0;
+  return input;
 }
@@ -1,12 +1,131 @@
 #include "include/stdarg.h"
 #include "include/stdbool.h"
 #include "include/stdio.h"
+#include "include/stddef.h"
 #include "include/stdlib.h"
 #include "include/string.h"
+#include "libcompilium.h"
 
 char *strndup(const char *s, size_t n);
 char *strdup(const char *s);
 
+// POSIX functions used for precompiled headers, the output, workers, the
+// compile server and the time report
+#define PROT_READ 1
+#define MAP_PRIVATE 2
+#define MAP_FAILED ((void *)-1)
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, long offset);
+int munmap(void *addr, size_t len);
+int fileno(FILE *fp);
+int getpid(void);
+long write(int fd, const void *buf, size_t size);
+long read(int fd, void *buf, size_t size);
+int close(int fd);
+int dup(int fd);
+int dup2(int fd, int fd2);
+int unlink(const char *path);
+int chdir(const char *path);
+char *getcwd(char *buf, size_t size);
+char *realpath(const char *path, char *resolved_path);
+long sysconf(int name);
+#ifdef __APPLE__
+#define _SC_NPROCESSORS_ONLN 58
+#else
+#define _SC_NPROCESSORS_ONLN 84
+#endif
+#define AF_UNIX 1
+#define SOCK_STREAM 1
+struct sockaddr_un {
+#ifdef __APPLE__
+  unsigned char sun_len;
+  unsigned char sun_family;
+  char sun_path[104];
+#else
+  unsigned short sun_family;
+  char sun_path[108];
+#endif
+};
+int socket(int domain, int type, int protocol);
+int bind(int fd, const void *addr, unsigned int len);
+int listen(int fd, int backlog);
+int accept(int fd, void *addr, unsigned int *len);
+int connect(int fd, const void *addr, unsigned int len);
+#define SIGPIPE 13
+#define SIG_IGN ((void (*)(int))1)
+void (*signal(int sig, void (*handler)(int)))(int);
+struct timespec {
+  long tv_sec;
+  long tv_nsec;
+};
+#ifdef __APPLE__
+#define CLOCK_MONOTONIC 6
+#define CLOCK_THREAD_CPUTIME_ID 16
+#else
+#define CLOCK_MONOTONIC 1
+#define CLOCK_THREAD_CPUTIME_ID 3
+#endif
+int clock_gettime(int clock_id, struct timespec *ts);
+#define O_RDONLY 0
+#define S_IFMT 0170000
+#define S_IFREG 0100000
+struct stat {  // of x86-64 Linux, or of Darwin with 64-bit inodes
+#ifdef __APPLE__
+  int st_dev;
+  unsigned short st_mode;
+  unsigned short st_nlink;
+  unsigned long st_ino;
+  unsigned int st_uid;
+  unsigned int st_gid;
+  int st_rdev;
+  struct timespec st_atim;
+  struct timespec st_mtim;
+  struct timespec st_ctim;
+  struct timespec st_birthtim;
+  long st_size;
+  long st_blocks;
+  int st_blksize;
+  unsigned int st_flags;
+  unsigned int st_gen;
+  int st_lspare;
+  long st_qspare[2];
+#else
+  unsigned long st_dev;
+  unsigned long st_ino;
+  unsigned long st_nlink;
+  unsigned int st_mode;
+  unsigned int st_uid;
+  unsigned int st_gid;
+  int st_pad0;
+  unsigned long st_rdev;
+  long st_size;
+  long st_blksize;
+  long st_blocks;
+  struct timespec st_atim;
+  struct timespec st_mtim;
+  struct timespec st_ctim;
+  long st_reserved[3];
+#endif
+};
+int open(const char *path, int flags, ...);
+int fstat(int fd, struct stat *st);
+int stat(const char *path, struct stat *st);
+
+// setjmp and POSIX threads, to run compilations on threads and to return
+// from them on errors instead of exiting the process
+typedef long jmp_buf[32];  // large enough for Linux and Darwin
+int setjmp(jmp_buf env);
+_Noreturn void longjmp(jmp_buf env, int val);
+typedef unsigned long pthread_t;
+typedef union {
+  long align;
+  char opaque[64];
+} pthread_attr_t;
+int pthread_attr_init(pthread_attr_t *attr);
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t size);
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start)(void *), void *arg);
+int pthread_join(pthread_t thread, void **retval);
+
 #define assert(expr) \
   ((void)((expr) || (__assert(#expr, __FILE__, __LINE__), 0)))
 
@@ -72,6 +191,60 @@ enum TokenType {
   kTokenLineComment,
   kTokenBlockCommentBegin,
   kTokenBlockCommentEnd,
+  // Bounds of the tokens from a file included while building a PCH
+  kTokenPCHIncludeBegin,
+  kTokenPCHIncludeEnd,
+};
+
+// Sub-kind of kTokenPunctuator tokens, assigned by the tokenizer
+enum PunctuatorID {
+  kPunctNone,  // not a punctuator
+  kPunctHashHash,
+  kPunctHash,
+  kPunctAndAnd,
+  kPunctAnd,
+  kPunctOrOr,
+  kPunctOr,
+  kPunctShlAssign,
+  kPunctShl,
+  kPunctLe,
+  kPunctLt,
+  kPunctShrAssign,
+  kPunctShr,
+  kPunctGe,
+  kPunctGt,
+  kPunctEq,
+  kPunctAssign,
+  kPunctNe,
+  kPunctNot,
+  kPunctXor,
+  kPunctInc,
+  kPunctAddAssign,
+  kPunctPlus,
+  kPunctDec,
+  kPunctSubAssign,
+  kPunctArrow,
+  kPunctMinus,
+  kPunctMulAssign,
+  kPunctStar,
+  kPunctDivAssign,
+  kPunctSlash,
+  kPunctModAssign,
+  kPunctPercent,
+  kPunctTilde,
+  kPunctQuestion,
+  kPunctColon,
+  kPunctComma,
+  kPunctSemicolon,
+  kPunctLBrace,
+  kPunctRBrace,
+  kPunctLParen,
+  kPunctRParen,
+  kPunctEllipsis,
+  kPunctDot,
+  kPunctLBracket,
+  kPunctRBracket,
+  kNumOfPunctuators,
 };
 
 /*
@@ -91,55 +264,104 @@ Node expr-stmt:
 
 struct Node {
   enum NodeType type;
-  int reg;
-  struct Node *expr_type;
-  struct Node *op;
-  struct Node *left;
-  struct Node *right;
-  struct Node *init;
-  struct Node *cond;
-  struct Node *updt;
-  struct Node *body;
-  struct Node *if_true_stmt;
-  struct Node *if_else_stmt;
-  struct Node *decltor_init_expr;
-  struct Node *decltor_init_stmt;
-  struct Node *struct_member_dict;
-  struct Node *struct_member_ent_type;
-  struct Node *struct_member_decl;
-  int struct_member_ent_ofs;
-  // for list
-  int capacity;
-  int size;
-  struct Node **nodes;
-  // for key value
-  const char *key;
-  struct Node *value;
-  // for local var
-  int byte_offset;
-  // for string literal
-  int label_number;
-  // kASTExprFuncCall
-  struct Node *func_expr;
-  struct Node *arg_expr_list;
-  struct Node *arg_var_list;
-  int stack_size_needed;
-  // kASTFuncDef
-  struct Node *func_body;
-  struct Node *func_type;
-  struct Node *func_name_token;
-  struct Node *tag;
-  struct Node *type_struct_spec;
-  struct Node *type_array_type_of;
-  struct Node *type_array_index_decl;
-  // kNodeToken
-  enum TokenType token_type;
-  struct Node *next_token;
-  const char *begin;
-  int length;
-  const char *src_str;
-  int line;
+  union {
+    // kNodeToken
+    // Tokens use only these fields, so they are allocated with
+    // TOKEN_NODE_SIZE bytes instead of sizeof(struct Node).
+    struct {
+      enum TokenType token_type;
+      int length;
+      int line;
+      enum PunctuatorID punct_id;  // kPunctNone if not a punctuator
+      const char *begin;
+      const char *atom;  // interned name of ident and keyword tokens, or NULL
+      struct Node *next_token;
+    };
+    // AST nodes and types
+    // The fields up to cond are common to all of them. The rest is a union
+    // of payloads for each NodeType, and AllocNode allocates only the bytes
+    // needed for the payload of the type (see GetSizeOfNode).
+    struct {
+      int reg;
+      struct Node *expr_type;
+      struct Node *op;
+      struct Node *left;
+      struct Node *right;
+      struct Node *cond;
+      union {
+        // kASTExpr, kASTLocalVar
+        struct {
+          int byte_offset;
+          // for string literal
+          int label_number;
+        };
+        // kASTForStmt, kASTWhileStmt
+        struct {
+          struct Node *body;
+          struct Node *init;
+          struct Node *updt;
+        };
+        // kASTSelectionStmt
+        struct {
+          struct Node *if_true_stmt;
+          struct Node *if_else_stmt;
+        };
+        // kASTDecltor
+        struct Node *decltor_init_expr;
+        // kASTList
+        struct {
+          int capacity;
+          int size;
+          struct Node **nodes;
+        };
+        // kASTKeyValue(key, value), kASTDirectDecltor(value),
+        // kNodeMacroReplacement(value, arg_expr_list), kASTExprFuncCall
+        struct {
+          struct Node *value;
+          union {
+            const char *key;
+            struct {
+              struct Node *arg_expr_list;
+              struct Node *func_expr;
+              int stack_size_needed;
+            };
+          };
+        };
+        // kASTFuncDef
+        struct {
+          struct Node *func_body;
+          struct Node *func_type;
+          struct Node *func_name_token;
+          struct Node *arg_var_list;
+        };
+        // kNodeStructMember
+        struct {
+          struct Node *struct_member_decl;
+          struct Node *struct_member_ent_type;
+          int struct_member_ent_ofs;
+        };
+        // kASTStructSpec(tag, struct_member_dict),
+        // kTypeStruct(tag, type_struct_spec)
+        struct {
+          struct Node *tag;
+          struct Node *struct_member_dict;
+          struct Node *type_struct_spec;
+        };
+        // kTypeArray
+        struct {
+          struct Node *type_array_type_of;
+          struct Node *type_array_index_decl;
+        };
+      };
+    };
+  };
 };
+// Bytes of struct Node needed to hold the fields up to member
+#define NODE_SIZE_UNTIL(member)                                            \
+  ((offsetof(struct Node, member) + sizeof(((struct Node *)0)->member) + \
+    7) &                                                                   \
+   ~7UL)
+#define TOKEN_NODE_SIZE NODE_SIZE_UNTIL(next_token)
 
 _Noreturn void Error(const char *fmt, ...);
 _Noreturn void __assert(const char *expr_str, const char *file, int line);
@@ -155,9 +377,6 @@ int GetSizeOfList(struct Node *list);
 struct Node *GetNodeAt(struct Node *list, int index);
 struct Node *GetNodeByTokenKey(struct Node *list, struct Node *key);
 
-extern const char *symbol_prefix;
-extern const char *include_path;
-
 #define NUM_OF_SCRATCH_REGS 10
 extern const char *reg_names_64[NUM_OF_SCRATCH_REGS + 1];
 extern const char *reg_names_32[NUM_OF_SCRATCH_REGS + 1];
@@ -169,7 +388,36 @@ extern const char *param_reg_names_32[NUM_OF_PARAM_REGISTERS];
 extern const char *param_reg_names_8[NUM_OF_PARAM_REGISTERS];
 
 // @analyzer.c
-struct SymbolEntry *Analyze(struct Node *node);
+struct SymbolTable *Analyze(struct Node *node);
+
+// @arena.c
+enum ArenaKind {
+  kArenaLex,
+  kArenaParse,
+  kArenaAnalysis,
+  kArenaCodegen,
+  kArenaCache,  // kept between compilations by the compile server
+  kNumOfArenas,
+};
+struct ArenaChunk;
+struct Arena {
+  struct ArenaChunk *chunks;
+  struct ArenaChunk *free_chunks;  // recycled by RecycleArenas()
+  size_t num_of_bytes;     // requested by ArenaAlloc (after alignment)
+  size_t num_of_reserved;  // allocated for chunks
+  int num_of_objects;
+};
+enum ArenaKind SetCurrentArena(enum ArenaKind kind);
+void *ArenaAlloc(size_t size);
+char *ArenaStrndup(const char *s, size_t n);
+char *ArenaStrdup(const char *s);
+void ReleaseAllArenas(void);
+void RecycleArenas(void);
+void PrintAllocReport(FILE *fp);
+
+// @assembler.c
+struct ObjBuffer;
+void AssembleToObjectFile(const char *text, int size, struct ObjBuffer *file);
 
 // @ast.c
 bool IsToken(struct Node *n);
@@ -177,6 +425,7 @@ bool IsTokenWithType(struct Node *n, enum TokenType type);
 bool IsASTList(struct Node *);
 bool IsASTDeclOfTypedef(struct Node *n);
 bool IsASTDeclOfExtern(struct Node *n);
+int GetSizeOfNode(enum NodeType type);
 struct Node *AllocNode(enum NodeType type);
 struct Node *CreateASTBinOp(struct Node *t, struct Node *left,
                             struct Node *right);
@@ -204,32 +453,240 @@ struct Node *CreateASTIdent(struct Node *ident);
 struct Node *CreateTypeArray(struct Node *type_of, struct Node *index_decl);
 struct Node *CreateMacroReplacement(struct Node *args_tokens,
                                     struct Node *to_tokens);
+struct Node *GetDecltorInitExpr(struct Node *decltor);
+int GetLocalVarOffset(struct Node *local_var);
+struct Node *GetFuncCallArgs(struct Node *func_call);
+struct Node *GetFuncDefBody(struct Node *func_def);
 void PrintASTNode(struct Node *n);
 
 // @compilium.c
 const char *ReadFile(FILE *fp);
+const char *ReadFileFromPath(const char *path);
+
+// @context.c
+struct CompilerContext;
+struct CompilerContext *CreateCompilerContext(
+    const struct CompilerOptions *options);
+void DestroyCompilerContext(struct CompilerContext *c);
+void ResetCompilerContext(struct CompilerContext *c,
+                          const struct CompilerOptions *options);
+bool CompileInContext(struct CompilerContext *c, const char *source);
+
+// @driver.c
+int GetNumOfOnlineCPUs(void);
+int CompileFilesInParallel(const struct CompilerOptions *options,
+                           const char **input_paths, int num_of_files,
+                           const char *output_dir, const char *suffix,
+                           int num_of_jobs);
+
+// @elf.c
+struct ObjBuffer {
+  char *data;
+  int size;
+  int capacity;
+};
+
+enum ELFSectionIndex {
+  kELFSectionUndef,
+  kELFSectionText,
+  kELFSectionData,
+};
+
+struct ELFSymbol {
+  const char *name;
+  enum ELFSectionIndex section;  // kELFSectionUndef if not defined
+  int offset;
+  bool is_global;
+};
+
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+#define R_X86_64_GOTPCREL 9
+#define R_X86_64_REX_GOTPCRELX 42
+
+struct ELFRelocation {
+  int offset;  // in .text
+  int type;    // R_X86_64_*
+  int symbol;  // index in ELFObject.symbols, or -1 for the section symbol
+  enum ELFSectionIndex section;  // of the section symbol
+  long addend;
+};
+
+struct ELFObject {
+  struct ObjBuffer text;
+  struct ObjBuffer data;
+  struct ObjBuffer symbols;      // of struct ELFSymbol
+  struct ObjBuffer relocations;  // of struct ELFRelocation
+};
+
+int AppendToObjBuffer(struct ObjBuffer *b, const void *p, int size);
+void ReleaseELFObject(struct ELFObject *obj);
+void WriteELFObject(struct ELFObject *obj, struct ObjBuffer *file);
+
+// @emitter.c
+struct Emitter {
+  int fd;  // -1 if the output is captured
+  int recording_fd;  // fd restored by EndEmitterRecording()
+  int used;
+  int capacity;
+  char *buf;
+};
+void SetEmitterOutput(int fd);
+void CaptureEmitterOutput(void);
+const char *GetCapturedOutput(int *size);
+void ReleaseEmitter(void);
+void FlushEmitter(void);
+void EmitStrN(const char *s, int len);
+void Emit(const char *fmt, ...);
+int BeginEmitterRecording(void);
+const char *EndEmitterRecording(int begin, int *size);
+
+// @funccache.c
+unsigned long CalcFuncDefHash(struct Node *func_def);
+const char *LoadCachedFunc(struct Node *func_def, unsigned long hash);
+void StoreCachedFunc(struct Node *func_def, unsigned long hash,
+                     const char *code, int size);
+
+// @intern.c
+struct InternEntry {
+  const char *str;
+  int length;
+  unsigned int hash;
+};
+struct InternTable {
+  struct InternEntry *entries;
+  int capacity;
+  int used;
+};
+const char *InternStr(const char *begin, int length);
+const char *InternCStr(const char *s);
+void ReleaseInternTable(void);
 
 // @generate.c
-void Generate(struct Node *ast, struct SymbolEntry *);
+void Generate(struct Node *ast, struct SymbolTable *);
+
+// @macro.c
+struct MacroTable;
+struct MacroTable *AllocMacroTable(void);
+void DefineMacro(struct MacroTable *mt, const char *name,
+                 struct Node *replacement);
+void UndefMacro(struct MacroTable *mt, const char *name);
+struct Node *FindMacroByName(struct MacroTable *mt, const char *name);
+struct Node *FindMacro(struct MacroTable *mt, struct Node *t);
+struct Node *CreateMacroList(struct MacroTable *mt);
 
 // @optimizer.c
 void Optimize(struct Node *ast);
 
 // @parser.c
-extern struct Node *toplevel_names;
 void InitParser(struct Node **);
 struct Node *Parse(struct Node **passed_tokens);
 
+// @pch.c
+struct IncludeGuard {
+  const char *path;   // atom of the resolved path
+  const char *macro;  // atom of the guard macro, or NULL if #pragma once
+  struct IncludeGuard *next;
+};
+
+struct PCHDependency {
+  const char *path;    // atom of the resolved path
+  unsigned long hash;  // CalcPCHContentHash of the contents
+  long size;           // -1 if unknown; then the contents are always hashed
+  struct timespec mtime;
+  struct PCHDependency *next;
+};
+
+struct PCHMacroUse {
+  const char *name;    // atom
+  unsigned long hash;  // CalcPCHMacroHash of the macro when it was looked up
+  struct PCHMacroUse *next;
+};
+
+struct PCHToken {  // also the format of tokens in PCH files
+  int token_type;
+  int line;
+  unsigned int begin_ofs;  // in strings
+  int length;
+  int punct_id;
+  int atom_index;  // in atoms, or -1
+};
+
+struct PrecompiledHeader {
+  const struct PCHToken *tokens;  // after preprocessing
+  int num_of_tokens;
+  const char *strings;
+  unsigned int strings_size;
+  const char **atoms;
+  struct Node *macros;  // kASTList of name -> kNodeMacroReplacement
+  struct Node *undefs;  // token sequence of macro names removed by #undef
+  struct IncludeGuard *guards;
+  struct PCHDependency *deps;  // the first one is the header itself
+  struct PCHMacroUse *uses;  // macros defined outside the header and used
+};
+
+// FNV-1a
+#define FNV_OFFSET_BASIS 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+unsigned long CalcHash(unsigned long h, const char *s, int length);
+unsigned long CalcPCHContentHash(const char *s);
+unsigned long CalcPCHFlagsHash(struct Node *macro_list);
+unsigned long CalcPCHMacroHash(struct Node *rep);
+void StatPCHDependency(struct PCHDependency *d);
+void SetPCHTokens(struct PrecompiledHeader *pch, struct Node *tokens);
+struct Node *CreateTokenFromPCH(struct PrecompiledHeader *pch,
+                                const struct PCHToken *pt);
+const char *CreatePCHPath(const char *header_path, unsigned long flags_hash);
+struct PrecompiledHeader *LoadPCH(const char *pch_path,
+                                  const char *header_path,
+                                  unsigned long flags_hash);
+bool WritePCH(const char *pch_path, struct PrecompiledHeader *pch,
+              unsigned long flags_hash);
+void ReleasePCH(void);
+struct PrecompiledHeader *FindCachedPCH(const char *header_path,
+                                        unsigned long flags_hash);
+void AddCachedPCH(const char *header_path, unsigned long flags_hash,
+                  struct PrecompiledHeader *pch);
+
 // @preprocessor.c
-void Preprocess(struct Node **head_holder, struct Node *replacement_list);
+void Preprocess(struct Node **head_holder, struct MacroTable *macros);
+
+// @server.c
+_Noreturn void RunCompileServer(const char *socket_path);
+int CompileOnServer(const char *socket_path,
+                    const struct CompilerOptions *options,
+                    const char *input_path, const char *output_path);
+
+// @stats.c
+enum StatCounterKind {
+  kStatTokenCompare,   // IsEqualTokenWithCStr
+  kStatListKeyLookup,  // GetNodeByTokenKey
+  kStatSymbolLookup,   // FindSymbol
+  kStatMacroProbe,     // FindMacroByName
+  kStatNodeAlloc,      // AllocNode
+  kStatArenaAlloc,     // ArenaAlloc
+  kNumOfStatCounters,
+};
+struct StatCounter {
+  long calls;
+  long steps;
+};
+#ifdef COMPILIUM_STATS
+#define STAT_CALL(kind) (compiler->stats[kind].calls++)
+#define STAT_STEPS(kind, n) (compiler->stats[kind].steps += (n))
+#else
+#define STAT_CALL(kind) ((void)0)
+#define STAT_STEPS(kind, n) ((void)0)
+#endif
+void PrintStats(FILE *fp);
 
 // @struct.c
-struct SymbolEntry;
+struct SymbolTable;
 int CalcStructSize(struct Node *spec);
 int CalcStructAlign(struct Node *spec);
 void AddMemberOfStructFromDecl(struct Node *struct_spec, struct Node *decl);
 struct Node *FindStructMember(struct Node *struct_type, struct Node *key_token);
-void ResolveTypesOfMembersOfStruct(struct SymbolEntry *ctx, struct Node *spec);
+void ResolveTypesOfMembersOfStruct(struct SymbolTable *ctx, struct Node *spec);
 
 // @symbol.c
 enum SymbolType {
@@ -243,32 +700,45 @@ enum SymbolType {
 struct SymbolEntry {
   enum SymbolType type;
   struct SymbolEntry *prev;
-  const char *key;
+  struct SymbolEntry *next_in_bucket;
+  const char *key;  // atom
   struct Node *value;
+  int last_local_var_ofs;  // offset of the last local var at this entry
 };
-int GetLastLocalVarOffset(struct SymbolEntry *);
-struct Node *AddLocalVar(struct SymbolEntry **ctx, const char *key,
+struct SymbolScope;
+struct SymbolTable {
+  struct SymbolEntry **buckets;
+  int capacity;
+  int num_of_entries;
+  struct SymbolEntry *last;  // the most recently added entry
+  struct SymbolScope *scope;
+};
+struct SymbolTable *AllocSymbolTable(void);
+void PushSymbolScope(struct SymbolTable *ctx);
+void PopSymbolScope(struct SymbolTable *ctx);
+int GetLastLocalVarOffset(struct SymbolTable *ctx);
+struct Node *AddLocalVar(struct SymbolTable *ctx, const char *key,
                          struct Node *var_type);
-void AddExternVar(struct SymbolEntry **ctx, const char *key,
+void AddExternVar(struct SymbolTable *ctx, const char *key,
                   struct Node *var_type);
-void AddGlobalVar(struct SymbolEntry **ctx, const char *key,
+void AddGlobalVar(struct SymbolTable *ctx, const char *key,
                   struct Node *var_type);
-struct Node *FindExternVar(struct SymbolEntry *e, struct Node *key_token);
-struct Node *FindGlobalVar(struct SymbolEntry *e, struct Node *key_token);
-struct Node *FindLocalVar(struct SymbolEntry *e, struct Node *key_token);
-void AddFuncDef(struct SymbolEntry **ctx, const char *key,
+struct Node *FindExternVar(struct SymbolTable *ctx, struct Node *key_token);
+struct Node *FindGlobalVar(struct SymbolTable *ctx, struct Node *key_token);
+struct Node *FindLocalVar(struct SymbolTable *ctx, struct Node *key_token);
+void AddFuncDef(struct SymbolTable *ctx, const char *key,
                 struct Node *func_def);
-struct Node *FindFuncDef(struct SymbolEntry *e, struct Node *key_token);
-void AddFuncDeclType(struct SymbolEntry **ctx, const char *key,
+struct Node *FindFuncDef(struct SymbolTable *ctx, struct Node *key_token);
+void AddFuncDeclType(struct SymbolTable *ctx, const char *key,
                      struct Node *func_decl);
-struct Node *FindFuncDeclType(struct SymbolEntry *e, struct Node *key_token);
-void AddStructType(struct SymbolEntry **, const char *, struct Node *);
-struct Node *FindStructType(struct SymbolEntry *, struct Node *);
+struct Node *FindFuncDeclType(struct SymbolTable *ctx, struct Node *key_token);
+void AddStructType(struct SymbolTable *, const char *, struct Node *);
+struct Node *FindStructType(struct SymbolTable *, struct Node *);
 
 // @token.c
 bool IsToken(struct Node *n);
-struct Node *AllocToken(const char *src_str, int line, const char *begin,
-                        int length, enum TokenType type);
+struct Node *AllocToken(int line, const char *begin, int length,
+                        enum TokenType type);
 struct Node *DuplicateToken(struct Node *base_token);
 struct Node *DuplicateTokenSequence(struct Node *base_head);
 char *CreateTokenStr(struct Node *t);
@@ -280,13 +750,15 @@ void PrintTokenBrief(struct Node *t);
 void PrintTokenStrToFile(struct Node *t, FILE *fp);
 
 void InitTokenStream(struct Node **head_token);
+struct Node **GetTokenStreamPos(void);
 struct Node *PeekToken(void);
 struct Node *ReadToken(enum TokenType type);
 struct Node *ConsumeToken(enum TokenType type);
 struct Node *ConsumeTokenStr(const char *s);
 struct Node *ExpectTokenStr(const char *s);
-struct Node *ConsumePunctuator(const char *s);
-struct Node *ExpectPunctuator(const char *s);
+bool IsPunctuator(struct Node *t, enum PunctuatorID id);
+struct Node *ConsumePunctuator(enum PunctuatorID id);
+struct Node *ExpectPunctuator(enum PunctuatorID id);
 struct Node *NextToken(void);
 void RemoveCurrentToken(void);
 void RemoveTokensTo(struct Node *end);
@@ -295,9 +767,78 @@ void InsertTokensWithIdentReplace(struct Node *seq, struct Node *rep_list);
 struct Node **RemoveDelimiterTokens(struct Node **);
 
 // @tokenizer.c
-struct Node *CreateNextToken(const char *p, const char *src, int *line);
+struct Node *CreateNextToken(const char *p, int *line);
+const char *FindSourceBegin(const char *p);
+const char *GetPunctuatorStr(enum PunctuatorID id);
 struct Node *CreateToken(const char *input);
 struct Node *Tokenize(const char *input);
+void ReleaseSourceRanges(void);
+
+// @timer.c
+enum Phase {
+  kPhaseTokenize,
+  kPhasePreprocess,
+  kPhaseParse,
+  kPhaseOptimize,
+  kPhaseAnalyze,
+  kPhaseGenerate,
+  kPhaseAssemble,
+  kNumOfPhases,
+};
+struct PhaseStat {
+  double wall;  // in seconds
+  double cpu;   // of the thread, in seconds
+  long tokens;
+  long nodes;
+  bool is_done;
+};
+void BeginPhase(enum Phase phase);
+void EndPhase(enum Phase phase, struct Node *tokens);
+void PrintTimeReport(FILE *fp);
+
+// @trace.c
+enum TraceCategory {
+  kTracePreprocess,
+  kTraceParse,
+  kTraceOptimize,
+  kTraceAnalyze,
+  kTraceCodegen,
+  kNumOfTraceCategories,
+};
+unsigned int ParseTraceCategories(const char *list);
+#define IsTraceEnabled(category) \
+  (compiler->options.trace_categories & (1u << (category)))
+// Arguments are not evaluated unless the category is enabled.
+#define TRACE(category, ...)                                    \
+  do {                                                          \
+    if (IsTraceEnabled(category)) fprintf(stderr, __VA_ARGS__); \
+  } while (0)
+#define TRACE_AST(category, n)                     \
+  do {                                             \
+    if (IsTraceEnabled(category)) PrintASTNode(n); \
+  } while (0)
+
+// @traverse.c
+struct TraverseFrame {
+  struct Node *node;
+  int param;  // given by the parent (e.g. depth or rvalue-ness)
+  int step;   // where to resume; 0 on the first call
+  int i;      // number of elements visited by VisitNextElement
+  int scratch[4];  // labels and other state of the pass kept across steps
+  struct Node *child;  // set by VisitChild
+  int child_param;
+};
+struct TraverseStack {
+  struct TraverseFrame *frames;
+  int capacity;
+};
+bool VisitChild(struct TraverseFrame *f, int resume_step, struct Node *child,
+                int param);
+bool VisitNextElement(struct TraverseFrame *f, int resume_step,
+                      struct Node *list, int param);
+void Traverse(struct Node *root, int param,
+              bool (*step)(struct TraverseFrame *f, void *arg), void *arg);
+void ReleaseTraverseStack(void);
 
 // @type.c
 int IsSameTypeExceptAttr(struct Node *a, struct Node *b);
@@ -305,11 +846,76 @@ int IsLValueType(struct Node *t);
 struct Node *GetTypeWithoutAttr(struct Node *t);
 struct Node *GetIdentifierTokenFromTypeAttr(struct Node *t);
 struct Node *GetRValueType(struct Node *t);
+int EvalExprAsInt(struct Node *n);
 int GetSizeOfType(struct Node *t);
 int GetAlignOfType(struct Node *t);
-struct Node *CreateTypeInContext(struct SymbolEntry *ctx,
+struct Node *CreateTypeInContext(struct SymbolTable *ctx,
                                  struct Node *decl_spec, struct Node *decltor);
 struct Node *CreateType(struct Node *decl_spec, struct Node *decltor);
 struct Node *CreateTypeFromDecl(struct Node *decl);
-struct Node *CreateTypeFromDeclInContext(struct SymbolEntry *ctx,
+struct Node *CreateTypeFromDeclInContext(struct SymbolTable *ctx,
                                          struct Node *decl);
+
+// State of a compilation, which is bound to the thread running it as
+// `compiler` by the entry points in context.c.
+struct SourceRange;
+struct PCHMapping;
+struct CachedPCH;
+struct CompilerContext {
+  struct CompilerOptions options;
+  const char *symbol_prefix;
+  struct MacroTable *macros;  // defined by the options
+  const char *input_file_path;
+  const char *source;            // compiled instead of the input file
+  const char *output_file_path;  // NULL for stdout
+  bool is_output_returned;       // to the caller instead of being written
+  FILE *output_fp;
+  struct ObjBuffer output;  // captured output, or the object file
+  jmp_buf *error_jmp;       // Error() jumps here, or exits if NULL
+  bool keeps_caches;        // between compilations (compile server)
+  // analyzer.c
+  struct Node *in_function;  // ASTFuncDef
+  int reg_used_table[NUM_OF_SCRATCH_REGS + 1];  // indexed by reg (1-origin)
+  struct Node *reg_node_table[NUM_OF_SCRATCH_REGS + 1];
+  // arena.c
+  struct Arena arenas[kNumOfArenas];
+  enum ArenaKind current_arena;
+  // ast.c
+  int num_of_nodes;  // allocated by AllocNode()
+  // emitter.c
+  struct Emitter emitter;
+  // generator.c
+  struct Node *str_list;
+  int label_to_break;
+  int label_to_continue;
+  const char *func_name;  // labels are local to the function
+  int label_number;
+  // intern.c
+  struct InternTable intern_table;
+  // parser.c
+  struct Node *ord_idents;  // ordinary identifiers
+  // pch.c
+  struct PCHMapping *pch_mappings;
+  struct CachedPCH *cached_pchs;
+  // preprocessor.c
+  struct IncludeGuard **include_guards;
+  struct Node *predefined_macro_list;
+  struct MacroTable *predefined_macros;
+  unsigned long pch_flags_hash;
+  struct PrecompiledHeader *building_pch;  // NULL if not building
+  struct MacroTable *pch_seen_macros;  // names not to be added to uses
+  // stats.c
+  struct StatCounter stats[kNumOfStatCounters];
+  // timer.c
+  struct PhaseStat phase_stats[kNumOfPhases];
+  // token.c
+  struct Node **next_token_holder;
+  // tokenizer.c
+  struct SourceRange *source_ranges;
+  int num_of_source_ranges;
+  int source_ranges_capacity;
+  // traverse.c
+  struct TraverseStack traverse_stack;  // reused by the outermost traversal
+  bool is_traversing;
+};
+extern _Thread_local struct CompilerContext *compiler;
@@ -0,0 +1,302 @@
+#include "compilium.h"
+
+// Compilation contexts and the library interface (libcompilium.h).
+// All the state of a compilation is held in a CompilerContext, which is
+// created for each translation unit and bound to the thread compiling it
+// as `compiler`, so that compilations on different threads do not share
+// anything. Error() jumps back to RunCompilation() instead of exiting, and
+// the context releases everything the failed compilation has allocated.
+
+_Thread_local struct CompilerContext *compiler;
+
+struct CompilerContext *CreateCompilerContext(
+    const struct CompilerOptions *options) {
+  struct CompilerContext *c = calloc(1, sizeof(struct CompilerContext));
+  assert(c);
+  c->options = *options;
+  c->emitter.fd = 1;  // stdout
+  return c;
+}
+
+void DestroyCompilerContext(struct CompilerContext *c) {
+  struct CompilerContext *saved = compiler;
+  compiler = c;
+  if (c->output_fp) fclose(c->output_fp);
+  free(c->output.data);
+  ReleaseEmitter();
+  ReleasePCH();
+  ReleaseInternTable();
+  ReleaseSourceRanges();
+  ReleaseTraverseStack();
+  ReleaseAllArenas();
+  compiler = saved;
+  free(c);
+}
+
+void ResetCompilerContext(struct CompilerContext *c,
+                          const struct CompilerOptions *options) {
+  // Prepares c for the next compilation with options. The interned strings,
+  // the cached PCHs (and the files mapped for them) are kept, and so is the
+  // memory of the arenas, the emitter and the output to be reused.
+  struct CompilerContext *saved = compiler;
+  compiler = c;
+  if (c->output_fp) fclose(c->output_fp);
+  RecycleArenas();
+  struct CompilerContext kept = *c;
+  *c = (struct CompilerContext){0};
+  c->options = *options;
+  c->keeps_caches = kept.keeps_caches;
+  memcpy(c->arenas, kept.arenas, sizeof(c->arenas));
+  c->intern_table = kept.intern_table;
+  c->pch_mappings = kept.pch_mappings;
+  c->cached_pchs = kept.cached_pchs;
+  c->emitter.fd = 1;  // stdout
+  c->emitter.buf = kept.emitter.buf;
+  c->emitter.capacity = kept.emitter.capacity;
+  c->output.data = kept.output.data;
+  c->output.capacity = kept.output.capacity;
+  c->source_ranges = kept.source_ranges;
+  c->source_ranges_capacity = kept.source_ranges_capacity;
+  c->traverse_stack = kept.traverse_stack;
+  compiler = saved;
+}
+
+static void SetUpTarget(void) {
+  struct CompilerContext *c = compiler;
+  const char *os = c->options.target_os;
+  c->symbol_prefix = "_";
+  c->macros = AllocMacroTable();
+  if (!os) {
+    // Mach-O symbols without __APPLE__, for compatibility.
+  } else if (strcmp(os, "Darwin") == 0) {
+    DefineMacro(c->macros, "__APPLE__", CreateMacroReplacement(NULL, NULL));
+  } else if (strcmp(os, "Linux") == 0) {
+    c->symbol_prefix = "";
+  } else {
+    Error("Unknown os type %s", os);
+  }
+  if (c->options.is_object_output && !c->options.is_preprocess_only &&
+      c->symbol_prefix[0]) {
+    Error("-c supports only ELF objects (--target-os Linux)");
+  }
+}
+
+static bool IsOutputCaptured(void) {
+  const struct CompilerOptions *options = &compiler->options;
+  return compiler->is_output_returned ||
+         (options->is_object_output && !options->is_preprocess_only);
+}
+
+static void BeginOutput(void) {
+  // Directs the output to stdout, the file at output_file_path, or the
+  // memory if it is assembled to an object file or returned to the caller.
+  struct CompilerContext *c = compiler;
+  if (IsOutputCaptured()) {
+    CaptureEmitterOutput();
+  } else if (c->output_file_path) {
+    c->output_fp = fopen(c->output_file_path, "w");
+    if (!c->output_fp) Error("Failed to open %s", c->output_file_path);
+    SetEmitterOutput(fileno(c->output_fp));
+  }
+}
+
+static void WriteOutput(void) {
+  struct CompilerContext *c = compiler;
+  const char *path = c->output_file_path;
+  FILE *fp = path ? fopen(path, "wb") : stdout;
+  if (!fp) Error("Failed to open %s", path);
+  bool is_written =
+      fwrite(c->output.data, 1, c->output.size, fp) == (size_t)c->output.size;
+  is_written = (path ? fclose(fp) : fflush(fp)) == 0 && is_written;
+  if (!is_written) Error("Failed to write %s", path ? path : "the output");
+}
+
+static void EndOutput(void) {
+  struct CompilerContext *c = compiler;
+  if (!IsOutputCaptured()) {
+    FlushEmitter();
+    if (!c->output_fp) return;
+    int result = fclose(c->output_fp);
+    c->output_fp = NULL;
+    if (result) Error("Failed to write %s", c->output_file_path);
+    return;
+  }
+  int size;
+  const char *text = GetCapturedOutput(&size);
+  if (c->options.is_object_output && !c->options.is_preprocess_only) {
+    BeginPhase(kPhaseAssemble);
+    AssembleToObjectFile(text, size, &c->output);
+    EndPhase(kPhaseAssemble, NULL);
+  } else {
+    AppendToObjBuffer(&c->output, text, size + 1);
+    c->output.size = size;
+  }
+  if (!c->is_output_returned) WriteOutput();
+}
+
+static void Compile(void) {
+  struct CompilerContext *c = compiler;
+  SetUpTarget();
+  const char *input = c->source;
+  if (!input) input = ReadFileFromPath(c->input_file_path);
+  if (!input) Error("File not found: %s", c->input_file_path);
+
+  BeginPhase(kPhaseTokenize);
+  struct Node *tokens = Tokenize(input);
+  EndPhase(kPhaseTokenize, tokens);
+
+  if (c->options.include_path) {
+    TRACE(kTracePreprocess, "Include path: %s\n", c->options.include_path);
+  }
+  TRACE(kTracePreprocess, "Preprocess begin\n");
+  BeginPhase(kPhasePreprocess);
+  Preprocess(&tokens, c->macros);
+  EndPhase(kPhasePreprocess, tokens);
+  if (c->options.is_preprocess_only) {
+    BeginOutput();
+    OutputTokenSequenceAsCSource(tokens);
+    EndOutput();
+    return;
+  }
+
+  TRACE(kTraceParse, "Parse begin\n");
+  SetCurrentArena(kArenaParse);
+  BeginPhase(kPhaseParse);
+  struct Node *ast = Parse(&tokens);
+  EndPhase(kPhaseParse, NULL);
+  TRACE_AST(kTraceParse, ast);
+  TRACE(kTraceParse, "\n");
+
+  SetCurrentArena(kArenaAnalysis);
+  BeginPhase(kPhaseOptimize);
+  Optimize(ast);
+  EndPhase(kPhaseOptimize, NULL);
+
+  TRACE(kTraceAnalyze, "Analyze begin\n");
+  BeginPhase(kPhaseAnalyze);
+  struct SymbolTable *ctx = Analyze(ast);
+  EndPhase(kPhaseAnalyze, NULL);
+  TRACE_AST(kTraceAnalyze, ast);
+  TRACE(kTraceAnalyze, "\n");
+
+  SetCurrentArena(kArenaCodegen);
+  BeginOutput();
+  BeginPhase(kPhaseGenerate);
+  Generate(ast, ctx);
+  EndPhase(kPhaseGenerate, NULL);
+  EndOutput();
+}
+
+static bool RunCompilation(struct CompilerContext *c) {
+  // Returns false if an error is reported.
+  struct CompilerContext *saved = compiler;
+  compiler = c;
+  jmp_buf error_jmp;
+  if (setjmp(error_jmp)) {
+    c->error_jmp = NULL;
+    compiler = saved;
+    return false;
+  }
+  c->error_jmp = &error_jmp;
+  Compile();
+  c->error_jmp = NULL;
+  if (c->options.is_alloc_report_enabled) PrintAllocReport(stderr);
+  if (c->options.time_report) PrintTimeReport(stderr);
+  if (c->options.is_stats_enabled) PrintStats(stderr);
+  compiler = saved;
+  return true;
+}
+
+int CompileFile(const struct CompilerOptions *options, const char *input_path,
+                const char *output_path) {
+  struct CompilerContext *c = CreateCompilerContext(options);
+  c->input_file_path = input_path;
+  c->output_file_path = output_path;
+  bool is_compiled = RunCompilation(c);
+  DestroyCompilerContext(c);
+  return is_compiled ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool CompileInContext(struct CompilerContext *c, const char *source) {
+  // Compiles source into c->output. Returns false if an error is reported.
+  c->source = source;
+  c->is_output_returned = true;
+  return RunCompilation(c);
+}
+
+char *CompileSource(const struct CompilerOptions *options, const char *source,
+                    int *size) {
+  struct CompilerContext *c = CreateCompilerContext(options);
+  char *output = NULL;
+  if (CompileInContext(c, source)) {
+    output = c->output.data;
+    *size = c->output.size;
+    c->output = (struct ObjBuffer){0};
+  }
+  DestroyCompilerContext(c);
+  return output;
+}
+
+#define NUM_OF_TEST_THREADS 4
+
+static const struct CompilerOptions test_options = {.target_os = "Linux"};
+
+static const char *test_sources[NUM_OF_TEST_THREADS] = {
+    "int f(int a) { return a * 3 + 1; }\nint main() { return f(2); }\n",
+    "int main() { char *s; s = \"str\"; return s[1]; }\n",
+    "int main() { int v; v = 0; while (v < 10) v++; return v; }\n",
+    "int main() { return ; ",  // error
+};
+
+struct TestCompilation {
+  const char *source;
+  int num_of_runs;
+  char *output;
+  int size;
+};
+
+static void *RunTestCompilations(void *arg) {
+  struct TestCompilation *t = arg;
+  for (int i = 0; i < t->num_of_runs; i++) {
+    int size;
+    char *output = CompileSource(&test_options, t->source, &size);
+    if (!output || !t->output || size != t->size ||
+        memcmp(output, t->output, size) != 0) {
+      free(t->output);
+      t->output = NULL;
+    }
+    free(output);
+  }
+  return NULL;
+}
+
+void TestLibrary() {
+  fprintf(stderr, "Testing Library...");
+
+  // Outputs of compilations on threads should be the same as the ones
+  // compiled one by one, and errors should not stop other compilations.
+  struct TestCompilation tests[NUM_OF_TEST_THREADS];
+  pthread_t threads[NUM_OF_TEST_THREADS];
+  for (int i = 0; i < NUM_OF_TEST_THREADS; i++) {
+    tests[i].source = test_sources[i];
+    tests[i].output =
+        CompileSource(&test_options, tests[i].source, &tests[i].size);
+    assert(i == NUM_OF_TEST_THREADS - 1 ? !tests[i].output : !!tests[i].output);
+    // The last one fails, which is reported to stderr on each run.
+    tests[i].num_of_runs = tests[i].output ? 20 : 1;
+  }
+  assert(tests[0].size > 0 && !tests[0].output[tests[0].size]);
+  for (int i = 0; i < NUM_OF_TEST_THREADS - 1; i++) {
+    assert(pthread_create(&threads[i], NULL, RunTestCompilations, &tests[i]) ==
+           0);
+  }
+  RunTestCompilations(&tests[NUM_OF_TEST_THREADS - 1]);
+  for (int i = 0; i < NUM_OF_TEST_THREADS - 1; i++) {
+    assert(pthread_join(threads[i], NULL) == 0);
+    assert(tests[i].output);
+    free(tests[i].output);
+  }
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,144 @@
+#include "compilium.h"
+
+// Driver which compiles many translation units at once (-j N).
+// Each compilation has a context of its own (see context.c), so the files
+// are compiled by N workers on threads of this process: the calling thread
+// and N - 1 threads started here. A worker takes the next file which is
+// not compiled yet until all of them are taken, without any lock.
+
+#define WORKER_STACK_SIZE (8 * 1024 * 1024)
+
+static char *CreateOutputPath(const char *input_path, const char *output_dir,
+                              const char *suffix) {
+  // Returns <output_dir><basename of input_path without extension><suffix>,
+  // or the same path as input_path with the suffix if output_dir is NULL.
+  // The result should be freed by the caller.
+  const char *base = strrchr(input_path, '/');
+  base = base ? base + 1 : input_path;
+  const char *ext = strrchr(base, '.');
+  int base_len = ext ? ext - base : (int)strlen(base);
+  const char *dir = output_dir ? output_dir : input_path;
+  int dir_len = output_dir ? (int)strlen(output_dir) : base - input_path;
+  char *path = malloc(dir_len + base_len + strlen(suffix) + 1);
+  assert(path);
+  memcpy(path, dir, dir_len);
+  memcpy(path + dir_len, base, base_len);
+  strcpy(path + dir_len + base_len, suffix);
+  return path;
+}
+
+static char *CanonicalizePath(const char *path) {
+  // Returns path with its directory resolved by realpath, to compare paths of
+  // files which may not exist yet. The result should be freed by the caller.
+  const char *base = strrchr(path, '/');
+  char *dir = base ? strndup(path, base - path + 1) : strdup(".");
+  assert(dir);
+  base = base ? base + 1 : path;
+  char *resolved_dir = realpath(dir, NULL);
+  free(dir);
+  if (!resolved_dir) return strdup(path);
+  char *resolved = malloc(strlen(resolved_dir) + 1 + strlen(base) + 1);
+  assert(resolved);
+  strcpy(resolved, resolved_dir);
+  strcat(resolved, "/");
+  strcat(resolved, base);
+  free(resolved_dir);
+  return resolved;
+}
+
+static void CheckOutputPaths(const char **input_paths, char **output_paths,
+                             int num_of_files) {
+  // Exits with an error if two outputs or an output and an input are the same
+  // file, before any of them is written by the workers.
+  char **inputs = malloc(sizeof(char *) * num_of_files);
+  char **outputs = malloc(sizeof(char *) * num_of_files);
+  assert(inputs && outputs);
+  for (int i = 0; i < num_of_files; i++) {
+    inputs[i] = CanonicalizePath(input_paths[i]);
+    outputs[i] = CanonicalizePath(output_paths[i]);
+  }
+  for (int i = 0; i < num_of_files; i++) {
+    for (int k = 0; k < num_of_files; k++) {
+      if (strcmp(outputs[i], inputs[k]) == 0) {
+        Error("Output of %s overwrites the input file %s", input_paths[i],
+              input_paths[k]);
+      }
+      if (k < i && strcmp(outputs[i], outputs[k]) == 0) {
+        Error("Outputs of %s and %s are the same file %s", input_paths[k],
+              input_paths[i], output_paths[i]);
+      }
+    }
+  }
+  for (int i = 0; i < num_of_files; i++) {
+    free(inputs[i]);
+    free(outputs[i]);
+  }
+  free(inputs);
+  free(outputs);
+}
+
+int GetNumOfOnlineCPUs(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
+
+struct CompileJobs {
+  const struct CompilerOptions *options;
+  const char **input_paths;
+  char **output_paths;
+  int num_of_files;
+  int next;  // index of the file to be compiled next
+  int num_of_failed;
+};
+
+static void *RunWorker(void *arg) {
+  struct CompileJobs *jobs = arg;
+  for (;;) {
+    int i = __sync_fetch_and_add(&jobs->next, 1);
+    if (i >= jobs->num_of_files) break;
+    const char *input_path = jobs->input_paths[i];
+    if (CompileFile(jobs->options, input_path, jobs->output_paths[i]) !=
+        EXIT_SUCCESS) {
+      fprintf(stderr, "Failed to compile %s\n", input_path);
+      __sync_fetch_and_add(&jobs->num_of_failed, 1);
+    }
+  }
+  return NULL;
+}
+
+int CompileFilesInParallel(const struct CompilerOptions *options,
+                           const char **input_paths, int num_of_files,
+                           const char *output_dir, const char *suffix,
+                           int num_of_jobs) {
+  // Returns EXIT_SUCCESS if all files are compiled.
+  char **output_paths = malloc(sizeof(char *) * num_of_files);
+  assert(output_paths);
+  for (int i = 0; i < num_of_files; i++) {
+    output_paths[i] = CreateOutputPath(input_paths[i], output_dir, suffix);
+  }
+  CheckOutputPaths(input_paths, output_paths, num_of_files);
+  struct CompileJobs jobs = {
+      .options = options,
+      .input_paths = input_paths,
+      .output_paths = output_paths,
+      .num_of_files = num_of_files,
+  };
+  if (num_of_jobs > num_of_files) num_of_jobs = num_of_files;
+  pthread_t *threads = malloc(sizeof(pthread_t) * num_of_jobs);
+  assert(threads);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  // The parser recurses as deep as on the main thread.
+  pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+  for (int i = 1; i < num_of_jobs; i++) {
+    if (pthread_create(&threads[i], &attr, RunWorker, &jobs)) {
+      Error("Failed to start a worker");
+    }
+  }
+  RunWorker(&jobs);
+  for (int i = 1; i < num_of_jobs; i++) pthread_join(threads[i], NULL);
+  free(threads);
+  for (int i = 0; i < num_of_files; i++) free(output_paths[i]);
+  free(output_paths);
+  return jobs.num_of_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+#include "compilium.h"
+
+// Writer of ELF64 relocatable objects for x86-64 (-c).
+// The assembler fills an ELFObject with the contents of .text and .data,
+// the symbols and the relocations of .text. The file consists of:
+//
+//   ELF header
+//   contents of .text, .data, .rela.text, .symtab, .strtab and .shstrtab
+//   section headers (see enum ELFSectionHeaderIndex)
+//
+// The symbol table begins with the null symbol and the section symbols of
+// .text and .data, followed by the local symbols and then the global ones,
+// as ELF requires.
+
+#define ELF_ALIGN 8
+
+#define EM_X86_64 62
+#define ET_REL 1
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_SECTION 3
+
+enum ELFSectionHeaderIndex {
+  kELFShNull,
+  kELFShText,  // == kELFSectionText
+  kELFShData,  // == kELFSectionData
+  kELFShRelaText,
+  kELFShSymtab,
+  kELFShStrtab,
+  kELFShShstrtab,
+  kELFShNoteGNUStack,
+  kNumOfELFSectionHeaders,
+};
+
+struct ELFFileHeader {
+  unsigned char ident[16];
+  unsigned short type;
+  unsigned short machine;
+  unsigned int version;
+  unsigned long entry;
+  unsigned long phoff;
+  unsigned long shoff;
+  unsigned int flags;
+  unsigned short ehsize;
+  unsigned short phentsize;
+  unsigned short phnum;
+  unsigned short shentsize;
+  unsigned short shnum;
+  unsigned short shstrndx;
+};
+
+struct ELFSectionHeader {
+  unsigned int name;  // offset in .shstrtab
+  unsigned int type;
+  unsigned long flags;
+  unsigned long addr;
+  unsigned long offset;
+  unsigned long size;
+  unsigned int link;
+  unsigned int info;
+  unsigned long addralign;
+  unsigned long entsize;
+};
+
+struct ELFFileSymbol {
+  unsigned int name;  // offset in .strtab
+  unsigned char info;
+  unsigned char other;
+  unsigned short shndx;
+  unsigned long value;
+  unsigned long size;
+};
+
+struct ELFFileRela {
+  unsigned long offset;
+  unsigned long info;
+  long addend;
+};
+
+int AppendToObjBuffer(struct ObjBuffer *b, const void *p, int size) {
+  // Returns the offset of the appended data in b. If p is NULL, size bytes
+  // are reserved to be filled by the caller.
+  if (b->size + size > b->capacity) {
+    while (b->size + size > b->capacity) b->capacity = (b->capacity + 1) * 2;
+    b->data = realloc(b->data, b->capacity);
+    assert(b->data);
+  }
+  int ofs = b->size;
+  if (p && size) memcpy(b->data + ofs, p, size);
+  b->size += size;
+  return ofs;
+}
+
+void ReleaseELFObject(struct ELFObject *obj) {
+  free(obj->text.data);
+  free(obj->data.data);
+  free(obj->symbols.data);
+  free(obj->relocations.data);
+  *obj = (struct ELFObject){0};
+}
+
+static void AlignObjBuffer(struct ObjBuffer *b, int align) {
+  static const char zeros[16];
+  AppendToObjBuffer(b, zeros, (align - b->size % align) % align);
+}
+
+static void AppendSection(struct ObjBuffer *file, struct ELFSectionHeader *sh,
+                          struct ObjBuffer *b, int align) {
+  AlignObjBuffer(file, align);
+  sh->offset = AppendToObjBuffer(file, b->data, b->size);
+  sh->size = b->size;
+  sh->addralign = align;
+}
+
+static void AppendSymbols(struct ObjBuffer *symtab, struct ObjBuffer *strtab,
+                          int *symtab_index_of, struct ELFObject *obj,
+                          bool is_global) {
+  struct ELFSymbol *symbols = (struct ELFSymbol *)obj->symbols.data;
+  int num_of_symbols = obj->symbols.size / sizeof(struct ELFSymbol);
+  for (int i = 0; i < num_of_symbols; i++) {
+    struct ELFSymbol *s = &symbols[i];
+    if (s->is_global != is_global) continue;
+    struct ELFFileSymbol fs = {0};
+    fs.name = AppendToObjBuffer(strtab, s->name, strlen(s->name) + 1);
+    fs.info = (is_global ? STB_GLOBAL : STB_LOCAL) << 4 | STT_NOTYPE;
+    fs.shndx = s->section;
+    fs.value = s->offset;
+    symtab_index_of[i] = symtab->size / sizeof(fs);
+    AppendToObjBuffer(symtab, &fs, sizeof(fs));
+  }
+}
+
+void WriteELFObject(struct ELFObject *obj, struct ObjBuffer *file) {
+  // Writes the contents of the object file to file, which should be empty.
+  assert(file->size == 0);
+  int num_of_symbols = obj->symbols.size / sizeof(struct ELFSymbol);
+  int *symtab_index_of = malloc(sizeof(int) * (num_of_symbols + 1));
+  assert(symtab_index_of);
+  struct ObjBuffer symtab = {0}, strtab = {0}, rela = {0}, shstrtab = {0};
+  AppendToObjBuffer(&strtab, "", 1);
+  struct ELFFileSymbol fs = {0};
+  AppendToObjBuffer(&symtab, &fs, sizeof(fs));
+  fs.info = STB_LOCAL << 4 | STT_SECTION;
+  fs.shndx = kELFSectionText;
+  AppendToObjBuffer(&symtab, &fs, sizeof(fs));
+  fs.shndx = kELFSectionData;
+  AppendToObjBuffer(&symtab, &fs, sizeof(fs));
+  AppendSymbols(&symtab, &strtab, symtab_index_of, obj, false);
+  int first_global = symtab.size / sizeof(fs);
+  AppendSymbols(&symtab, &strtab, symtab_index_of, obj, true);
+
+  struct ELFRelocation *relocations =
+      (struct ELFRelocation *)obj->relocations.data;
+  int num_of_relocations = obj->relocations.size / sizeof(*relocations);
+  for (int i = 0; i < num_of_relocations; i++) {
+    struct ELFRelocation *r = &relocations[i];
+    // Section symbols are at the index of the section.
+    unsigned long sym =
+        r->symbol >= 0 ? symtab_index_of[r->symbol] : (int)r->section;
+    struct ELFFileRela fr = {r->offset, sym << 32 | r->type, r->addend};
+    AppendToObjBuffer(&rela, &fr, sizeof(fr));
+  }
+  free(symtab_index_of);
+
+  static const char *section_names[kNumOfELFSectionHeaders] = {
+      [kELFShNull] = "",           [kELFShText] = ".text",
+      [kELFShData] = ".data",      [kELFShRelaText] = ".rela.text",
+      [kELFShSymtab] = ".symtab",  [kELFShStrtab] = ".strtab",
+      [kELFShShstrtab] = ".shstrtab",
+      [kELFShNoteGNUStack] = ".note.GNU-stack",
+  };
+  struct ELFSectionHeader sh[kNumOfELFSectionHeaders] = {{0}};
+  for (int i = 0; i < kNumOfELFSectionHeaders; i++) {
+    sh[i].name = AppendToObjBuffer(&shstrtab, section_names[i],
+                                   strlen(section_names[i]) + 1);
+  }
+  sh[kELFShText].type = SHT_PROGBITS;
+  sh[kELFShText].flags = SHF_ALLOC | SHF_EXECINSTR;
+  sh[kELFShData].type = SHT_PROGBITS;
+  sh[kELFShData].flags = SHF_WRITE | SHF_ALLOC;
+  sh[kELFShRelaText].type = SHT_RELA;
+  sh[kELFShRelaText].flags = SHF_INFO_LINK;
+  sh[kELFShRelaText].link = kELFShSymtab;
+  sh[kELFShRelaText].info = kELFShText;
+  sh[kELFShRelaText].entsize = sizeof(struct ELFFileRela);
+  sh[kELFShSymtab].type = SHT_SYMTAB;
+  sh[kELFShSymtab].link = kELFShStrtab;
+  sh[kELFShSymtab].info = first_global;
+  sh[kELFShSymtab].entsize = sizeof(struct ELFFileSymbol);
+  sh[kELFShStrtab].type = SHT_STRTAB;
+  sh[kELFShShstrtab].type = SHT_STRTAB;
+  // Marks the stack as non-executable.
+  sh[kELFShNoteGNUStack].type = SHT_PROGBITS;
+  sh[kELFShNoteGNUStack].addralign = 1;
+
+  struct ELFFileHeader header = {0};
+  memcpy(header.ident, "\177ELF", 4);
+  header.ident[4] = 2;  // ELFCLASS64
+  header.ident[5] = 1;  // ELFDATA2LSB
+  header.ident[6] = 1;  // EV_CURRENT
+  header.type = ET_REL;
+  header.machine = EM_X86_64;
+  header.version = 1;
+  header.ehsize = sizeof(header);
+  header.shentsize = sizeof(struct ELFSectionHeader);
+  header.shnum = kNumOfELFSectionHeaders;
+  header.shstrndx = kELFShShstrtab;
+
+  AppendToObjBuffer(file, &header, sizeof(header));
+  AppendSection(file, &sh[kELFShText], &obj->text, 16);
+  AppendSection(file, &sh[kELFShData], &obj->data, 1);
+  AppendSection(file, &sh[kELFShRelaText], &rela, ELF_ALIGN);
+  AppendSection(file, &sh[kELFShSymtab], &symtab, ELF_ALIGN);
+  AppendSection(file, &sh[kELFShStrtab], &strtab, 1);
+  AppendSection(file, &sh[kELFShShstrtab], &shstrtab, 1);
+  sh[kELFShNoteGNUStack].offset = file->size;
+  AlignObjBuffer(file, ELF_ALIGN);
+  header.shoff = AppendToObjBuffer(file, sh, sizeof(sh));
+  memcpy(file->data, &header, sizeof(header));
+  free(rela.data);
+  free(symtab.data);
+  free(strtab.data);
+  free(shstrtab.data);
+}
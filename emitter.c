@@ -0,0 +1,145 @@
+#include "compilium.h"
+
+// Buffered writer of the output (assembly, or C source with -E).
+// Text is appended to a large buffer and written to the fd with write(2)
+// only when the buffer is full and by FlushEmitter(), instead of going
+// through stdio for every instruction. Nothing else writes to the output
+// fd, so diagnostics cannot be mixed into the assembly.
+// With -c, the output is captured instead: the buffer grows to hold all of
+// it, and the assembler reads it from memory.
+
+#define EMITTER_BUFFER_SIZE (1024 * 1024)
+
+static void WriteAll(int fd, const char *p, size_t size) {
+  while (size) {
+    long written = write(fd, p, size);
+    if (written <= 0) Error("Failed to write the output");
+    p += written;
+    size -= written;
+  }
+}
+
+void SetEmitterOutput(int fd) {
+  struct Emitter *e = &compiler->emitter;
+  FlushEmitter();
+  e->fd = fd;
+}
+
+void CaptureEmitterOutput(void) {
+  struct Emitter *e = &compiler->emitter;
+  FlushEmitter();
+  e->fd = -1;
+}
+
+const char *GetCapturedOutput(int *size) {
+  // The text is terminated by a NUL, which is not counted in size.
+  struct Emitter *e = &compiler->emitter;
+  assert(e->fd == -1);
+  EmitStrN("", 1);
+  *size = --e->used;
+  return e->buf;
+}
+
+void FlushEmitter(void) {
+  struct Emitter *e = &compiler->emitter;
+  if (e->fd == -1) return;
+  WriteAll(e->fd, e->buf, e->used);
+  e->used = 0;
+}
+
+int BeginEmitterRecording(void) {
+  // Keeps the text emitted from now on in the buffer, so that it can be
+  // read by EndEmitterRecording(). Returns the offset to be passed to it.
+  struct Emitter *e = &compiler->emitter;
+  FlushEmitter();
+  e->recording_fd = e->fd;
+  e->fd = -1;
+  return e->used;
+}
+
+const char *EndEmitterRecording(int begin, int *size) {
+  // Returns the text emitted since BeginEmitterRecording() returned begin,
+  // which is valid until the next Emit.
+  struct Emitter *e = &compiler->emitter;
+  e->fd = e->recording_fd;
+  *size = e->used - begin;
+  return e->buf + begin;
+}
+
+void ReleaseEmitter(void) {
+  struct Emitter *e = &compiler->emitter;
+  free(e->buf);
+  *e = (struct Emitter){.fd = 1};  // stdout
+}
+
+static void GrowEmitterBuffer(int size) {
+  struct Emitter *e = &compiler->emitter;
+  int capacity = e->capacity ? e->capacity : EMITTER_BUFFER_SIZE;
+  while (capacity < size) capacity *= 2;
+  assert((e->buf = realloc(e->buf, capacity)));
+  e->capacity = capacity;
+}
+
+void EmitStrN(const char *s, int len) {
+  struct Emitter *e = &compiler->emitter;
+  if (e->used + len > e->capacity) {
+    if (e->fd == -1 || !e->buf) {
+      GrowEmitterBuffer(e->used + len);
+    } else {
+      FlushEmitter();
+      if (len > e->capacity) {
+        WriteAll(e->fd, s, len);
+        return;
+      }
+    }
+  }
+  memcpy(e->buf + e->used, s, len);
+  e->used += len;
+}
+
+static void EmitLong(long v) {
+  char s[24];
+  int i = sizeof(s);
+  unsigned long u = v < 0 ? -(unsigned long)v : (unsigned long)v;
+  do {
+    s[--i] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (v < 0) s[--i] = '-';
+  EmitStrN(s + i, sizeof(s) - i);
+}
+
+void Emit(const char *fmt, ...) {
+  // Appends fmt formatted like printf. Only %s, %.*s, %d, %ld and %% are
+  // supported, which is all the generator needs for register names,
+  // labels and immediates.
+  va_list ap;
+  va_start(ap, fmt);
+  const char *p = fmt;
+  for (;;) {
+    const char *q = p;
+    while (*q && *q != '%') q++;
+    EmitStrN(p, q - p);
+    if (!*q) break;
+    q++;
+    if (q[0] == 's') {
+      const char *s = va_arg(ap, const char *);
+      EmitStrN(s, strlen(s));
+    } else if (q[0] == '.' && q[1] == '*' && q[2] == 's') {
+      int len = va_arg(ap, int);
+      EmitStrN(va_arg(ap, const char *), len);
+      q += 2;
+    } else if (q[0] == 'd') {
+      EmitLong(va_arg(ap, int));
+    } else if (q[0] == 'l' && q[1] == 'd') {
+      EmitLong(va_arg(ap, long));
+      q++;
+    } else if (q[0] == '%') {
+      EmitStrN("%", 1);
+    } else {
+      Error("Emit: Unsupported format: %s", fmt);
+    }
+    p = q + 1;
+  }
+  va_end(ap);
+}
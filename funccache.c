@@ -0,0 +1,204 @@
+#include "compilium.h"
+
+// Function cache (--func-cache-dir).
+// The code of each function is stored to a file named after the function
+// and a hash of everything the generator reads to emit it: the analyzed AST
+// of the function, the types of the declarations it refers to (as the types
+// of the expressions) and the target. Since labels are local to a function
+// and its string literals are emitted with it, the code is independent of
+// the rest of the translation unit, and an unchanged function is emitted
+// from the file without being generated again.
+
+#define FUNC_CACHE_VERSION 1
+
+static unsigned long HashInt(unsigned long h, long v) {
+  return CalcHash(h, (const char *)&v, sizeof(v));
+}
+
+static unsigned long HashToken(unsigned long h, struct Node *t) {
+  if (!t) return HashInt(h, -1);
+  h = HashInt(h, t->token_type);
+  return CalcHash(h, t->begin, t->length);
+}
+
+static unsigned long HashType(unsigned long h, struct Node *t) {
+  // Structs are hashed by their tags and sizes, since the offsets of their
+  // members are resolved in the AST. This also stops at recursive types.
+  h = HashInt(h, t ? t->type : kNodeNone);
+  if (!t) return h;
+  switch (t->type) {
+    case kTypeBase:
+      return HashInt(h, t->op->token_type);
+    case kTypeLValue:
+    case kTypePointer:
+    case kTypeAttrIdent:
+      return HashType(h, t->right);
+    case kTypeFunction:
+      h = HashType(h, t->left);
+      if (!t->right) return h;
+      for (int i = 0; i < GetSizeOfList(t->right); i++) {
+        h = HashType(h, GetNodeAt(t->right, i));
+      }
+      return h;
+    case kTypeStruct:
+      h = HashToken(h, t->tag);
+      return HashInt(h,
+                     t->type_struct_spec ? CalcStructSize(t->type_struct_spec)
+                                         : -1);
+    case kTypeArray:
+      h = HashType(h, t->type_array_type_of);
+      return HashInt(h, t->type_array_index_decl
+                            ? EvalExprAsInt(t->type_array_index_decl)
+                            : -1);
+    default:
+      return h;
+  }
+}
+
+static int GetChildrenToHash(struct Node *n, struct Node **children) {
+  // Stores the children of n except the elements of lists, and returns the
+  // number of them. Only the payload of the type of n is read, since the
+  // node is allocated without the others.
+  int num = 0;
+  children[num++] = n->op;
+  children[num++] = n->left;
+  children[num++] = n->right;
+  children[num++] = n->cond;
+  switch (n->type) {
+    case kASTForStmt:
+      children[num++] = n->init;
+      children[num++] = n->updt;
+      children[num++] = n->body;
+      break;
+    case kASTWhileStmt:
+      children[num++] = n->body;
+      break;
+    case kASTSelectionStmt:
+      children[num++] = n->if_true_stmt;
+      children[num++] = n->if_else_stmt;
+      break;
+    case kASTDecltor:
+      children[num++] = n->decltor_init_expr;
+      break;
+    case kASTKeyValue:
+    case kASTDirectDecltor:
+      children[num++] = n->value;
+      break;
+    case kASTExprFuncCall:
+      children[num++] = n->value;
+      children[num++] = n->func_expr;
+      children[num++] = n->arg_expr_list;
+      break;
+    case kASTFuncDef:
+      children[num++] = n->func_body;
+      children[num++] = n->func_type;
+      children[num++] = n->func_name_token;
+      children[num++] = n->arg_var_list;
+      break;
+    case kNodeStructMember:
+      children[num++] = n->struct_member_decl;
+      children[num++] = n->struct_member_ent_type;
+      break;
+    case kASTStructSpec:
+      children[num++] = n->tag;
+      children[num++] = n->struct_member_dict;
+      break;
+    default:
+      break;
+  }
+  return num;
+}
+
+#define MAX_CHILDREN_TO_HASH 8
+
+static bool HashStep(struct TraverseFrame *f, void *arg) {
+  unsigned long *h = arg;
+  struct Node *n = f->node;
+  if (n->type == kNodeToken) {
+    *h = HashToken(*h, n);
+    return false;
+  }
+  if (n->type >= kTypeBase) {
+    *h = HashType(*h, n);
+    return false;
+  }
+  if (!f->step) {
+    *h = HashInt(*h, n->type);
+    *h = HashInt(*h, n->reg);
+    *h = HashType(*h, n->expr_type);
+    if (n->type == kASTExpr || n->type == kASTLocalVar) {
+      *h = HashInt(*h, n->byte_offset);
+    } else if (n->type == kASTExprFuncCall) {
+      *h = HashInt(*h, n->stack_size_needed);
+    } else if (n->type == kNodeStructMember) {
+      *h = HashInt(*h, n->struct_member_ent_ofs);
+    } else if (n->type == kASTKeyValue) {
+      *h = CalcHash(*h, n->key, n->key ? strlen(n->key) + 1 : 0);
+    }
+    f->step = 1;
+  }
+  struct Node *children[MAX_CHILDREN_TO_HASH];
+  int num_of_children = GetChildrenToHash(n, children);
+  // f->i counts the children, and then the elements of a list.
+  while (f->step == 1 && f->i < num_of_children) {
+    struct Node *child = children[f->i++];
+    if (child) return VisitChild(f, 1, child, 0);
+    *h = HashInt(*h, kNodeNone);
+  }
+  if (n->type != kASTList) return false;
+  if (f->step == 1) {
+    f->step = 2;
+    f->i = 0;
+    *h = HashInt(*h, GetSizeOfList(n));
+  }
+  while (f->i < GetSizeOfList(n)) {
+    struct Node *e = GetNodeAt(n, f->i++);
+    if (e) return VisitChild(f, 2, e, 0);
+    *h = HashInt(*h, kNodeNone);
+  }
+  return false;
+}
+
+unsigned long CalcFuncDefHash(struct Node *func_def) {
+  assert(func_def->type == kASTFuncDef);
+  unsigned long h = HashInt(FNV_OFFSET_BASIS, FUNC_CACHE_VERSION);
+  const char *prefix = compiler->symbol_prefix;
+  h = CalcHash(h, prefix, strlen(prefix) + 1);
+  Traverse(func_def, 0, HashStep, &h);
+  return h;
+}
+
+static const char *CreateFuncCachePath(struct Node *func_def,
+                                       unsigned long hash) {
+  const char *dir = compiler->options.func_cache_dir;
+  const char *name = func_def->func_name_token->atom;
+  assert(dir);
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "-%016lx.s", hash);
+  char *path = ArenaAlloc(strlen(dir) + strlen(name) + strlen(suffix) + 1);
+  strcpy(path, dir);
+  strcat(path, name);
+  strcat(path, suffix);
+  return path;
+}
+
+const char *LoadCachedFunc(struct Node *func_def, unsigned long hash) {
+  // Returns the code stored for func_def with hash, or NULL if there is not.
+  return ReadFileFromPath(CreateFuncCachePath(func_def, hash));
+}
+
+void StoreCachedFunc(struct Node *func_def, unsigned long hash,
+                     const char *code, int size) {
+  // Failures are ignored, since the code is only cached.
+  const char *path = CreateFuncCachePath(func_def, hash);
+  // Written like PCHs (see WritePCH) not to be read partially.
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%lx.tmp", path, getpid(),
+           (unsigned long)compiler);
+  FILE *fp = fopen(tmp_path, "wb");
+  if (!fp) return;
+  bool is_written = fwrite(code, 1, size, fp) == (size_t)size;
+  is_written = fclose(fp) == 0 && is_written;
+  is_written = is_written && rename(tmp_path, path) == 0;
+  if (!is_written) remove(tmp_path);
+}
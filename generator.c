@@ -1,41 +1,41 @@
 #include "compilium.h"
 
-static void GenerateForNodeRValue(struct Node *node);
-
-static struct Node *str_list;
-static int label_to_break;
-static int label_to_continue;
+// Param of TraverseFrame in the generator
+enum GenerateMode {
+  kGenerateAsIs,    // leaves the address in the reg if the node is an lvalue
+  kGenerateRValue,  // loads the value of the node to the reg
+};
 
 static int GetLabelNumber() {
-  static int label_number;
-  return ++label_number;
+  // Labels are numbered in each function and named L<function>.<number>,
+  // so that the code of a function does not depend on the others.
+  return ++compiler->label_number;
 }
 
 static void EmitConvertToBool(int dst, int src) {
   // This code also sets zero flag as boolean value
-  printf("cmp %s, 0\n", reg_names_64[src]);
-  printf("setnz %s\n", reg_names_8[src]);
-  printf("movzx %s, %s\n", reg_names_64[dst], reg_names_8[src]);
+  Emit("cmp %s, 0\n", reg_names_64[src]);
+  Emit("setnz %s\n", reg_names_8[src]);
+  Emit("movzx %s, %s\n", reg_names_64[dst], reg_names_8[src]);
 }
 
 static void EmitCompareIntegers(int dst, int left, int right, const char *cc) {
-  printf("cmp %s, %s\n", reg_names_64[left], reg_names_64[right]);
-  printf("set%s %s\n", cc, reg_names_8[dst]);
-  printf("movzx %s, %s\n", reg_names_64[dst], reg_names_8[dst]);
+  Emit("cmp %s, %s\n", reg_names_64[left], reg_names_64[right]);
+  Emit("set%s %s\n", cc, reg_names_8[dst]);
+  Emit("movzx %s, %s\n", reg_names_64[dst], reg_names_8[dst]);
 }
 
 static void EmitMoveToMemory(struct Node *op, int dst, int src, int size) {
   if (size == 8) {
-    printf("mov [%s], %s\n", reg_names_64[dst], reg_names_64[src]);
+    Emit("mov [%s], %s\n", reg_names_64[dst], reg_names_64[src]);
     return;
   }
   if (size == 4) {
-    printf("mov [%s], %s # 4 byte store\n", reg_names_64[dst],
-           reg_names_32[src]);
+    Emit("mov [%s], %s # 4 byte store\n", reg_names_64[dst], reg_names_32[src]);
     return;
   }
   if (size == 1) {
-    printf("mov [%s], %s\n", reg_names_64[dst], reg_names_8[src]);
+    Emit("mov [%s], %s\n", reg_names_64[dst], reg_names_8[src]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -43,15 +43,15 @@ static void EmitMoveToMemory(struct Node *op, int dst, int src, int size) {
 
 static void EmitMoveFromMemory(struct Node *op, int dst, int src, int size) {
   if (size == 8) {
-    printf("mov %s, [%s]\n", reg_names_64[dst], reg_names_64[src]);
+    Emit("mov %s, [%s]\n", reg_names_64[dst], reg_names_64[src]);
     return;
   }
   if (size == 4) {
-    printf("movsxd %s, dword ptr [%s]\n", reg_names_64[dst], reg_names_64[src]);
+    Emit("movsxd %s, dword ptr [%s]\n", reg_names_64[dst], reg_names_64[src]);
     return;
   }
   if (size == 1) {
-    printf("movsxb %s, byte ptr [%s]\n", reg_names_64[dst], reg_names_64[src]);
+    Emit("movsxb %s, byte ptr [%s]\n", reg_names_64[dst], reg_names_64[src]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -59,15 +59,15 @@ static void EmitMoveFromMemory(struct Node *op, int dst, int src, int size) {
 
 static void EmitAddToMemory(struct Node *op, int dst, int src, int size) {
   if (size == 8) {
-    printf("add qword ptr [%s], %s\n", reg_names_64[dst], reg_names_64[src]);
+    Emit("add qword ptr [%s], %s\n", reg_names_64[dst], reg_names_64[src]);
     return;
   }
   if (size == 4) {
-    printf("add dword ptr [%s], %s\n", reg_names_64[dst], reg_names_32[src]);
+    Emit("add dword ptr [%s], %s\n", reg_names_64[dst], reg_names_32[src]);
     return;
   }
   if (size == 1) {
-    printf("add byte ptr [%s], %s\n", reg_names_64[dst], reg_names_8[src]);
+    Emit("add byte ptr [%s], %s\n", reg_names_64[dst], reg_names_8[src]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -75,15 +75,15 @@ static void EmitAddToMemory(struct Node *op, int dst, int src, int size) {
 
 static void EmitSubFromMemory(struct Node *op, int dst, int src, int size) {
   if (size == 8) {
-    printf("sub qword ptr [%s], %s\n", reg_names_64[dst], reg_names_64[src]);
+    Emit("sub qword ptr [%s], %s\n", reg_names_64[dst], reg_names_64[src]);
     return;
   }
   if (size == 4) {
-    printf("sub dword ptr [%s], %s\n", reg_names_64[dst], reg_names_32[src]);
+    Emit("sub dword ptr [%s], %s\n", reg_names_64[dst], reg_names_32[src]);
     return;
   }
   if (size == 1) {
-    printf("sub byte ptr [%s], %s\n", reg_names_64[dst], reg_names_8[src]);
+    Emit("sub byte ptr [%s], %s\n", reg_names_64[dst], reg_names_8[src]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -91,15 +91,15 @@ static void EmitSubFromMemory(struct Node *op, int dst, int src, int size) {
 
 static void EmitDecMemory(struct Node *op, int dst, int size) {
   if (size == 8) {
-    printf("dec qword ptr [%s]\n", reg_names_64[dst]);
+    Emit("dec qword ptr [%s]\n", reg_names_64[dst]);
     return;
   }
   if (size == 4) {
-    printf("dec dword ptr [%s]\n", reg_names_64[dst]);
+    Emit("dec dword ptr [%s]\n", reg_names_64[dst]);
     return;
   }
   if (size == 1) {
-    printf("dec byte ptr [%s]\n", reg_names_64[dst]);
+    Emit("dec byte ptr [%s]\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -107,15 +107,15 @@ static void EmitDecMemory(struct Node *op, int dst, int size) {
 
 static void EmitIncMemory(struct Node *op, int dst, int size) {
   if (size == 8) {
-    printf("inc qword ptr [%s]\n", reg_names_64[dst]);
+    Emit("inc qword ptr [%s]\n", reg_names_64[dst]);
     return;
   }
   if (size == 4) {
-    printf("inc dword ptr [%s]\n", reg_names_64[dst]);
+    Emit("inc dword ptr [%s]\n", reg_names_64[dst]);
     return;
   }
   if (size == 1) {
-    printf("inc byte ptr [%s]\n", reg_names_64[dst]);
+    Emit("inc byte ptr [%s]\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -124,11 +124,11 @@ static void EmitIncMemory(struct Node *op, int dst, int size) {
 static void EmitMulToMemory(struct Node *op, int dst, int src, int size) {
   if (size == 4) {
     // rdx:rax <- rax * r/m
-    printf("xor rdx, rdx\n");
-    printf("mov rax, %s\n", reg_names_64[dst]);
-    printf("mov eax, [rax]\n");
-    printf("imul %s\n", reg_names_64[src]);
-    printf("mov [%s], eax\n", reg_names_64[dst]);
+    Emit("xor rdx, rdx\n");
+    Emit("mov rax, %s\n", reg_names_64[dst]);
+    Emit("mov eax, [rax]\n");
+    Emit("imul %s\n", reg_names_64[src]);
+    Emit("mov [%s], eax\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -137,10 +137,10 @@ static void EmitMulToMemory(struct Node *op, int dst, int src, int size) {
 static void EmitDivToMemory(struct Node *op, int dst, int src, int size) {
   if (size == 4) {
     // rax <- rdx:rax / r/m
-    printf("xor rdx, rdx\n");
-    printf("mov eax, [%s]\n", reg_names_64[dst]);
-    printf("idiv %s\n", reg_names_64[src]);
-    printf("mov [%s], eax\n", reg_names_64[dst]);
+    Emit("xor rdx, rdx\n");
+    Emit("mov eax, [%s]\n", reg_names_64[dst]);
+    Emit("idiv %s\n", reg_names_64[src]);
+    Emit("mov [%s], eax\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -149,10 +149,10 @@ static void EmitDivToMemory(struct Node *op, int dst, int src, int size) {
 static void EmitModToMemory(struct Node *op, int dst, int src, int size) {
   if (size == 4) {
     // rdx <- rdx:rax % r/m
-    printf("xor rdx, rdx\n");
-    printf("mov eax, [%s]\n", reg_names_64[dst]);
-    printf("idiv %s\n", reg_names_64[src]);
-    printf("mov [%s], edx\n", reg_names_64[dst]);
+    Emit("xor rdx, rdx\n");
+    Emit("mov eax, [%s]\n", reg_names_64[dst]);
+    Emit("idiv %s\n", reg_names_64[src]);
+    Emit("mov [%s], edx\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -160,8 +160,8 @@ static void EmitModToMemory(struct Node *op, int dst, int src, int size) {
 
 static void EmitLShiftMemory(struct Node *op, int dst, int src, int size) {
   if (size == 4) {
-    printf("mov ecx, %s\n", reg_names_32[src]);
-    printf("shl dword ptr [%s], cl\n", reg_names_64[dst]);
+    Emit("mov ecx, %s\n", reg_names_32[src]);
+    Emit("shl dword ptr [%s], cl\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -169,8 +169,8 @@ static void EmitLShiftMemory(struct Node *op, int dst, int src, int size) {
 
 static void EmitRShiftMemory(struct Node *op, int dst, int src, int size) {
   if (size == 4) {
-    printf("mov ecx, %s\n", reg_names_32[src]);
-    printf("shr dword ptr [%s], cl\n", reg_names_64[dst]);
+    Emit("mov ecx, %s\n", reg_names_32[src]);
+    Emit("shr dword ptr [%s], cl\n", reg_names_64[dst]);
     return;
   }
   ErrorWithToken(op, "Assigning %d bytes is not implemented.", size);
@@ -186,57 +186,92 @@ const char *GetParamRegName(struct Node *type, int idx) {
                  "Assigning %d bytes is not implemented.", size);
 }
 
-static void GenerateForNode(struct Node *node) {
+static void GenerateStringLiterals(void) {
+  // String literals are emitted after each function which uses them, so
+  // that the code of the function can be cached with them.
+  if (!GetSizeOfList(compiler->str_list)) return;
+  Emit(".data\n");
+  for (int i = 0; i < GetSizeOfList(compiler->str_list); i++) {
+    struct Node *n = GetNodeAt(compiler->str_list, i);
+    Emit("L%s.%d: ", compiler->func_name, n->label_number);
+    Emit(".asciz ");
+    EmitStrN(n->op->begin, n->op->length);
+    Emit("\n");
+  }
+  Emit(".text\n");
+}
+
+static bool GenerateForNode(struct TraverseFrame *f) {
+  // Emits code for f->node. Children are visited with kGenerateRValue if
+  // their value is needed, or kGenerateAsIs if their address is needed.
+  struct Node *node = f->node;
   if (node->type == kASTList && !node->op) {
-    for (int i = 0; i < GetSizeOfList(node); i++) {
-      GenerateForNode(GetNodeAt(node, i));
-    }
-    return;
+    return VisitNextElement(f, 1, node, kGenerateAsIs);
   }
   if (node->type == kASTExprFuncCall) {
-    printf("sub rsp, %d # alloc stack frame\n", node->stack_size_needed);
-    int i;
-    for (i = 1; i <= NUM_OF_SCRATCH_REGS; i++) {
-      printf("push %s # save scratch regs\n", reg_names_64[i]);
-    }
-    GenerateForNodeRValue(node->func_expr);
-    printf("push %s\n", reg_names_64[node->func_expr->reg]);
-    assert(GetSizeOfList(node->arg_expr_list) <= NUM_OF_PARAM_REGISTERS);
-    for (i = 0; i < GetSizeOfList(node->arg_expr_list); i++) {
-      struct Node *n = GetNodeAt(node->arg_expr_list, i);
-      GenerateForNodeRValue(n);
-      printf("push %s\n", reg_names_64[n->reg]);
+    struct Node *args = GetFuncCallArgs(node);
+    switch (f->step) {
+      case 0:
+        Emit("sub rsp, %d # alloc stack frame\n", node->stack_size_needed);
+        for (int i = 1; i <= NUM_OF_SCRATCH_REGS; i++) {
+          Emit("push %s # save scratch regs\n", reg_names_64[i]);
+        }
+        return VisitChild(f, 1, node->func_expr, kGenerateRValue);
+      case 1:
+        Emit("push %s\n", reg_names_64[node->func_expr->reg]);
+        assert(GetSizeOfList(args) <= NUM_OF_PARAM_REGISTERS);
+        break;
+      case 2:
+        Emit("push %s\n", reg_names_64[f->child->reg]);
+        break;
     }
-    for (i--; i >= 0; i--) {
-      printf("pop %s\n", param_reg_names_64[i]);
+    if (VisitNextElement(f, 2, args, kGenerateRValue)) return true;
+    for (int i = GetSizeOfList(args) - 1; i >= 0; i--) {
+      Emit("pop %s\n", param_reg_names_64[i]);
     }
-    printf("pop rax\n");
-    printf("call rax\n");
-    for (i = NUM_OF_SCRATCH_REGS; i >= 1; i--) {
-      printf("pop %s # restore scratch regs\n", reg_names_64[i]);
+    Emit("pop rax\n");
+    Emit("call rax\n");
+    for (int i = NUM_OF_SCRATCH_REGS; i >= 1; i--) {
+      Emit("pop %s # restore scratch regs\n", reg_names_64[i]);
     }
     int ret_type_size = GetSizeOfType(node->expr_type);
     if (ret_type_size == 4) {
-      printf("movsxd %s, eax\n", reg_names_64[node->reg]);
+      Emit("movsxd %s, eax\n", reg_names_64[node->reg]);
     } else if (ret_type_size == 8) {
-      printf("mov %s, rax\n", reg_names_64[node->reg]);
+      Emit("mov %s, rax\n", reg_names_64[node->reg]);
     } else if (ret_type_size == 0) {
       // Return type is "void". Do nothing.
     } else {
       assert(false);
     }
-    printf("add rsp, %d # restore stack frame\n", node->stack_size_needed);
-    return;
+    Emit("add rsp, %d # restore stack frame\n", node->stack_size_needed);
+    return false;
   } else if (node->type == kASTFuncDef) {
-    const char *func_name = CreateTokenStr(node->func_name_token);
-    printf(".global %s%s\n", symbol_prefix, func_name);
-    printf("%s%s:\n", symbol_prefix, func_name);
-    printf("push rbp\n");
-    printf("mov rbp, rsp\n");
-    printf("push r12\n");
-    printf("push r13\n");
-    printf("push r14\n");
-    printf("push r15\n");
+    if (f->step) {
+      Emit("pop r15\n");
+      Emit("pop r14\n");
+      Emit("pop r13\n");
+      Emit("pop r12\n");
+      Emit("mov rsp, rbp\n");
+      Emit("pop rbp\n");
+      Emit("ret\n");
+      GenerateStringLiterals();
+      return false;
+    }
+    const char *func_name = node->func_name_token->atom;
+    compiler->func_name = func_name;
+    compiler->label_number = 0;
+    compiler->label_to_break = 0;
+    compiler->label_to_continue = 0;
+    compiler->str_list = AllocList();
+    Emit(".global %s%s\n", compiler->symbol_prefix, func_name);
+    Emit("%s%s:\n", compiler->symbol_prefix, func_name);
+    Emit("push rbp\n");
+    Emit("mov rbp, rsp\n");
+    Emit("push r12\n");
+    Emit("push r13\n");
+    Emit("push r14\n");
+    Emit("push r15\n");
     struct Node *arg_var_list = node->arg_var_list;
     assert(arg_var_list);
     assert(GetSizeOfList(arg_var_list) <= NUM_OF_PARAM_REGISTERS);
@@ -244,422 +279,455 @@ static void GenerateForNode(struct Node *node) {
       struct Node *arg_var = GetNodeAt(arg_var_list, i);
       if (!arg_var) continue;
       const char *param_reg_name = GetParamRegName(arg_var->expr_type, i);
-      printf("mov [rbp - %d], %s // arg[%d]\n", arg_var->byte_offset,
-             param_reg_name, i);
+      Emit("mov [rbp - %d], %s // arg[%d]\n", GetLocalVarOffset(arg_var),
+           param_reg_name, i);
     }
-    GenerateForNode(node->func_body);
-    printf("pop r15\n");
-    printf("pop r14\n");
-    printf("pop r13\n");
-    printf("pop r12\n");
-    printf("mov rsp, rbp\n");
-    printf("pop rbp\n");
-    printf("ret\n");
-    return;
+    return VisitChild(f, 1, GetFuncDefBody(node), kGenerateAsIs);
   }
   assert(node && node->op);
   if (node->type == kASTExpr) {
     if (IsTokenWithType(node->op, kTokenIntegerConstant)) {
-      printf("mov %s, %ld\n", reg_names_64[node->reg],
-             strtol(node->op->begin, NULL, 0));
-      return;
+      Emit("mov %s, %ld\n", reg_names_64[node->reg],
+           strtol(node->op->begin, NULL, 0));
+      return false;
     } else if (IsTokenWithType(node->op, kTokenCharLiteral)) {
       if (node->op->length == (1 + 1 + 1)) {
-        printf("mov %s, %d\n", reg_names_64[node->reg], node->op->begin[1]);
-        return;
+        Emit("mov %s, %d\n", reg_names_64[node->reg], node->op->begin[1]);
+        return false;
       }
       if (node->op->length == (1 + 2 + 1) && node->op->begin[1] == '\\') {
         if (node->op->begin[2] == 'n') {
-          printf("mov %s, %d\n", reg_names_64[node->reg], '\n');
-          return;
+          Emit("mov %s, %d\n", reg_names_64[node->reg], '\n');
+          return false;
         }
         if (node->op->begin[2] == '\\') {
-          printf("mov %s, %d\n", reg_names_64[node->reg], '\\');
-          return;
+          Emit("mov %s, %d\n", reg_names_64[node->reg], '\\');
+          return false;
         }
       }
       ErrorWithToken(node->op, "Not implemented char literal");
-    } else if (IsEqualTokenWithCStr(node->op, "(")) {
-      GenerateForNode(node->right);
-      return;
-    } else if (IsEqualTokenWithCStr(node->op, ".")) {
-      GenerateForNodeRValue(node->left);
-      printf("add %s, %d # struct member ofs\n", reg_names_64[node->reg],
-             node->byte_offset);
-      return;
-    } else if (IsEqualTokenWithCStr(node->op, "->")) {
-      GenerateForNodeRValue(node->left);
-      printf("add %s, %d # struct member ofs\n", reg_names_64[node->reg],
-             node->byte_offset);
-      return;
-    } else if (IsEqualTokenWithCStr(node->op, "[")) {
-      GenerateForNodeRValue(node->left);
-      GenerateForNodeRValue(node->right);
+    } else if (IsPunctuator(node->op, kPunctLParen)) {
+      if (!f->step) return VisitChild(f, 1, node->right, kGenerateAsIs);
+      return false;
+    } else if (IsPunctuator(node->op, kPunctDot) ||
+               IsPunctuator(node->op, kPunctArrow)) {
+      if (!f->step) return VisitChild(f, 1, node->left, kGenerateRValue);
+      Emit("add %s, %d # struct member ofs\n", reg_names_64[node->reg],
+           node->byte_offset);
+      return false;
+    } else if (IsPunctuator(node->op, kPunctLBracket)) {
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->left, kGenerateRValue);
+        case 1:
+          return VisitChild(f, 2, node->right, kGenerateRValue);
+      }
       int elem_size = GetSizeOfType(node->expr_type);
-      printf("imul %s, %s, %d\n", reg_names_64[node->right->reg],
-             reg_names_64[node->right->reg], elem_size);
-      printf("add %s, %s\n", reg_names_64[node->left->reg],
-             reg_names_64[node->right->reg]);
-      return;
+      Emit("imul %s, %s, %d\n", reg_names_64[node->right->reg],
+           reg_names_64[node->right->reg], elem_size);
+      Emit("add %s, %s\n", reg_names_64[node->left->reg],
+           reg_names_64[node->right->reg]);
+      return false;
     } else if (IsTokenWithType(node->op, kTokenIdent)) {
       if (node->expr_type->type == kTypeFunction) {
-        const char *label_name = CreateTokenStr(node->op);
-        printf(".global %s%s\n", symbol_prefix, label_name);
-        printf("mov %s, [rip + %s%s@GOTPCREL]\n", reg_names_64[node->reg],
-               symbol_prefix, label_name);
-        return;
+        const char *label_name = node->op->atom;
+        Emit(".global %s%s\n", compiler->symbol_prefix, label_name);
+        Emit("mov %s, [rip + %s%s@GOTPCREL]\n", reg_names_64[node->reg],
+             compiler->symbol_prefix, label_name);
+        return false;
       }
       if (!node->byte_offset) {
         // global var
-        const char *label_name = CreateTokenStr(node->op);
-        printf(".global %s%s\n", symbol_prefix, label_name);
-        printf("mov %s, [rip + %s%s@GOTPCREL]\n", reg_names_64[node->reg],
-               symbol_prefix, label_name);
-        return;
+        const char *label_name = node->op->atom;
+        Emit(".global %s%s\n", compiler->symbol_prefix, label_name);
+        Emit("mov %s, [rip + %s%s@GOTPCREL]\n", reg_names_64[node->reg],
+             compiler->symbol_prefix, label_name);
+        return false;
       }
-      printf("lea %s, [rbp - %d]\n", reg_names_64[node->reg],
-             node->byte_offset);
-      return;
+      Emit("lea %s, [rbp - %d]\n", reg_names_64[node->reg], node->byte_offset);
+      return false;
     } else if (IsTokenWithType(node->op, kTokenStringLiteral)) {
       int str_label = GetLabelNumber();
-      printf("lea %s, [rip + L%d]\n", reg_names_64[node->reg], str_label);
+      Emit("lea %s, [rip + L%s.%d]\n", reg_names_64[node->reg],
+           compiler->func_name, str_label);
       node->label_number = str_label;
-      PushToList(str_list, node);
-      return;
+      PushToList(compiler->str_list, node);
+      return false;
     } else if (node->cond) {
-      GenerateForNodeRValue(node->cond);
-      int false_label = GetLabelNumber();
-      int end_label = GetLabelNumber();
-      EmitConvertToBool(node->cond->reg, node->cond->reg);
-      printf("jz L%d\n", false_label);
-      GenerateForNodeRValue(node->left);
-      printf("mov %s, %s\n", reg_names_64[node->reg],
-             reg_names_64[node->left->reg]);
-      printf("jmp L%d\n", end_label);
-      printf("L%d:\n", false_label);
-      GenerateForNodeRValue(node->right);
-      printf("mov %s, %s\n", reg_names_64[node->reg],
-             reg_names_64[node->right->reg]);
-      printf("L%d:\n", end_label);
-      return;
+      int *false_label = &f->scratch[0];
+      int *end_label = &f->scratch[1];
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->cond, kGenerateRValue);
+        case 1:
+          *false_label = GetLabelNumber();
+          *end_label = GetLabelNumber();
+          EmitConvertToBool(node->cond->reg, node->cond->reg);
+          Emit("jz L%s.%d\n", compiler->func_name, *false_label);
+          return VisitChild(f, 2, node->left, kGenerateRValue);
+        case 2:
+          Emit("mov %s, %s\n", reg_names_64[node->reg],
+               reg_names_64[node->left->reg]);
+          Emit("jmp L%s.%d\n", compiler->func_name, *end_label);
+          Emit("L%s.%d:\n", compiler->func_name, *false_label);
+          return VisitChild(f, 3, node->right, kGenerateRValue);
+      }
+      Emit("mov %s, %s\n", reg_names_64[node->reg],
+           reg_names_64[node->right->reg]);
+      Emit("L%s.%d:\n", compiler->func_name, *end_label);
+      return false;
     } else if (!node->left && node->right) {
-      if (IsEqualTokenWithCStr(node->op, "--")) {
+      if (IsPunctuator(node->op, kPunctDec)) {
         // Prefix --
+        if (!f->step) return VisitChild(f, 1, node->right, kGenerateAsIs);
         int size = GetSizeOfType(node->expr_type);
-        GenerateForNode(node->right);
         EmitDecMemory(node->op, node->reg, GetSizeOfType(node->expr_type));
         EmitMoveFromMemory(node->op, node->reg, node->reg, size);
-        return;
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "++")) {
+      if (IsPunctuator(node->op, kPunctInc)) {
         // Prefix ++
+        if (!f->step) return VisitChild(f, 1, node->right, kGenerateAsIs);
         int size = GetSizeOfType(node->expr_type);
-        GenerateForNode(node->right);
         EmitIncMemory(node->op, node->reg, GetSizeOfType(node->expr_type));
         EmitMoveFromMemory(node->op, node->reg, node->reg, size);
-        return;
+        return false;
       }
       if (IsTokenWithType(node->op, kTokenKwSizeof)) {
-        printf("mov %s, %d\n", reg_names_64[node->reg],
-               GetSizeOfType(node->right->expr_type));
-        return;
+        Emit("mov %s, %d\n", reg_names_64[node->reg],
+             GetSizeOfType(node->right->expr_type));
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "&")) {
-        GenerateForNode(node->right);
-        return;
+      if (IsPunctuator(node->op, kPunctAnd)) {
+        if (!f->step) return VisitChild(f, 1, node->right, kGenerateAsIs);
+        return false;
       }
-      GenerateForNodeRValue(node->right);
-      if (IsEqualTokenWithCStr(node->op, "+")) {
-        return;
+      if (!f->step) return VisitChild(f, 1, node->right, kGenerateRValue);
+      if (IsPunctuator(node->op, kPunctPlus)) {
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "-")) {
-        printf("neg %s\n", reg_names_64[node->reg]);
-        return;
+      if (IsPunctuator(node->op, kPunctMinus)) {
+        Emit("neg %s\n", reg_names_64[node->reg]);
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "~")) {
-        printf("not %s\n", reg_names_64[node->reg]);
-        return;
+      if (IsPunctuator(node->op, kPunctTilde)) {
+        Emit("not %s\n", reg_names_64[node->reg]);
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "!")) {
+      if (IsPunctuator(node->op, kPunctNot)) {
         EmitConvertToBool(node->reg, node->reg);
-        printf("setz %s\n", reg_names_8[node->reg]);
-        return;
+        Emit("setz %s\n", reg_names_8[node->reg]);
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "*")) {
-        return;
+      if (IsPunctuator(node->op, kPunctStar)) {
+        return false;
       }
       ErrorWithToken(node->op,
                      "GenerateForNode: Not implemented unary prefix op");
     } else if (node->left && !node->right) {
-      if (IsEqualTokenWithCStr(node->op, "++")) {
+      if (IsPunctuator(node->op, kPunctInc)) {
         // Postfix ++
+        if (!f->step) return VisitChild(f, 1, node->left, kGenerateAsIs);
         int size = GetSizeOfType(node->expr_type);
-        GenerateForNode(node->left);
         EmitIncMemory(node->op, node->reg, size);
         EmitMoveFromMemory(node->op, node->reg, node->reg, size);
-        printf("sub %s, 1\n", reg_names_64[node->reg]);
-        return;
+        Emit("sub %s, 1\n", reg_names_64[node->reg]);
+        return false;
       }
-      if (IsEqualTokenWithCStr(node->op, "--")) {
+      if (IsPunctuator(node->op, kPunctDec)) {
         // Postfix --
+        if (!f->step) return VisitChild(f, 1, node->left, kGenerateAsIs);
         int size = GetSizeOfType(node->expr_type);
-        GenerateForNode(node->left);
         EmitDecMemory(node->op, node->reg, GetSizeOfType(node->expr_type));
         EmitMoveFromMemory(node->op, node->reg, node->reg, size);
-        printf("add %s, 1\n", reg_names_64[node->reg]);
-        return;
+        Emit("add %s, 1\n", reg_names_64[node->reg]);
+        return false;
       }
       ErrorWithToken(node->op,
                      "GenerateForNode: Not implemented unary postfix op");
     } else if (node->left && node->right) {
-      if (IsEqualTokenWithCStr(node->op, "&&")) {
-        GenerateForNodeRValue(node->left);
-        int skip_label = GetLabelNumber();
-        EmitConvertToBool(node->reg, node->left->reg);
-        printf("jz L%d\n", skip_label);
-        GenerateForNodeRValue(node->right);
-        EmitConvertToBool(node->reg, node->right->reg);
-        printf("L%d:\n", skip_label);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "||")) {
-        GenerateForNodeRValue(node->left);
-        int skip_label = GetLabelNumber();
-        EmitConvertToBool(node->reg, node->left->reg);
-        printf("jnz L%d\n", skip_label);
-        GenerateForNodeRValue(node->right);
+      if (IsPunctuator(node->op, kPunctAndAnd) ||
+          IsPunctuator(node->op, kPunctOrOr)) {
+        int *skip_label = &f->scratch[0];
+        switch (f->step) {
+          case 0:
+            return VisitChild(f, 1, node->left, kGenerateRValue);
+          case 1:
+            *skip_label = GetLabelNumber();
+            EmitConvertToBool(node->reg, node->left->reg);
+            Emit("%s L%s.%d\n",
+                 IsPunctuator(node->op, kPunctAndAnd) ? "jz" : "jnz",
+                 compiler->func_name, *skip_label);
+            return VisitChild(f, 2, node->right, kGenerateRValue);
+        }
         EmitConvertToBool(node->reg, node->right->reg);
-        printf("L%d:\n", skip_label);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, ",")) {
-        GenerateForNode(node->left);
-        GenerateForNodeRValue(node->right);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "=") ||
-                 IsEqualTokenWithCStr(node->op, "+=") ||
-                 IsEqualTokenWithCStr(node->op, "-=") ||
-                 IsEqualTokenWithCStr(node->op, "*=") ||
-                 IsEqualTokenWithCStr(node->op, "/=") ||
-                 IsEqualTokenWithCStr(node->op, "%=") ||
-                 IsEqualTokenWithCStr(node->op, "<<=") ||
-                 IsEqualTokenWithCStr(node->op, ">>=")) {
-        GenerateForNode(node->left);
-        GenerateForNodeRValue(node->right);
+        Emit("L%s.%d:\n", compiler->func_name, *skip_label);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctComma)) {
+        switch (f->step) {
+          case 0:
+            return VisitChild(f, 1, node->left, kGenerateAsIs);
+          case 1:
+            return VisitChild(f, 2, node->right, kGenerateRValue);
+        }
+        return false;
+      } else if (IsPunctuator(node->op, kPunctAssign) ||
+                 IsPunctuator(node->op, kPunctAddAssign) ||
+                 IsPunctuator(node->op, kPunctSubAssign) ||
+                 IsPunctuator(node->op, kPunctMulAssign) ||
+                 IsPunctuator(node->op, kPunctDivAssign) ||
+                 IsPunctuator(node->op, kPunctModAssign) ||
+                 IsPunctuator(node->op, kPunctShlAssign) ||
+                 IsPunctuator(node->op, kPunctShrAssign)) {
+        switch (f->step) {
+          case 0:
+            return VisitChild(f, 1, node->left, kGenerateAsIs);
+          case 1:
+            return VisitChild(f, 2, node->right, kGenerateRValue);
+        }
         int size = GetSizeOfType(node->left->expr_type);
-        if (IsEqualTokenWithCStr(node->op, "=")) {
+        if (IsPunctuator(node->op, kPunctAssign)) {
           EmitMoveToMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, "+=")) {
+        if (IsPunctuator(node->op, kPunctAddAssign)) {
           EmitAddToMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, "-=")) {
+        if (IsPunctuator(node->op, kPunctSubAssign)) {
           EmitSubFromMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, "*=")) {
+        if (IsPunctuator(node->op, kPunctMulAssign)) {
           EmitMulToMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, "/=")) {
+        if (IsPunctuator(node->op, kPunctDivAssign)) {
           EmitDivToMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, "%=")) {
+        if (IsPunctuator(node->op, kPunctModAssign)) {
           EmitModToMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, "<<=")) {
+        if (IsPunctuator(node->op, kPunctShlAssign)) {
           EmitLShiftMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
-        if (IsEqualTokenWithCStr(node->op, ">>=")) {
+        if (IsPunctuator(node->op, kPunctShrAssign)) {
           EmitRShiftMemory(node->op, node->left->reg, node->right->reg, size);
-          return;
+          return false;
         }
         assert(false);
       }
-      GenerateForNodeRValue(node->left);
-      GenerateForNodeRValue(node->right);
-      if (IsEqualTokenWithCStr(node->op, "+")) {
-        printf("add %s, %s\n", reg_names_64[node->reg],
-               reg_names_64[node->right->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "-")) {
-        printf("sub %s, %s\n", reg_names_64[node->reg],
-               reg_names_64[node->right->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "*")) {
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->left, kGenerateRValue);
+        case 1:
+          return VisitChild(f, 2, node->right, kGenerateRValue);
+      }
+      if (IsPunctuator(node->op, kPunctPlus)) {
+        Emit("add %s, %s\n", reg_names_64[node->reg],
+             reg_names_64[node->right->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctMinus)) {
+        Emit("sub %s, %s\n", reg_names_64[node->reg],
+             reg_names_64[node->right->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctStar)) {
         // rdx:rax <- rax * r/m
-        printf("xor rdx, rdx\n");
-        printf("mov rax, %s\n", reg_names_64[node->reg]);
-        printf("imul %s\n", reg_names_64[node->right->reg]);
-        printf("mov %s, rax\n", reg_names_64[node->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "/")) {
+        Emit("xor rdx, rdx\n");
+        Emit("mov rax, %s\n", reg_names_64[node->reg]);
+        Emit("imul %s\n", reg_names_64[node->right->reg]);
+        Emit("mov %s, rax\n", reg_names_64[node->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctSlash)) {
         // rax <- rdx:rax / r/m
-        printf("xor rdx, rdx\n");
-        printf("mov rax, %s\n", reg_names_64[node->reg]);
-        printf("idiv %s\n", reg_names_64[node->right->reg]);
-        printf("mov %s, rax\n", reg_names_64[node->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "%")) {
+        Emit("xor rdx, rdx\n");
+        Emit("mov rax, %s\n", reg_names_64[node->reg]);
+        Emit("idiv %s\n", reg_names_64[node->right->reg]);
+        Emit("mov %s, rax\n", reg_names_64[node->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctPercent)) {
         // rdx <- rdx:rax % r/m
-        printf("xor rdx, rdx\n");
-        printf("mov rax, %s\n", reg_names_64[node->reg]);
-        printf("idiv %s\n", reg_names_64[node->right->reg]);
-        printf("mov %s, rdx\n", reg_names_64[node->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "<<")) {
+        Emit("xor rdx, rdx\n");
+        Emit("mov rax, %s\n", reg_names_64[node->reg]);
+        Emit("idiv %s\n", reg_names_64[node->right->reg]);
+        Emit("mov %s, rdx\n", reg_names_64[node->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctShl)) {
         // r/m <<= CL
-        printf("mov rcx, %s\n", reg_names_64[node->right->reg]);
-        printf("sal %s, cl\n", reg_names_64[node->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, ">>")) {
+        Emit("mov rcx, %s\n", reg_names_64[node->right->reg]);
+        Emit("sal %s, cl\n", reg_names_64[node->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctShr)) {
         // r/m >>= CL
-        printf("mov rcx, %s\n", reg_names_64[node->right->reg]);
-        printf("sar %s, cl\n", reg_names_64[node->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "<")) {
+        Emit("mov rcx, %s\n", reg_names_64[node->right->reg]);
+        Emit("sar %s, cl\n", reg_names_64[node->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctLt)) {
         EmitCompareIntegers(node->reg, node->left->reg, node->right->reg, "l");
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, ">")) {
+        return false;
+      } else if (IsPunctuator(node->op, kPunctGt)) {
         EmitCompareIntegers(node->reg, node->left->reg, node->right->reg, "g");
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "<=")) {
+        return false;
+      } else if (IsPunctuator(node->op, kPunctLe)) {
         EmitCompareIntegers(node->reg, node->left->reg, node->right->reg, "le");
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, ">=")) {
+        return false;
+      } else if (IsPunctuator(node->op, kPunctGe)) {
         EmitCompareIntegers(node->reg, node->left->reg, node->right->reg, "ge");
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "==")) {
+        return false;
+      } else if (IsPunctuator(node->op, kPunctEq)) {
         EmitCompareIntegers(node->reg, node->left->reg, node->right->reg, "e");
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "!=")) {
+        return false;
+      } else if (IsPunctuator(node->op, kPunctNe)) {
         EmitCompareIntegers(node->reg, node->left->reg, node->right->reg, "ne");
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "&")) {
-        printf("and %s, %s\n", reg_names_64[node->reg],
-               reg_names_64[node->right->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "^")) {
-        printf("xor %s, %s\n", reg_names_64[node->reg],
-               reg_names_64[node->right->reg]);
-        return;
-      } else if (IsEqualTokenWithCStr(node->op, "|")) {
-        printf("or %s, %s\n", reg_names_64[node->reg],
-               reg_names_64[node->right->reg]);
-        return;
+        return false;
+      } else if (IsPunctuator(node->op, kPunctAnd)) {
+        Emit("and %s, %s\n", reg_names_64[node->reg],
+             reg_names_64[node->right->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctXor)) {
+        Emit("xor %s, %s\n", reg_names_64[node->reg],
+             reg_names_64[node->right->reg]);
+        return false;
+      } else if (IsPunctuator(node->op, kPunctOr)) {
+        Emit("or %s, %s\n", reg_names_64[node->reg],
+             reg_names_64[node->right->reg]);
+        return false;
       }
     }
   }
   if (node->type == kASTExprStmt) {
-    if (node->left) GenerateForNode(node->left);
-    return;
-  } else if (node->type == kASTList) {
-    for (int i = 0; i < GetSizeOfList(node); i++) {
-      GenerateForNode(GetNodeAt(node, i));
+    if (node->left && !f->step) {
+      return VisitChild(f, 1, node->left, kGenerateAsIs);
     }
-    return;
+    return false;
+  } else if (node->type == kASTList) {
+    return VisitNextElement(f, 1, node, kGenerateAsIs);
   } else if (node->type == kASTDecl) {
     if (IsASTDeclOfTypedef(node)) {
-      return;
+      return false;
     }
     assert(node->right && node->right->type == kASTDecltor);
-    if (!node->right->decltor_init_expr) return;
-    GenerateForNode(node->right->decltor_init_expr);
-    return;
+    if (!GetDecltorInitExpr(node->right) || f->step) return false;
+    return VisitChild(f, 1, GetDecltorInitExpr(node->right), kGenerateAsIs);
   } else if (node->type == kASTJumpStmt) {
     if (IsTokenWithType(node->op, kTokenKwBreak)) {
-      if (!label_to_break) {
+      if (!compiler->label_to_break) {
         ErrorWithToken(node->op, "break is not allowed here");
       }
-      printf("jmp L%d\n", label_to_break);
-      return;
+      Emit("jmp L%s.%d\n", compiler->func_name,
+           compiler->label_to_break);
+      return false;
     }
     if (IsTokenWithType(node->op, kTokenKwContinue)) {
-      if (!label_to_continue) {
+      if (!compiler->label_to_continue) {
         ErrorWithToken(node->op, "continue is not allowed here");
       }
-      printf("jmp L%d\n", label_to_continue);
-      return;
+      Emit("jmp L%s.%d\n", compiler->func_name,
+           compiler->label_to_continue);
+      return false;
     }
     if (IsTokenWithType(node->op, kTokenKwReturn)) {
       if (node->right) {
-        GenerateForNodeRValue(node->right);
-        printf("mov rax, %s\n", reg_names_64[node->right->reg]);
+        if (!f->step) return VisitChild(f, 1, node->right, kGenerateRValue);
+        Emit("mov rax, %s\n", reg_names_64[node->right->reg]);
       }
-      printf("mov rsp, rbp\n");
-      printf("pop rbp\n");
-      printf("ret\n");
-      return;
+      Emit("mov rsp, rbp\n");
+      Emit("pop rbp\n");
+      Emit("ret\n");
+      return false;
     }
     ErrorWithToken(node->op, "GenerateForNode: Not implemented jump stmt");
   } else if (node->type == kASTSelectionStmt) {
     if (IsTokenWithType(node->op, kTokenKwIf)) {
-      GenerateForNodeRValue(node->cond);
-      int false_label = GetLabelNumber();
-      int end_label = GetLabelNumber();
-      EmitConvertToBool(node->cond->reg, node->cond->reg);
-      printf("jz L%d\n", false_label);
-      GenerateForNodeRValue(node->if_true_stmt);
-      printf("jmp L%d\n", end_label);
-      printf("L%d:\n", false_label);
-      if (node->if_else_stmt) {
-        GenerateForNodeRValue(node->if_else_stmt);
+      int *false_label = &f->scratch[0];
+      int *end_label = &f->scratch[1];
+      switch (f->step) {
+        case 0:
+          return VisitChild(f, 1, node->cond, kGenerateRValue);
+        case 1:
+          *false_label = GetLabelNumber();
+          *end_label = GetLabelNumber();
+          EmitConvertToBool(node->cond->reg, node->cond->reg);
+          Emit("jz L%s.%d\n", compiler->func_name, *false_label);
+          return VisitChild(f, 2, node->if_true_stmt, kGenerateRValue);
+        case 2:
+          Emit("jmp L%s.%d\n", compiler->func_name, *end_label);
+          Emit("L%s.%d:\n", compiler->func_name, *false_label);
+          if (node->if_else_stmt) {
+            return VisitChild(f, 3, node->if_else_stmt, kGenerateRValue);
+          }
       }
-      printf("L%d:\n", end_label);
-      return;
+      Emit("L%s.%d:\n", compiler->func_name, *end_label);
+      return false;
     }
     ErrorWithToken(node->op, "GenerateForNode: Not implemented jump stmt");
   } else if (node->type == kASTForStmt) {
-    int loop_label = GetLabelNumber();
-    int end_label = GetLabelNumber();
-    int old_label_to_break = label_to_break;
-    label_to_break = end_label;
-    int old_label_to_continue = label_to_break;
-    label_to_continue = loop_label;
-    if (node->init) {
-      GenerateForNode(node->init);
-    }
-    printf("L%d:\n", loop_label);
-    if (node->cond) {
-      GenerateForNodeRValue(node->cond);
-      EmitConvertToBool(node->cond->reg, node->cond->reg);
-      printf("jz L%d\n", end_label);
-    }
-    GenerateForNode(node->body);
-    if (node->updt) {
-      GenerateForNode(node->updt);
+    int *loop_label = &f->scratch[0];
+    int *end_label = &f->scratch[1];
+    int *old_label_to_break = &f->scratch[2];
+    int *old_label_to_continue = &f->scratch[3];
+    switch (f->step) {
+      case 0:
+        *loop_label = GetLabelNumber();
+        *end_label = GetLabelNumber();
+        *old_label_to_break = compiler->label_to_break;
+        compiler->label_to_break = *end_label;
+        *old_label_to_continue = compiler->label_to_break;
+        compiler->label_to_continue = *loop_label;
+        if (node->init) return VisitChild(f, 1, node->init, kGenerateAsIs);
+        // fallthrough
+      case 1:
+        Emit("L%s.%d:\n", compiler->func_name, *loop_label);
+        if (node->cond) return VisitChild(f, 2, node->cond, kGenerateRValue);
+        // fallthrough
+      case 2:
+        if (node->cond) {
+          EmitConvertToBool(node->cond->reg, node->cond->reg);
+          Emit("jz L%s.%d\n", compiler->func_name, *end_label);
+        }
+        return VisitChild(f, 3, node->body, kGenerateAsIs);
+      case 3:
+        if (node->updt) return VisitChild(f, 4, node->updt, kGenerateAsIs);
     }
-    printf("jmp L%d\n", loop_label);
-    printf("L%d:\n", end_label);
-    label_to_continue = old_label_to_continue;
-    label_to_break = old_label_to_break;
-    return;
+    Emit("jmp L%s.%d\n", compiler->func_name, *loop_label);
+    Emit("L%s.%d:\n", compiler->func_name, *end_label);
+    compiler->label_to_continue = *old_label_to_continue;
+    compiler->label_to_break = *old_label_to_break;
+    return false;
   } else if (node->type == kASTWhileStmt) {
-    int loop_label = GetLabelNumber();
-    int end_label = GetLabelNumber();
-    int old_label_to_break = label_to_break;
-    label_to_break = end_label;
-    int old_label_to_continue = label_to_break;
-    label_to_continue = loop_label;
-    printf("L%d:\n", loop_label);
-    GenerateForNodeRValue(node->cond);
-    EmitConvertToBool(node->cond->reg, node->cond->reg);
-    printf("jz L%d\n", end_label);
-    GenerateForNode(node->body);
-    printf("jmp L%d\n", loop_label);
-    printf("L%d:\n", end_label);
-    label_to_continue = old_label_to_continue;
-    label_to_break = old_label_to_break;
-    return;
+    int *loop_label = &f->scratch[0];
+    int *end_label = &f->scratch[1];
+    int *old_label_to_break = &f->scratch[2];
+    int *old_label_to_continue = &f->scratch[3];
+    switch (f->step) {
+      case 0:
+        *loop_label = GetLabelNumber();
+        *end_label = GetLabelNumber();
+        *old_label_to_break = compiler->label_to_break;
+        compiler->label_to_break = *end_label;
+        *old_label_to_continue = compiler->label_to_break;
+        compiler->label_to_continue = *loop_label;
+        Emit("L%s.%d:\n", compiler->func_name, *loop_label);
+        return VisitChild(f, 1, node->cond, kGenerateRValue);
+      case 1:
+        EmitConvertToBool(node->cond->reg, node->cond->reg);
+        Emit("jz L%s.%d\n", compiler->func_name, *end_label);
+        return VisitChild(f, 2, node->body, kGenerateAsIs);
+    }
+    Emit("jmp L%s.%d\n", compiler->func_name, *loop_label);
+    Emit("L%s.%d:\n", compiler->func_name, *end_label);
+    compiler->label_to_continue = *old_label_to_continue;
+    compiler->label_to_break = *old_label_to_break;
+    return false;
   }
   ErrorWithToken(node->op, "GenerateForNode: Not implemented");
 }
 
-static void GenerateForNodeRValue(struct Node *node) {
-  GenerateForNode(node);
+static void GenerateRValueLoad(struct Node *node) {
+  // Loads the value from the address in node->reg if node is an lvalue.
   if (!node->expr_type) return;
   if (node->expr_type->type != kTypeLValue) return;
   if (node->expr_type->type == kTypeLValue &&
@@ -667,49 +735,78 @@ static void GenerateForNodeRValue(struct Node *node) {
     return;
   int size = GetSizeOfType(GetRValueType(node->expr_type));
   if (size == 8) {
-    printf("mov %s, [%s]\n", reg_names_64[node->reg], reg_names_64[node->reg]);
+    Emit("mov %s, [%s]\n", reg_names_64[node->reg], reg_names_64[node->reg]);
     return;
   } else if (size == 4) {
-    printf("movsxd %s, dword ptr[%s]\n", reg_names_64[node->reg],
-           reg_names_64[node->reg]);
+    Emit("movsxd %s, dword ptr[%s]\n", reg_names_64[node->reg],
+         reg_names_64[node->reg]);
     return;
   } else if (size == 1) {
-    printf("movsx %s, byte ptr[%s]\n", reg_names_64[node->reg],
-           reg_names_64[node->reg]);
+    Emit("movsx %s, byte ptr[%s]\n", reg_names_64[node->reg],
+         reg_names_64[node->reg]);
     return;
   }
   ErrorWithToken(node->op, "Dereferencing %d bytes is not implemented.", size);
 }
 
-static void GenerateDataSection(struct SymbolEntry *toplevel_names) {
-  printf(".data\n");
-  for (int i = 0; i < GetSizeOfList(str_list); i++) {
-    struct Node *n = GetNodeAt(str_list, i);
-    printf("L%d: ", n->label_number);
-    printf(".asciz ");
-    PrintTokenStrToFile(n->op, stdout);
-    putchar('\n');
-  }
-  struct SymbolEntry *e = toplevel_names;
+static bool GenerateStep(struct TraverseFrame *f, void *arg) {
+  (void)arg;
+  if (GenerateForNode(f)) return true;
+  if (f->param == kGenerateRValue) GenerateRValueLoad(f->node);
+  return false;
+}
+
+static void GenerateDataSection(struct SymbolTable *toplevel_names) {
+  Emit(".data\n");
+  struct SymbolEntry *e = toplevel_names->last;
   for (; e; e = e->prev) {
     if (e->type != kSymbolGlobalVar) continue;
     int size = GetSizeOfType(e->value);
-    fprintf(stderr, "Global Var: %s = %d bytes\n", e->key, size);
-    printf(".global %s%s\n", symbol_prefix, e->key);
-    printf("%s%s:\n", symbol_prefix, e->key);
-    printf(".byte ");
+    TRACE(kTraceCodegen, "Global Var: %s = %d bytes\n", e->key, size);
+    Emit(".global %s%s\n", compiler->symbol_prefix, e->key);
+    Emit("%s%s:\n", compiler->symbol_prefix, e->key);
+    Emit(".byte ");
     for (int i = 0; i < size; i++) {
-      printf("0%s", i == (size - 1) ? "\n" : ", ");
+      Emit("0%s", i == (size - 1) ? "\n" : ", ");
     }
   }
 }
 
-void Generate(struct Node *ast, struct SymbolEntry *toplevel_names) {
-  label_to_break = 0;
-  label_to_continue = 0;
-  str_list = AllocList();
-  printf(".intel_syntax noprefix\n");
-  printf(".text\n");
-  GenerateForNode(ast);
+static void GenerateFuncDef(struct Node *func_def) {
+  // Emits the code of func_def, which is also stored to the function cache
+  // (--func-cache-dir). The code cached for the same function by an earlier
+  // compilation is emitted instead if there is.
+  if (!compiler->options.func_cache_dir) {
+    Traverse(func_def, kGenerateAsIs, GenerateStep, NULL);
+    return;
+  }
+  unsigned long hash = CalcFuncDefHash(func_def);
+  const char *code = LoadCachedFunc(func_def, hash);
+  if (code) {
+    TRACE(kTraceCodegen, "Function cached: %s\n",
+          func_def->func_name_token->atom);
+    EmitStrN(code, strlen(code));
+    return;
+  }
+  int begin = BeginEmitterRecording();
+  Traverse(func_def, kGenerateAsIs, GenerateStep, NULL);
+  int size;
+  code = EndEmitterRecording(begin, &size);
+  StoreCachedFunc(func_def, hash, code, size);
+}
+
+void Generate(struct Node *ast, struct SymbolTable *toplevel_names) {
+  Emit(".intel_syntax noprefix\n");
+  Emit(".text\n");
+  assert(ast->type == kASTList);
+  for (int i = 0; i < GetSizeOfList(ast); i++) {
+    struct Node *n = GetNodeAt(ast, i);
+    if (n->type == kASTFuncDef) {
+      GenerateFuncDef(n);
+      continue;
+    }
+    Traverse(n, kGenerateAsIs, GenerateStep, NULL);
+  }
   GenerateDataSection(toplevel_names);
+  FlushEmitter();
 }
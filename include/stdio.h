@@ -2,6 +2,8 @@
 
 #define NULL 0
 #define EOF (-1)
+#define SEEK_SET 0
+#define SEEK_END 2
 
 typedef unsigned long size_t;
 typedef struct FILE FILE;
@@ -26,12 +28,20 @@ FILE *fopen(const char *, const char *);
 int fclose(FILE *);
 int fflush(FILE *);
 int fgetc(FILE *);
+size_t fread(void *, size_t, size_t, FILE *);
+size_t fwrite(const void *, size_t, size_t, FILE *);
+int fseek(FILE *, long, int);
+long ftell(FILE *);
 int fprintf(FILE *, const char *, ...);
 int fputc(int c, FILE *);
 int puts(char *s);
+int remove(const char *);
+int rename(const char *, const char *);
+FILE *tmpfile(void);
 int fputs(const char *, FILE *);
 int getchar(void);
 int printf(const char *, ...);
 int putchar(int c);
 int snprintf(char *, unsigned long, const char *, ...);
 int vfprintf(struct FILE *, const char *, va_list);
+int vsnprintf(char *, unsigned long, const char *, va_list);
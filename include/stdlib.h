@@ -1,7 +1,10 @@
 void* malloc(size_t size);
 void* calloc(size_t count, size_t size);
 void* realloc(void* ptr, size_t size);
+void free(void* ptr);
+char* realpath(const char* path, char* resolved_path);
 #define EXIT_FAILURE 1
 #define EXIT_SUCCESS 0
 void exit(int status);
+char* getenv(const char* name);
 long strtol(const char* str, char** endptr, int base);
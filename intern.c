@@ -0,0 +1,97 @@
+#include "compilium.h"
+
+// Intern table of identifier strings.
+// Each distinct string is stored only once, so two names are equal
+// if and only if their atoms (pointers returned from InternStr) are equal.
+
+#define INTERN_TABLE_INITIAL_CAPACITY 1024
+
+static unsigned int CalcStrHash(const char *s, int length) {
+  // FNV-1a
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < length; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void ExpandInternTable(struct InternTable *t) {
+  struct InternEntry *old_entries = t->entries;
+  int old_capacity = t->capacity;
+  t->capacity = old_capacity ? old_capacity * 2 : INTERN_TABLE_INITIAL_CAPACITY;
+  t->entries = calloc(t->capacity, sizeof(struct InternEntry));
+  assert(t->entries);
+  int mask = t->capacity - 1;
+  for (int i = 0; i < old_capacity; i++) {
+    struct InternEntry *e = &old_entries[i];
+    if (!e->str) continue;
+    int idx = e->hash & mask;
+    while (t->entries[idx].str) idx = (idx + 1) & mask;
+    t->entries[idx] = *e;
+  }
+  free(old_entries);
+}
+
+const char *InternStr(const char *begin, int length) {
+  // Returns NUL-terminated canonical copy of begin[0..length).
+  struct InternTable *t = &compiler->intern_table;
+  if (t->used * 2 >= t->capacity) ExpandInternTable(t);
+  unsigned int hash = CalcStrHash(begin, length);
+  int mask = t->capacity - 1;
+  int idx = hash & mask;
+  for (;; idx = (idx + 1) & mask) {
+    struct InternEntry *e = &t->entries[idx];
+    if (!e->str) break;
+    if (e->hash == hash && e->length == length &&
+        strncmp(e->str, begin, length) == 0)
+      return e->str;
+  }
+  struct InternEntry *e = &t->entries[idx];
+  enum ArenaKind prev_arena = SetCurrentArena(kArenaCache);
+  e->str = ArenaStrndup(begin, length);
+  SetCurrentArena(prev_arena);
+  e->length = length;
+  e->hash = hash;
+  t->used++;
+  return e->str;
+}
+
+void ReleaseInternTable(void) {
+  // Interned strings live in kArenaCache, so this should be called
+  // when the arenas are released.
+  free(compiler->intern_table.entries);
+  compiler->intern_table = (struct InternTable){0};
+}
+
+const char *InternCStr(const char *s) {
+  return InternStr(s, strlen(s));
+}
+
+void TestIntern() {
+  fprintf(stderr, "Testing Intern...");
+
+  char buf[] = "item1 item2 item1";
+  const char *a1 = InternStr(&buf[0], 5);
+  const char *a2 = InternStr(&buf[6], 5);
+  const char *a3 = InternStr(&buf[12], 5);
+  assert(a1 == a3);
+  assert(a1 != a2);
+  assert(strcmp(a1, "item1") == 0);
+  assert(strcmp(a2, "item2") == 0);
+  assert(InternCStr("item1") == a1);
+  assert(InternStr("item", 4) != a1);
+
+  // Atoms should be kept after the table is expanded
+  char name[16];
+  for (int i = 0; i < INTERN_TABLE_INITIAL_CAPACITY * 4; i++) {
+    snprintf(name, sizeof(name), "v%d", i);
+    InternCStr(name);
+  }
+  assert(InternCStr("item1") == a1);
+  assert(InternCStr("item2") == a2);
+  assert(InternCStr("v1234") == InternStr("v12345", 5));
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,39 @@
+#ifndef LIBCOMPILIUM_H
+#define LIBCOMPILIUM_H
+
+// Library interface of compilium (libcompilium.a), to embed the compiler.
+// Each call compiles one translation unit with a state of its own, so
+// calls can run at the same time on different threads. Errors in the
+// source are reported to stderr and fail the call without exiting.
+
+enum TimeReportFormat {
+  kTimeReportNone,
+  kTimeReportTable,
+  kTimeReportJSON,  // a line of JSON for each compilation
+};
+
+struct CompilerOptions {
+  const char *target_os;     // "Darwin", "Linux", or NULL for the default
+  const char *include_path;  // for #include <...>, ended with '/'
+  const char *pch_dir;       // of precompiled headers, ended with '/'
+  const char *func_cache_dir;  // of code of functions, ended with '/'
+  int is_preprocess_only;    // outputs the preprocessed source (-E)
+  int is_object_output;      // outputs an ELF object file (-c)
+  int is_alloc_report_enabled;
+  int is_stats_enabled;  // prints hot-path counters (make compilium_stats)
+  unsigned int trace_categories;  // bits of enum TraceCategory
+  enum TimeReportFormat time_report;  // printed to stderr
+};
+
+// Compiles the file at input_path ("-" for stdin) and writes the output
+// to output_path, or to stdout if it is NULL. Returns 0 on success.
+int CompileFile(const struct CompilerOptions *options, const char *input_path,
+                const char *output_path);
+
+// Compiles source and returns the output allocated with malloc, which
+// should be freed by the caller, or NULL on errors. The size of the output
+// is stored to *size, and the text is also terminated by a NUL.
+char *CompileSource(const struct CompilerOptions *options, const char *source,
+                    int *size);
+
+#endif
@@ -0,0 +1,153 @@
+#include "compilium.h"
+
+// Table of macros defined by #define (and compiler args), keyed by atom.
+// Every identifier in the input is looked up here, so a small bloom filter
+// over the atoms of defined names rejects most of them before hashing into
+// the buckets. #undef does not clear bloom bits; they only cause a lookup.
+
+#define MACRO_TABLE_NUM_OF_BUCKETS 1024
+#define MACRO_BLOOM_BITS 4096
+
+struct MacroEntry {
+  const char *name;  // atom
+  struct Node *replacement;  // kNodeMacroReplacement
+  struct MacroEntry *next;
+};
+
+struct MacroTable {
+  struct MacroEntry *buckets[MACRO_TABLE_NUM_OF_BUCKETS];
+  unsigned long bloom[MACRO_BLOOM_BITS / (8 * sizeof(unsigned long))];
+};
+
+static unsigned int CalcMacroHash(const char *name) {
+  // name is an atom, so its address identifies the name.
+  unsigned long v = (unsigned long)name;
+  return (unsigned int)((v >> 3) ^ (v >> 19)) * 2654435761u;
+}
+
+#define BLOOM_WORD_BITS (8 * sizeof(unsigned long))
+static void SetBloomBit(struct MacroTable *mt, unsigned int bit) {
+  bit %= MACRO_BLOOM_BITS;
+  mt->bloom[bit / BLOOM_WORD_BITS] |= 1UL << (bit % BLOOM_WORD_BITS);
+}
+
+static bool TestBloomBit(struct MacroTable *mt, unsigned int bit) {
+  bit %= MACRO_BLOOM_BITS;
+  return mt->bloom[bit / BLOOM_WORD_BITS] & (1UL << (bit % BLOOM_WORD_BITS));
+}
+
+static bool MayBeMacro(struct MacroTable *mt, unsigned int hash) {
+  // Two bits taken from different parts of the hash.
+  return TestBloomBit(mt, hash) && TestBloomBit(mt, hash >> 16);
+}
+
+static struct MacroEntry **FindMacroEntryHolder(struct MacroTable *mt,
+                                                const char *name,
+                                                unsigned int hash) {
+  struct MacroEntry **p = &mt->buckets[hash % MACRO_TABLE_NUM_OF_BUCKETS];
+  for (; *p; p = &(*p)->next) {
+    STAT_STEPS(kStatMacroProbe, 1);
+    if ((*p)->name == name) break;
+  }
+  return p;
+}
+
+struct MacroTable *AllocMacroTable(void) {
+  return ArenaAlloc(sizeof(struct MacroTable));
+}
+
+void DefineMacro(struct MacroTable *mt, const char *name,
+                 struct Node *replacement) {
+  // Redefinition replaces the previous one.
+  assert(mt && name);
+  assert(replacement && replacement->type == kNodeMacroReplacement);
+  name = InternCStr(name);
+  unsigned int hash = CalcMacroHash(name);
+  struct MacroEntry **p = FindMacroEntryHolder(mt, name, hash);
+  if (*p) {
+    (*p)->replacement = replacement;
+    return;
+  }
+  struct MacroEntry *e = ArenaAlloc(sizeof(struct MacroEntry));
+  e->name = name;
+  e->replacement = replacement;
+  *p = e;
+  SetBloomBit(mt, hash);
+  SetBloomBit(mt, hash >> 16);
+}
+
+void UndefMacro(struct MacroTable *mt, const char *name) {
+  assert(mt && name);
+  name = InternCStr(name);
+  struct MacroEntry **p = FindMacroEntryHolder(mt, name, CalcMacroHash(name));
+  if (*p) *p = (*p)->next;
+}
+
+struct Node *FindMacroByName(struct MacroTable *mt, const char *name) {
+  // name should be an atom.
+  assert(mt && name);
+  unsigned int hash = CalcMacroHash(name);
+  STAT_CALL(kStatMacroProbe);
+  if (!MayBeMacro(mt, hash)) return NULL;
+  struct MacroEntry *e = *FindMacroEntryHolder(mt, name, hash);
+  return e ? e->replacement : NULL;
+}
+
+struct Node *FindMacro(struct MacroTable *mt, struct Node *t) {
+  // Returns kNodeMacroReplacement if t is an identifier defined as a macro.
+  if (!IsToken(t) || !t->atom) return NULL;
+  return FindMacroByName(mt, t->atom);
+}
+
+struct Node *CreateMacroList(struct MacroTable *mt) {
+  // Returns kASTList of kASTKeyValue (name -> kNodeMacroReplacement)
+  // for all macros in mt. The order is unspecified.
+  assert(mt);
+  struct Node *list = AllocList();
+  for (int i = 0; i < MACRO_TABLE_NUM_OF_BUCKETS; i++) {
+    for (struct MacroEntry *e = mt->buckets[i]; e; e = e->next) {
+      PushKeyValueToList(list, e->name, e->replacement);
+    }
+  }
+  return list;
+}
+
+void TestMacro() {
+  fprintf(stderr, "Testing Macro...");
+
+  struct MacroTable *mt = AllocMacroTable();
+  struct Node *a = CreateToken("MACRO_A");
+  struct Node *b = CreateToken("MACRO_B");
+  struct Node *rep1 = CreateMacroReplacement(NULL, CreateToken("1"));
+  struct Node *rep2 = CreateMacroReplacement(NULL, CreateToken("2"));
+
+  assert(!FindMacro(mt, a));
+  DefineMacro(mt, "MACRO_A", rep1);
+  assert(FindMacro(mt, a) == rep1);
+  assert(!FindMacro(mt, b));
+  assert(!FindMacro(mt, CreateToken("1")));
+
+  DefineMacro(mt, "MACRO_A", rep2);
+  assert(FindMacro(mt, a) == rep2);
+
+  DefineMacro(mt, "MACRO_B", rep1);
+  UndefMacro(mt, "MACRO_A");
+  assert(!FindMacro(mt, a));
+  assert(FindMacro(mt, b) == rep1);
+  UndefMacro(mt, "MACRO_NOT_DEFINED");
+
+  // Many macros should share the buckets and the bloom filter
+  char name[16];
+  for (int i = 0; i < MACRO_TABLE_NUM_OF_BUCKETS * 4; i++) {
+    snprintf(name, sizeof(name), "M%d", i);
+    DefineMacro(mt, name, rep1);
+  }
+  assert(FindMacro(mt, CreateToken("M1234")) == rep1);
+  assert(FindMacro(mt, b) == rep1);
+  assert(!FindMacro(mt, a));
+  assert(GetSizeOfList(CreateMacroList(mt)) ==
+         MACRO_TABLE_NUM_OF_BUCKETS * 4 + 1);
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,152 @@
+#include "compilium.h"
+
+// Command line interface. The args are parsed into CompilerOptions, and
+// the input files are compiled through the library interface.
+
+static struct CompilerOptions options;
+static const char **input_file_paths;
+static int num_of_input_files;
+static const char *output_file_path;
+static int num_of_jobs;  // 0 to use all CPUs
+static const char *server_socket_path;  // to run the compile server
+static const char *connect_socket_path;  // to compile on the server
+
+void TestList(void);
+void TestType(void);
+void TestIntern(void);
+void TestSymbol(void);
+void TestMacro(void);
+void TestTokenizer(void);
+void TestLibrary(void);
+
+static void RunUnitTest(void (*test)(void)) {
+  // Tests use the modules directly, so a context is bound for them.
+  compiler = CreateCompilerContext(&options);
+  test();
+}
+
+static void ParseCompilerArgs(int argc, char **argv) {
+  input_file_paths = malloc(sizeof(const char *) * argc);
+  assert(input_file_paths);
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--target-os") == 0) {
+      i++;
+      options.target_os = argv[i];
+      if (!options.target_os ||
+          (strcmp(options.target_os, "Darwin") != 0 &&
+           strcmp(options.target_os, "Linux") != 0)) {
+        Error("Unknown os type %s", options.target_os);
+      }
+    } else if (strcmp(argv[i], "-I") == 0) {
+      i++;
+      options.include_path = argv[i];
+      assert(options.include_path);
+      if (options.include_path[strlen(options.include_path) - 1] != '/') {
+        Error("Include path (-I <path>) should be ended with '/'");
+      }
+    } else if (strcmp(argv[i], "--pch-dir") == 0) {
+      i++;
+      options.pch_dir = argv[i];
+      if (!options.pch_dir ||
+          options.pch_dir[strlen(options.pch_dir) - 1] != '/') {
+        Error("PCH directory (--pch-dir <path>) should be ended with '/'");
+      }
+    } else if (strcmp(argv[i], "--func-cache-dir") == 0) {
+      i++;
+      options.func_cache_dir = argv[i];
+      if (!options.func_cache_dir ||
+          options.func_cache_dir[strlen(options.func_cache_dir) - 1] != '/') {
+        Error("Function cache directory (--func-cache-dir <path>) should be "
+              "ended with '/'");
+      }
+    } else if (strcmp(argv[i], "--run-unittest=List") == 0) {
+      RunUnitTest(TestList);
+    } else if (strcmp(argv[i], "--run-unittest=Type") == 0) {
+      RunUnitTest(TestType);
+    } else if (strcmp(argv[i], "--run-unittest=Intern") == 0) {
+      RunUnitTest(TestIntern);
+    } else if (strcmp(argv[i], "--run-unittest=Symbol") == 0) {
+      RunUnitTest(TestSymbol);
+    } else if (strcmp(argv[i], "--run-unittest=Macro") == 0) {
+      RunUnitTest(TestMacro);
+    } else if (strcmp(argv[i], "--run-unittest=Tokenizer") == 0) {
+      RunUnitTest(TestTokenizer);
+    } else if (strcmp(argv[i], "--run-unittest=Library") == 0) {
+      RunUnitTest(TestLibrary);
+    } else if (strcmp(argv[i], "-E") == 0) {
+      options.is_preprocess_only = true;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      options.is_object_output = true;
+    } else if (strcmp(argv[i], "-o") == 0) {
+      i++;
+      output_file_path = argv[i];
+      if (!output_file_path) Error("Output file path (-o <path>) is missing");
+    } else if (strcmp(argv[i], "-j") == 0) {
+      i++;
+      num_of_jobs = argv[i] ? strtol(argv[i], NULL, 10) : 0;
+      if (num_of_jobs <= 0) Error("Number of jobs (-j <N>) should be positive");
+    } else if (strcmp(argv[i], "--server") == 0) {
+      i++;
+      server_socket_path = argv[i];
+      if (!server_socket_path) {
+        Error("Socket path (--server <path>) is missing");
+      }
+    } else if (strcmp(argv[i], "--connect") == 0) {
+      i++;
+      connect_socket_path = argv[i];
+      if (!connect_socket_path) {
+        Error("Socket path (--connect <path>) is missing");
+      }
+    } else if (strcmp(argv[i], "--time-report") == 0) {
+      options.time_report = kTimeReportTable;
+    } else if (strcmp(argv[i], "--time-report=json") == 0) {
+      options.time_report = kTimeReportJSON;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      options.is_stats_enabled = true;
+    } else if (strcmp(argv[i], "--alloc-report") == 0) {
+      options.is_alloc_report_enabled = true;
+    } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+      options.trace_categories |= ParseTraceCategories(argv[i] + 8);
+    } else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+      input_file_paths[num_of_input_files++] = argv[i];
+    } else {
+      Error("Unknown argument: %s", argv[i]);
+    }
+  }
+  if (num_of_input_files > 1) {
+    // Outputs are named after the inputs, in the directory given by -o.
+    if (output_file_path &&
+        output_file_path[strlen(output_file_path) - 1] != '/') {
+      Error("Output directory (-o <path>) for multiple input files should be "
+            "ended with '/'");
+    }
+    for (int i = 0; i < num_of_input_files; i++) {
+      if (strcmp(input_file_paths[i], "-") == 0) {
+        Error("stdin (-) can not be compiled with other input files");
+      }
+    }
+  } else if (options.is_object_output && !output_file_path) {
+    Error("Output file path (-o <path>) is required with -c");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  ParseCompilerArgs(argc, argv);
+  if (server_socket_path) RunCompileServer(server_socket_path);
+  if (!connect_socket_path) connect_socket_path = getenv("COMPILIUM_SERVER");
+  if (num_of_input_files > 1) {
+    // The server compiles one file at a time, so they are compiled here.
+    const char *suffix = options.is_preprocess_only ? ".i"
+                         : options.is_object_output ? ".o"
+                                                    : ".S";
+    return CompileFilesInParallel(
+        &options, input_file_paths, num_of_input_files, output_file_path,
+        suffix, num_of_jobs ? num_of_jobs : GetNumOfOnlineCPUs());
+  }
+  const char *input_path = num_of_input_files ? input_file_paths[0] : "-";
+  if (connect_socket_path && *connect_socket_path) {
+    return CompileOnServer(connect_socket_path, &options, input_path,
+                           output_file_path);
+  }
+  return CompileFile(&options, input_path, output_file_path);
+}
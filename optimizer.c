@@ -1,7 +1,9 @@
 #include "compilium.h"
 
-
-
+static bool IsIntegerConstantExpr(struct Node *n) {
+  return n && n->type == kASTExpr && !n->left && !n->right && !n->cond &&
+         IsTokenWithType(n->op, kTokenIntegerConstant);
+}
 
 // ConstantPropagation は式を受け取り，左右が定数値であれば，
 // 定数畳み込みを行い，式を定数式に書き換える。
@@ -12,58 +14,56 @@ int ConstantPropagation(struct Node *expr){
   if (!expr || expr->type != kASTExpr) {
     return false;
   }
-  if( !expr->left || !expr->right) {
+  if (!IsIntegerConstantExpr(expr->left) ||
+      !IsIntegerConstantExpr(expr->right)) {
     return false;
   }
-  int left_var = strtol(expr->left->op->begin, NULL, 10);
-  int right_var = strtol(expr->right->op->begin, NULL, 10);
-  PrintASTNode(expr);
-
-  char s[12];
-
-  if (strncmp(expr->op->begin, "+", expr->op->length) == 0) {
-    snprintf(s, sizeof(s), "%d", left_var + right_var);    
-  } else if (strncmp(expr->op->begin, "-", expr->op->length) == 0) {
-    snprintf(s, sizeof(s), "%d", left_var - right_var);    
-  } else if (strncmp(expr->op->begin, "*", expr->op->length) == 0) {
-    snprintf(s, sizeof(s), "%d", left_var * right_var);    
+  long left_var = strtol(expr->left->op->begin, NULL, 0);
+  long right_var = strtol(expr->right->op->begin, NULL, 0);
+  TRACE_AST(kTraceOptimize, expr);
+
+  long result;
+  if (IsPunctuator(expr->op, kPunctPlus)) {
+    result = left_var + right_var;
+  } else if (IsPunctuator(expr->op, kPunctMinus)) {
+    result = left_var - right_var;
+  } else if (IsPunctuator(expr->op, kPunctStar)) {
+    result = left_var * right_var;
   } else {
     return false;
   }
-  
-  fprintf(stderr, "%d %.*s %d = %s\n", left_var, expr->op->length, expr->op->begin, right_var, s);
-
-    
-  fprintf(stderr, "s: %s\n", s);
-  char *ds = strdup(s);  // duplicate because s is allocated on the stack
+  // A negative value is not a single integer-constant token.
+  if (result < 0 || result > 0x7fffffff) {
+    return false;
+  }
+  char s[12];
+  snprintf(s, sizeof(s), "%ld", result);
+  TRACE(kTraceOptimize, "%ld %.*s %ld = %s\n", left_var, expr->op->length,
+        expr->op->begin, right_var, s);
+  char *ds = ArenaStrdup(s);  // duplicate because s is allocated on the stack
   int line = 0;
-  expr->op = CreateNextToken(ds, ds, &line);  // use ds here
+  expr->op = CreateNextToken(ds, &line);  // use ds here
   expr->left = NULL;
   expr->right = NULL;
-  PrintASTNode(expr);
-  
-  /*
-  else if (strncmp(expr->op->begin, "-", expr->op->length) == 0) {
-    int left_var = strtol(expr->left->op->begin, NULL, 10);
-    int right_var = strtol(expr->right->op->begin, NULL, 10);
-    PrintASTNode(expr);
-    fprintf(stderr, "%d - %d = %d\n", left_var, right_var,
-            left_var + right_var);
-    char s[12];
-    snprintf(s, sizeof(s), "%d", left_var - right_var);
-    fprintf(stderr, "s: %s\n", s);
-    char *ds = strdup(s);  // duplicate because s is allocated on the stack
-    int line = 0;
-    expr->op = CreateNextToken(ds, ds, &line);  // use ds here
-    expr->left = NULL;
-    expr->right = NULL;
-    PrintASTNode(expr);
-  } else {
+  TRACE_AST(kTraceOptimize, expr);
+  return true;
+}
+
+static bool OptimizeExprStep(struct TraverseFrame *f, void *arg) {
+  (void)arg;
+  struct Node *expr = f->node;
+  if (!expr || expr->type != kASTExpr) {
     return false;
   }
-  //*/
-  
-  return true;
+  switch (f->step) {
+    case 0:
+      return VisitChild(f, 1, expr->left, 0);
+    case 1:
+      return VisitChild(f, 2, expr->right, 0);
+  }
+  // left と right が定数なら，ここで定数の計算
+  ConstantPropagation(expr);
+  return false;
 }
 
 // OptimizeExpr は式を受け取って定数伝播の最適化を施す。
@@ -75,23 +75,20 @@ int OptimizeExpr(struct Node *expr) {
     return 0;
   }
 
-  fprintf(stderr, "OptimizeExpr:\n");
-  PrintASTNode(expr);
-
-  OptimizeExpr(expr->left);
-  OptimizeExpr(expr->right);
+  TRACE(kTraceOptimize, "OptimizeExpr:\n");
+  TRACE_AST(kTraceOptimize, expr);
 
-  // left と right が定数なら，ここで定数の計算
-  ConstantPropagation(expr);
+  // 部分式から順に畳み込む
+  Traverse(expr, 0, OptimizeExprStep, NULL);
   return 1;
 }
 
 void Optimize(struct Node *ast) {
   // Show the base AST
-  fprintf(stderr, "AST before optimization:\n");
-  PrintASTNode(ast);
+  TRACE(kTraceOptimize, "AST before optimization:\n");
+  TRACE_AST(kTraceOptimize, ast);
 
-  fputs("Optimization begin\n", stderr);
+  TRACE(kTraceOptimize, "Optimization begin\n");
   // do something cool here...
 
   // Calculate constant expression on toplevel return
@@ -102,25 +99,17 @@ void Optimize(struct Node *ast) {
       continue;
     }
     // for each FuncDef
-    assert(IsASTList(n->func_body));
-    for (int k = 0; k < GetSizeOfList(n->func_body); k++) {
-      struct Node *toplevel_expr = GetNodeAt(n->func_body, k);
-
-      printf("Z %d\n", toplevel_expr->type);
-
-
+    struct Node *func_body = GetFuncDefBody(n);
+    assert(IsASTList(func_body));
+    for (int k = 0; k < GetSizeOfList(func_body); k++) {
+      struct Node *toplevel_expr = GetNodeAt(func_body, k);
       if (toplevel_expr->type == kASTExprStmt) {
         struct Node *expr = toplevel_expr->left;
         // for each ExprStmt
-        printf("A %1s %d\n", expr->op->begin, expr->type);
         if (!expr || expr->type != kASTExpr) {
           continue;
         }
-        printf("B %1s %d\n", expr->op->begin, expr->type);
-        if (OptimizeExpr(expr) == true) {
-          continue;
-        }
-        printf("C %1s %d\n", expr->op->begin, expr->type);
+        OptimizeExpr(expr);
       } else if (toplevel_expr->type == kASTJumpStmt) {
         if(toplevel_expr->left) {
           OptimizeExpr(toplevel_expr->left);
@@ -133,9 +122,9 @@ void Optimize(struct Node *ast) {
   }
 
   // Show the result
-  fprintf(stderr, "AST after optimization:\n");
-  PrintASTNode(ast);
-  fputs("Optimization end\n", stderr);
+  TRACE(kTraceOptimize, "AST after optimization:\n");
+  TRACE_AST(kTraceOptimize, ast);
+  TRACE(kTraceOptimize, "Optimization end\n");
 }
 
 
@@ -1,7 +1,6 @@
 #include "compilium.h"
 
 // 6.2.3 Name spaces of identifiers
-static struct Node *ord_idents;  // ordinary identifiers
 
 struct Node *ParseStmt();
 struct Node *ParseCompStmt();
@@ -19,12 +18,12 @@ struct Node *ParsePrimaryExpr() {
     op->op = t;
     return op;
   }
-  if ((t = ConsumePunctuator("("))) {
+  if ((t = ConsumePunctuator(kPunctLParen))) {
     struct Node *op = AllocNode(kASTExpr);
     op->op = t;
     op->right = ParseExpr();
     if (!op->right) ErrorWithToken(t, "Expected expr after this token");
-    ExpectPunctuator(")");
+    ExpectPunctuator(kPunctRParen);
     return op;
   }
   return NULL;
@@ -34,56 +33,70 @@ struct Node *ParseAssignExpr();
 struct Node *ParsePostfixExpr() {
   struct Node *n = ParsePrimaryExpr();
   while (n) {
-    struct Node *t;
-    if (ConsumePunctuator("(")) {
-      struct Node *args = AllocList();
-      if (!ConsumePunctuator(")")) {
-        do {
-          struct Node *arg_expr = ParseAssignExpr();
-          if (!arg_expr)
-            ErrorWithToken(NextToken(), "Expected expression here");
-          PushToList(args, arg_expr);
-        } while (ConsumePunctuator(","));
-        ExpectPunctuator(")");
+    struct Node *t = PeekToken();
+    switch (t ? t->punct_id : kPunctNone) {
+      case kPunctLParen: {
+        NextToken();
+        struct Node *args = AllocList();
+        if (!ConsumePunctuator(kPunctRParen)) {
+          do {
+            struct Node *arg_expr = ParseAssignExpr();
+            if (!arg_expr)
+              ErrorWithToken(NextToken(), "Expected expression here");
+            PushToList(args, arg_expr);
+          } while (ConsumePunctuator(kPunctComma));
+          ExpectPunctuator(kPunctRParen);
+        }
+        struct Node *nn = AllocNode(kASTExprFuncCall);
+        nn->func_expr = n;
+        nn->arg_expr_list = args;
+        n = nn;
+        continue;
       }
-      struct Node *nn = AllocNode(kASTExprFuncCall);
-      nn->func_expr = n;
-      nn->arg_expr_list = args;
-      n = nn;
-      continue;
-    }
-    if ((t = ConsumePunctuator("["))) {
-      n = CreateASTBinOp(t, n, ParseExpr());
-      ExpectPunctuator("]");
-      continue;
-    }
-    if ((t = ConsumePunctuator(".")) || (t = ConsumePunctuator("->"))) {
-      struct Node *right = ConsumeToken(kTokenIdent);
-      assert(right);
-      n = CreateASTBinOp(t, n, right);
-      continue;
-    }
-    if ((t = ConsumePunctuator("++"))) {
-      n = CreateASTUnaryPostfixOp(n, t);
-      continue;
-    }
-    if ((t = ConsumePunctuator("--"))) {
-      n = CreateASTUnaryPostfixOp(n, t);
-      continue;
+      case kPunctLBracket:
+        NextToken();
+        n = CreateASTBinOp(t, n, ParseExpr());
+        ExpectPunctuator(kPunctRBracket);
+        continue;
+      case kPunctDot:
+      case kPunctArrow: {
+        NextToken();
+        struct Node *right = ConsumeToken(kTokenIdent);
+        assert(right);
+        n = CreateASTBinOp(t, n, right);
+        continue;
+      }
+      case kPunctInc:
+      case kPunctDec:
+        NextToken();
+        n = CreateASTUnaryPostfixOp(n, t);
+        continue;
+      default:
+        return n;
     }
-    break;
   }
   return n;
 }
 
 struct Node *ParseUnaryExpr() {
-  struct Node *t;
-  if ((t = ConsumePunctuator("+")) || (t = ConsumePunctuator("-")) ||
-      (t = ConsumePunctuator("~")) || (t = ConsumePunctuator("!")) ||
-      (t = ConsumePunctuator("&")) || (t = ConsumePunctuator("*"))) {
-    return CreateASTUnaryPrefixOp(t, ParseCastExpr());
-  } else if ((t = ConsumePunctuator("--")) || (t = ConsumePunctuator("++")) ||
-             (t = ConsumeToken(kTokenKwSizeof))) {
+  struct Node *t = PeekToken();
+  switch (t ? t->punct_id : kPunctNone) {
+    case kPunctPlus:
+    case kPunctMinus:
+    case kPunctTilde:
+    case kPunctNot:
+    case kPunctAnd:
+    case kPunctStar:
+      NextToken();
+      return CreateASTUnaryPrefixOp(t, ParseCastExpr());
+    case kPunctDec:
+    case kPunctInc:
+      NextToken();
+      return CreateASTUnaryPrefixOp(t, ParseUnaryExpr());
+    default:
+      break;
+  }
+  if ((t = ConsumeToken(kTokenKwSizeof))) {
     return CreateASTUnaryPrefixOp(t, ParseUnaryExpr());
   }
   return ParsePostfixExpr();
@@ -93,120 +106,50 @@ struct Node *ParseCastExpr() {
   return ParseUnaryExpr();
 }
 
-struct Node *ParseMulExpr() {
-  struct Node *op = ParseCastExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("*")) || (t = ConsumePunctuator("/")) ||
-         (t = ConsumePunctuator("%"))) {
-    op = CreateASTBinOp(t, op, ParseCastExpr());
-  }
-  return op;
-}
-
-struct Node *ParseAddExpr() {
-  struct Node *op = ParseMulExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("+")) || (t = ConsumePunctuator("-"))) {
-    op = CreateASTBinOp(t, op, ParseMulExpr());
-  }
-  return op;
-}
-
-struct Node *ParseShiftExpr() {
-  struct Node *op = ParseAddExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("<<")) || (t = ConsumePunctuator(">>"))) {
-    op = CreateASTBinOp(t, op, ParseAddExpr());
-  }
-  return op;
-}
-
-struct Node *ParseRelExpr() {
-  struct Node *op = ParseShiftExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("<")) || (t = ConsumePunctuator(">")) ||
-         (t = ConsumePunctuator("<=")) || (t = ConsumePunctuator(">="))) {
-    op = CreateASTBinOp(t, op, ParseShiftExpr());
-  }
-  return op;
-}
-
-struct Node *ParseEqExpr() {
-  struct Node *op = ParseRelExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("==")) || (t = ConsumePunctuator("!="))) {
-    op = CreateASTBinOp(t, op, ParseRelExpr());
-  }
-  return op;
-}
-
-struct Node *ParseAndExpr() {
-  struct Node *op = ParseEqExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("&"))) {
-    op = CreateASTBinOp(t, op, ParseEqExpr());
-  }
-  return op;
-}
-
-struct Node *ParseXorExpr() {
-  struct Node *op = ParseAndExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("^"))) {
-    op = CreateASTBinOp(t, op, ParseAndExpr());
-  }
-  return op;
-}
-
-struct Node *ParseOrExpr() {
-  struct Node *op = ParseXorExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("|"))) {
-    op = CreateASTBinOp(t, op, ParseXorExpr());
-  }
-  return op;
-}
+// Binary operators from multiplicative-expression (6.5.5) up to
+// logical-OR-expression (6.5.14) are parsed by precedence climbing
+// with this table instead of a function for each level.
+// Higher binds tighter. 0 means the token is not a binary operator.
+static const int binary_op_precedence[kNumOfPunctuators] = {
+    [kPunctStar] = 10, [kPunctSlash] = 10, [kPunctPercent] = 10,
+    [kPunctPlus] = 9,  [kPunctMinus] = 9,  [kPunctShl] = 8,
+    [kPunctShr] = 8,   [kPunctLt] = 7,     [kPunctGt] = 7,
+    [kPunctLe] = 7,    [kPunctGe] = 7,     [kPunctEq] = 6,
+    [kPunctNe] = 6,    [kPunctAnd] = 5,    [kPunctXor] = 4,
+    [kPunctOr] = 3,    [kPunctAndAnd] = 2, [kPunctOrOr] = 1,
+};
 
-struct Node *ParseBoolAndExpr() {
-  struct Node *op = ParseOrExpr();
-  if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("&&"))) {
-    op = CreateASTBinOp(t, op, ParseOrExpr());
-  }
-  return op;
+static int GetBinaryOpPrecedence(struct Node *t) {
+  return t ? binary_op_precedence[t->punct_id] : 0;
 }
 
-struct Node *ParseBoolOrExpr() {
-  struct Node *op = ParseBoolAndExpr();
+static struct Node *ParseBinaryExpr(int min_precedence) {
+  // Parses operators with precedence >= min_precedence.
+  // All of them are left-associative, so the right operand of an operator
+  // takes only operators which bind tighter than it.
+  struct Node *op = ParseCastExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("||"))) {
-    op = CreateASTBinOp(t, op, ParseBoolAndExpr());
+  int precedence;
+  while ((precedence = GetBinaryOpPrecedence(PeekToken())) >=
+         min_precedence) {
+    struct Node *t = NextToken();
+    op = CreateASTBinOp(t, op, ParseBinaryExpr(precedence + 1));
   }
   return op;
 }
 
 struct Node *ParseConditionalExpr() {
-  struct Node *expr = ParseBoolOrExpr();
+  struct Node *expr = ParseBinaryExpr(1);
   if (!expr) return NULL;
   struct Node *t;
-  if ((t = ConsumePunctuator("?"))) {
+  if ((t = ConsumePunctuator(kPunctQuestion))) {
     struct Node *op = AllocNode(kASTExpr);
     op->op = t;
     op->cond = expr;
     op->left = ParseConditionalExpr();
     if (!op->left)
       ErrorWithToken(t, "Expected true-expr for this conditional expr");
-    ExpectPunctuator(":");
+    ExpectPunctuator(kPunctColon);
     op->right = ParseConditionalExpr();
     if (!op->right)
       ErrorWithToken(t, "Expected false-expr for this conditional expr");
@@ -215,14 +158,28 @@ struct Node *ParseConditionalExpr() {
   return expr;
 }
 
+static bool IsAssignmentOp(struct Node *t) {
+  if (!t) return false;
+  switch (t->punct_id) {
+    case kPunctAssign:
+    case kPunctAddAssign:
+    case kPunctSubAssign:
+    case kPunctMulAssign:
+    case kPunctDivAssign:
+    case kPunctModAssign:
+    case kPunctShlAssign:
+    case kPunctShrAssign:
+      return true;
+    default:
+      return false;
+  }
+}
+
 struct Node *ParseAssignExpr() {
   struct Node *left = ParseConditionalExpr();
   if (!left) return NULL;
-  struct Node *t;
-  if ((t = ConsumePunctuator("=")) || (t = ConsumePunctuator("+=")) ||
-      (t = ConsumePunctuator("-=")) || (t = ConsumePunctuator("*=")) ||
-      (t = ConsumePunctuator("/=")) || (t = ConsumePunctuator("%=")) ||
-      (t = ConsumePunctuator("<<=")) || (t = ConsumePunctuator(">>="))) {
+  if (IsAssignmentOp(PeekToken())) {
+    struct Node *t = NextToken();
     struct Node *right = ParseAssignExpr();
     if (!right) ErrorWithToken(t, "Expected expr after this token");
     return CreateASTBinOp(t, left, right);
@@ -234,7 +191,7 @@ struct Node *ParseExpr() {
   struct Node *op = ParseAssignExpr();
   if (!op) return NULL;
   struct Node *t;
-  while ((t = ConsumePunctuator(","))) {
+  while ((t = ConsumePunctuator(kPunctComma))) {
     op = CreateASTBinOp(t, op, ParseAssignExpr());
   }
   return op;
@@ -243,10 +200,10 @@ struct Node *ParseExpr() {
 struct Node *ParseExprStmt() {
   struct Node *expr = ParseExpr();
   struct Node *t;
-  if ((t = ConsumePunctuator(";"))) {
+  if ((t = ConsumePunctuator(kPunctSemicolon))) {
     return CreateASTExprStmt(t, expr);
   } else if (expr) {
-    ExpectPunctuator(";");
+    ExpectPunctuator(kPunctSemicolon);
   }
   return NULL;
 }
@@ -254,10 +211,10 @@ struct Node *ParseExprStmt() {
 struct Node *ParseSelectionStmt() {
   struct Node *t;
   if ((t = ConsumeToken(kTokenKwIf))) {
-    ExpectPunctuator("(");
+    ExpectPunctuator(kPunctLParen);
     struct Node *expr = ParseExpr();
     assert(expr);
-    ExpectPunctuator(")");
+    ExpectPunctuator(kPunctRParen);
     struct Node *stmt_true = ParseStmt();
     assert(stmt_true);
     struct Node *stmt = AllocNode(kASTSelectionStmt);
@@ -277,14 +234,14 @@ struct Node *ParseJumpStmt() {
   struct Node *t;
   if ((t = ConsumeToken(kTokenKwBreak)) ||
       (t = ConsumeToken(kTokenKwContinue))) {
-    ExpectPunctuator(";");
+    ExpectPunctuator(kPunctSemicolon);
     struct Node *stmt = AllocNode(kASTJumpStmt);
     stmt->op = t;
     return stmt;
   }
   if ((t = ConsumeToken(kTokenKwReturn))) {
     struct Node *expr = ParseExpr();
-    ExpectPunctuator(";");
+    ExpectPunctuator(kPunctSemicolon);
     struct Node *stmt = AllocNode(kASTJumpStmt);
     stmt->op = t;
     stmt->right = expr;
@@ -296,14 +253,14 @@ struct Node *ParseJumpStmt() {
 struct Node *ParseIterationStmt() {
   struct Node *t;
   if ((t = ConsumeToken(kTokenKwFor))) {
-    ExpectPunctuator("(");
+    ExpectPunctuator(kPunctLParen);
     struct Node *init = ParseDeclBody();
     if (!init) init = ParseExpr();
-    ExpectPunctuator(";");
+    ExpectPunctuator(kPunctSemicolon);
     struct Node *cond = ParseExpr();
-    ExpectPunctuator(";");
+    ExpectPunctuator(kPunctSemicolon);
     struct Node *updt = ParseExpr();
-    ExpectPunctuator(")");
+    ExpectPunctuator(kPunctRParen);
     struct Node *body = ParseStmt();
     assert(body);
 
@@ -316,10 +273,10 @@ struct Node *ParseIterationStmt() {
     return stmt;
   }
   if ((t = ConsumeToken(kTokenKwWhile))) {
-    ExpectPunctuator("(");
+    ExpectPunctuator(kPunctLParen);
     struct Node *cond = ParseExpr();
     assert(cond);
-    ExpectPunctuator(")");
+    ExpectPunctuator(kPunctRParen);
     struct Node *body = ParseStmt();
     assert(body);
 
@@ -375,7 +332,8 @@ struct Node *ParseDeclSpecs() {
       continue;
     }
     // typedef name
-    struct Node *typedef_type = GetNodeByTokenKey(ord_idents, PeekToken());
+    struct Node *typedef_type =
+        GetNodeByTokenKey(compiler->ord_idents, PeekToken());
     if (typedef_type) {
       PushToList(decl_specs, typedef_type);
       NextToken();
@@ -386,13 +344,13 @@ struct Node *ParseDeclSpecs() {
       struct Node *struct_spec = AllocNode(kASTStructSpec);
       struct_spec->tag = ConsumeToken(kTokenIdent);
       assert(struct_spec->tag);
-      if (ConsumePunctuator("{")) {
+      if (ConsumePunctuator(kPunctLBrace)) {
         struct_spec->struct_member_dict = AllocList();
         struct Node *decl;
         while ((decl = ParseDecl())) {
           AddMemberOfStructFromDecl(struct_spec, decl);
         }
-        ExpectPunctuator("}");
+        ExpectPunctuator(kPunctRBrace);
       }
       PushToList(decl_specs, struct_spec);
       continue;
@@ -411,23 +369,23 @@ struct Node *ParseDirectDecltor() {
   // always allow abstract decltors
   struct Node *n = NULL;
   struct Node *t;
-  if ((t = ConsumePunctuator("("))) {
+  if ((t = ConsumePunctuator(kPunctLParen))) {
     n = AllocNode(kASTDirectDecltor);
     n->op = t;
     n->value = ParseDecltor();
     assert(n->value);
-    ExpectPunctuator(")");
+    ExpectPunctuator(kPunctRParen);
   } else if ((t = ConsumeToken(kTokenIdent))) {
     n = AllocNode(kASTDirectDecltor);
     n->op = t;
   }
   while (true) {
-    if ((t = ConsumePunctuator("("))) {
+    if ((t = ConsumePunctuator(kPunctLParen))) {
       struct Node *op = t;
       struct Node *args = AllocList();
-      if (!ConsumePunctuator(")")) {
+      if (!ConsumePunctuator(kPunctRParen)) {
         while (1) {
-          if ((t = ConsumePunctuator("..."))) {
+          if ((t = ConsumePunctuator(kPunctEllipsis))) {
             PushToList(args, t);
           } else {
             struct Node *arg = ParseParamDecl();
@@ -436,9 +394,9 @@ struct Node *ParseDirectDecltor() {
             }
             PushToList(args, arg);
           }
-          if (!ConsumePunctuator(",")) break;
+          if (!ConsumePunctuator(kPunctComma)) break;
         }
-        ExpectPunctuator(")");
+        ExpectPunctuator(kPunctRParen);
       }
       struct Node *nn = AllocNode(kASTDirectDecltor);
       nn->op = op;
@@ -446,13 +404,13 @@ struct Node *ParseDirectDecltor() {
       nn->left = n;
       n = nn;
     }
-    if ((t = ConsumePunctuator("["))) {
+    if ((t = ConsumePunctuator(kPunctLBracket))) {
       struct Node *nn = AllocNode(kASTDirectDecltor);
       nn->op = t;
       nn->right = ParseAssignExpr();
       nn->left = n;
       n = nn;
-      ExpectPunctuator("]");
+      ExpectPunctuator(kPunctRBracket);
       continue;
     }
     break;
@@ -464,7 +422,7 @@ struct Node *ParseDecltor() {
   struct Node *n = AllocNode(kASTDecltor);
   struct Node *pointer = NULL;
   struct Node *t;
-  while ((t = ConsumePunctuator("*"))) {
+  while ((t = ConsumePunctuator(kPunctStar))) {
     pointer = CreateTypePointer(pointer);
   }
   n->left = pointer;
@@ -476,7 +434,7 @@ struct Node *ParseInitDecltor() {
   struct Node *decltor = ParseDecltor();
   if (!decltor) return NULL;
   struct Node *t;
-  if (!(t = ConsumePunctuator("="))) return decltor;
+  if (!(t = ConsumePunctuator(kPunctAssign))) return decltor;
   struct Node *init_expr = ParseAssignExpr();
   assert(init_expr);
   decltor->decltor_init_expr = CreateASTBinOp(t, NULL, init_expr);
@@ -504,20 +462,20 @@ struct Node *ParseDeclBody() {
 struct Node *ParseDecl() {
   struct Node *decl_body = ParseDeclBody();
   if (!decl_body) return NULL;
-  ExpectPunctuator(";");
+  ExpectPunctuator(kPunctSemicolon);
   return decl_body;
 }
 
 struct Node *ParseCompStmt() {
   struct Node *t;
-  if (!(t = ConsumePunctuator("{"))) return NULL;
+  if (!(t = ConsumePunctuator(kPunctLBrace))) return NULL;
   struct Node *list = AllocList();
   list->op = t;
   struct Node *stmt;
   while ((stmt = ParseDecl()) || (stmt = ParseStmt())) {
     PushToList(list, stmt);
   }
-  ExpectPunctuator("}");
+  ExpectPunctuator(kPunctRBrace);
   return list;
 }
 
@@ -529,7 +487,7 @@ struct Node *ParseFuncDef(struct Node *decl_body) {
 
 void InitParser(struct Node **head_token) {
   InitTokenStream(RemoveDelimiterTokens(head_token));
-  ord_idents = AllocList();
+  compiler->ord_idents = AllocList();
 }
 
 struct Node *Parse(struct Node **head_token) {
@@ -537,7 +495,7 @@ struct Node *Parse(struct Node **head_token) {
   struct Node *list = AllocList();
   struct Node *decl_body;
   while ((decl_body = ParseDeclBody())) {
-    if (ConsumePunctuator(";")) {
+    if (ConsumePunctuator(kPunctSemicolon)) {
       PushToList(list, decl_body);
       assert(IsASTList(decl_body->op));
       if (IsASTDeclOfTypedef(decl_body)) {
@@ -545,8 +503,8 @@ struct Node *Parse(struct Node **head_token) {
         struct Node *typedef_type = CreateTypeFromDecl(decl_body);
         struct Node *typedef_name =
             GetIdentifierTokenFromTypeAttr(typedef_type);
-        PrintASTNode(typedef_name);
-        PushKeyValueToList(ord_idents, CreateTokenStr(typedef_name),
+        TRACE_AST(kTraceParse, typedef_name);
+        PushKeyValueToList(compiler->ord_idents, typedef_name->atom,
                            GetTypeWithoutAttr(typedef_type));
       }
       continue;
@@ -0,0 +1,678 @@
+#include "compilium.h"
+
+// Precompiled headers
+// The result of preprocessing a header (tokens, macros defined or removed,
+// include guards found) is written to a file which is mapped with mmap
+// when the header is included again. The file has no pointers; everything
+// refers to other parts by offsets from the beginning of the file,
+// and the token text lives in the string section of the mapping.
+// Tokens are kept in the same format in memory, and ones from a file are
+// used in place until they are applied.
+// A file is used only when the compiler flags which affect preprocessing
+// and the contents of all files read for the header are unchanged.
+// The contents are hashed only for files whose size or mtime has changed.
+// It is applied only when the macros used by the header are defined as
+// they were when it was built; preprocessor.c checks this.
+
+#define PCH_MAGIC "CMPLMPCH"
+#define PCH_VERSION 5
+#define PCH_ALIGN 8
+
+struct PCHSection {
+  unsigned int ofs;    // from the beginning of the file
+  unsigned int count;  // number of elements (bytes for strings)
+};
+
+struct PCHFileHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int header_size;
+  unsigned long flags_hash;
+  unsigned long body_hash;  // of the rest of the file, to detect corruption
+  struct PCHSection deps;          // struct PCHFileDependency
+  struct PCHSection tokens;        // struct PCHToken
+  struct PCHSection macros;        // struct PCHFileMacro
+  struct PCHSection macro_tokens;  // struct PCHToken
+  struct PCHSection guards;        // struct PCHFileGuard
+  struct PCHSection uses;          // struct PCHFileMacroUse
+  struct PCHSection atoms;         // unsigned int offsets in strings
+  struct PCHSection strings;       // NUL-terminated strings
+};
+
+struct PCHFileDependency {
+  unsigned int path_ofs;
+  unsigned int padding;
+  unsigned long hash;
+  long size;
+  long mtime_sec;
+  long mtime_nsec;
+};
+
+enum PCHMacroKind {
+  kPCHMacroObjectLike,
+  kPCHMacroFunctionLike,
+  kPCHMacroUndef,
+};
+
+struct PCHFileMacro {
+  unsigned int name_ofs;
+  int kind;  // enum PCHMacroKind
+  unsigned int first_token;  // index in macro_tokens
+  int num_of_arg_tokens;
+  int num_of_value_tokens;
+};
+
+struct PCHFileGuard {
+  unsigned int path_ofs;
+  unsigned int macro_ofs;  // 0 ("") if #pragma once
+};
+
+struct PCHFileMacroUse {
+  unsigned int name_ofs;
+  unsigned int padding;
+  unsigned long hash;
+};
+
+unsigned long CalcHash(unsigned long h, const char *s, int length) {
+  for (int i = 0; i < length; i++) {
+    h ^= (unsigned char)s[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+unsigned long CalcPCHContentHash(const char *s) {
+  return CalcHash(FNV_OFFSET_BASIS, s, strlen(s));
+}
+
+static unsigned long CalcTokenSequenceHash(unsigned long h, struct Node *t) {
+  for (; t; t = t->next_token) {
+    h = CalcHash(h, t->begin, t->length);
+    h = CalcHash(h, " ", 1);
+  }
+  return h;
+}
+
+static unsigned long CalcMacroReplacementHash(unsigned long h,
+                                              struct Node *rep) {
+  h = CalcTokenSequenceHash(CalcHash(h, "(", 1), rep->arg_expr_list);
+  return CalcTokenSequenceHash(CalcHash(h, "=", 1), rep->value);
+}
+
+unsigned long CalcPCHFlagsHash(struct Node *macro_list) {
+  // Macros defined by compiler args (e.g. __APPLE__ by --target-os) are
+  // the only flags which change the result of preprocessing.
+  // Hashes of macros are summed up since the order of the list is unstable.
+  unsigned long sum = PCH_VERSION;
+  for (int i = 0; i < GetSizeOfList(macro_list); i++) {
+    struct Node *kv = GetNodeAt(macro_list, i);
+    unsigned long h = CalcHash(FNV_OFFSET_BASIS, kv->key, strlen(kv->key));
+    sum += CalcMacroReplacementHash(h, kv->value);
+  }
+  return sum;
+}
+
+unsigned long CalcPCHMacroHash(struct Node *rep) {
+  // rep is kNodeMacroReplacement, or NULL if the macro is not defined.
+  return rep ? CalcMacroReplacementHash(FNV_OFFSET_BASIS, rep) : 0;
+}
+
+const char *CreatePCHPath(const char *header_path, unsigned long flags_hash) {
+  const char *pch_dir = compiler->options.pch_dir;
+  assert(pch_dir);
+  char name[64];
+  snprintf(name, sizeof(name), "%016lx-%016lx.pch",
+           CalcPCHContentHash(header_path), flags_hash);
+  char *path = ArenaAlloc(strlen(pch_dir) + strlen(name) + 1);
+  strcpy(path, pch_dir);
+  strcat(path, name);
+  return path;
+}
+
+// Dependencies
+
+void StatPCHDependency(struct PCHDependency *d) {
+  // Should be called before reading the file, so that a change while it is
+  // read is detected later.
+  struct stat st;
+  if (stat(d->path, &st) != 0) {
+    d->size = -1;
+    return;
+  }
+  d->size = st.st_size;
+  d->mtime = st.st_mtim;
+}
+
+static bool IsPCHDependencyUpToDate(struct PCHDependency *d) {
+  // The size and mtime of d are updated if only they have changed.
+  struct PCHDependency current = *d;
+  StatPCHDependency(&current);
+  if (current.size < 0) return false;
+  if (d->size >= 0 && current.size == d->size &&
+      current.mtime.tv_sec == d->mtime.tv_sec &&
+      current.mtime.tv_nsec == d->mtime.tv_nsec) {
+    return true;
+  }
+  const char *input = ReadFileFromPath(d->path);
+  if (!input || CalcPCHContentHash(input) != d->hash) return false;
+  d->size = current.size;
+  d->mtime = current.mtime;
+  return true;
+}
+
+// Writer
+
+struct PCHBuffer {
+  char *data;
+  unsigned int size;
+  unsigned int capacity;
+};
+
+static unsigned int AppendToPCHBuffer(struct PCHBuffer *b, const void *p,
+                                      unsigned int size) {
+  // Returns the offset of the appended data in b.
+  if (b->size + size > b->capacity) {
+    while (b->size + size > b->capacity) b->capacity = (b->capacity + 1) * 2;
+    b->data = realloc(b->data, b->capacity);
+    assert(b->data);
+  }
+  unsigned int ofs = b->size;
+  if (size) memcpy(b->data + ofs, p, size);
+  b->size += size;
+  return ofs;
+}
+
+static unsigned int AppendStrToPCHBuffer(struct PCHBuffer *strings,
+                                         const char *s, int length) {
+  unsigned int ofs = AppendToPCHBuffer(strings, s, length);
+  AppendToPCHBuffer(strings, "", 1);
+  return ofs;
+}
+
+struct PCHStringTable {
+  // Strings of a PCH being written. Atoms are stored once and numbered,
+  // so that a reader interns each of them only once.
+  struct PCHBuffer strings;
+  struct PCHBuffer atoms;     // const char *, by index
+  struct PCHBuffer atom_ofs;  // unsigned int offsets in strings, by index
+  int *slots;  // index + 1 of atoms hashed by their address, or 0
+  int num_of_slots;  // power of 2
+};
+
+static void InitPCHStringTable(struct PCHStringTable *st) {
+  *st = (struct PCHStringTable){0};
+  AppendToPCHBuffer(&st->strings, "", 1);  // offset 0 is an empty string
+}
+
+static void FreePCHStringTable(struct PCHStringTable *st) {
+  free(st->strings.data);
+  free(st->atoms.data);
+  free(st->atom_ofs.data);
+  free(st->slots);
+}
+
+static int GetNumOfPCHAtoms(struct PCHStringTable *st) {
+  return st->atoms.size / sizeof(const char *);
+}
+
+static const char *GetPCHAtom(struct PCHStringTable *st, int index) {
+  return ((const char **)st->atoms.data)[index];
+}
+
+static int *FindPCHAtomSlot(struct PCHStringTable *st, const char *atom) {
+  unsigned long v = (unsigned long)atom;
+  unsigned int mask = st->num_of_slots - 1;
+  unsigned int i = (unsigned int)((v >> 3) ^ (v >> 17)) * 2654435761u & mask;
+  while (st->slots[i] && GetPCHAtom(st, st->slots[i] - 1) != atom) {
+    i = (i + 1) & mask;
+  }
+  return &st->slots[i];
+}
+
+static int AddPCHAtom(struct PCHStringTable *st, const char *atom) {
+  // Returns the index of atom.
+  int num_of_atoms = GetNumOfPCHAtoms(st);
+  if ((num_of_atoms + 1) * 2 > st->num_of_slots) {
+    free(st->slots);
+    st->num_of_slots = st->num_of_slots ? st->num_of_slots * 2 : 256;
+    st->slots = calloc(st->num_of_slots, sizeof(int));
+    assert(st->slots);
+    for (int i = 0; i < num_of_atoms; i++) {
+      *FindPCHAtomSlot(st, GetPCHAtom(st, i)) = i + 1;
+    }
+  }
+  int *slot = FindPCHAtomSlot(st, atom);
+  if (*slot) return *slot - 1;
+  unsigned int ofs = AppendStrToPCHBuffer(&st->strings, atom, strlen(atom));
+  AppendToPCHBuffer(&st->atoms, &atom, sizeof(atom));
+  AppendToPCHBuffer(&st->atom_ofs, &ofs, sizeof(ofs));
+  *slot = num_of_atoms + 1;
+  return num_of_atoms;
+}
+
+static void AppendTokenToPCHBuffer(struct PCHBuffer *tokens,
+                                   struct PCHStringTable *st, int token_type,
+                                   int line, const char *begin, int length,
+                                   int punct_id, const char *atom) {
+  struct PCHToken pt;
+  pt.token_type = token_type;
+  pt.line = line;
+  pt.length = length;
+  pt.punct_id = punct_id;
+  pt.atom_index = atom ? AddPCHAtom(st, atom) : -1;
+  pt.begin_ofs = atom ? ((unsigned int *)st->atom_ofs.data)[pt.atom_index]
+                      : AppendStrToPCHBuffer(&st->strings, begin, length);
+  AppendToPCHBuffer(tokens, &pt, sizeof(pt));
+}
+
+static int AppendTokensToPCHBuffer(struct PCHBuffer *tokens,
+                                   struct PCHStringTable *st, struct Node *t) {
+  // Returns the number of tokens appended.
+  int count = 0;
+  for (; t; t = t->next_token) {
+    AppendTokenToPCHBuffer(tokens, st, t->token_type, t->line, t->begin,
+                           t->length, t->punct_id, t->atom);
+    count++;
+  }
+  return count;
+}
+
+static void *ArenaDup(const void *p, unsigned int size) {
+  void *copied = ArenaAlloc(size ? size : 1);
+  if (size) memcpy(copied, p, size);
+  return copied;
+}
+
+void SetPCHTokens(struct PrecompiledHeader *pch, struct Node *tokens) {
+  // Stores tokens in pch in the format of PCH files.
+  struct PCHBuffer records = {0};
+  struct PCHStringTable st;
+  InitPCHStringTable(&st);
+  pch->num_of_tokens = AppendTokensToPCHBuffer(&records, &st, tokens);
+  pch->tokens = ArenaDup(records.data, records.size);
+  pch->strings = ArenaDup(st.strings.data, st.strings.size);
+  pch->strings_size = st.strings.size;
+  pch->atoms = ArenaDup(st.atoms.data, st.atoms.size);
+  free(records.data);
+  FreePCHStringTable(&st);
+}
+
+static void AppendMacroToPCHBuffer(struct PCHBuffer *macros,
+                                   struct PCHBuffer *macro_tokens,
+                                   struct PCHStringTable *st, const char *name,
+                                   struct Node *rep) {
+  // rep is NULL for #undef.
+  struct PCHFileMacro fm;
+  fm.name_ofs = AppendStrToPCHBuffer(&st->strings, name, strlen(name));
+  fm.first_token = macro_tokens->size / sizeof(struct PCHToken);
+  fm.kind = !rep                  ? kPCHMacroUndef
+            : rep->arg_expr_list ? kPCHMacroFunctionLike
+                                 : kPCHMacroObjectLike;
+  fm.num_of_arg_tokens =
+      rep ? AppendTokensToPCHBuffer(macro_tokens, st, rep->arg_expr_list) : 0;
+  fm.num_of_value_tokens =
+      rep ? AppendTokensToPCHBuffer(macro_tokens, st, rep->value) : 0;
+  AppendToPCHBuffer(macros, &fm, sizeof(fm));
+}
+
+static void AppendSection(struct PCHBuffer *file, struct PCHSection *section,
+                          struct PCHBuffer *b, unsigned int elem_size) {
+  static const char zeros[PCH_ALIGN];
+  AppendToPCHBuffer(file, zeros,
+                    (PCH_ALIGN - file->size % PCH_ALIGN) % PCH_ALIGN);
+  section->ofs = AppendToPCHBuffer(file, b->data, b->size);
+  section->count = b->size / elem_size;
+}
+
+bool WritePCH(const char *pch_path, struct PrecompiledHeader *pch,
+              unsigned long flags_hash) {
+  // Returns false if the file could not be written.
+  struct PCHBuffer deps = {0}, tokens = {0}, macros = {0}, macro_tokens = {0},
+                   guards = {0}, uses = {0};
+  struct PCHStringTable st;
+  InitPCHStringTable(&st);
+
+  for (struct PCHDependency *d = pch->deps; d; d = d->next) {
+    struct PCHFileDependency fd = {0};
+    fd.path_ofs = AppendStrToPCHBuffer(&st.strings, d->path, strlen(d->path));
+    fd.hash = d->hash;
+    fd.size = d->size;
+    fd.mtime_sec = d->mtime.tv_sec;
+    fd.mtime_nsec = d->mtime.tv_nsec;
+    AppendToPCHBuffer(&deps, &fd, sizeof(fd));
+  }
+  for (int i = 0; i < pch->num_of_tokens; i++) {
+    const struct PCHToken *pt = &pch->tokens[i];
+    AppendTokenToPCHBuffer(
+        &tokens, &st, pt->token_type, pt->line, pch->strings + pt->begin_ofs,
+        pt->length, pt->punct_id,
+        pt->atom_index >= 0 ? pch->atoms[pt->atom_index] : NULL);
+  }
+  for (int i = 0; i < GetSizeOfList(pch->macros); i++) {
+    struct Node *kv = GetNodeAt(pch->macros, i);
+    AppendMacroToPCHBuffer(&macros, &macro_tokens, &st, kv->key, kv->value);
+  }
+  for (struct Node *t = pch->undefs; t; t = t->next_token) {
+    AppendMacroToPCHBuffer(&macros, &macro_tokens, &st, t->atom, NULL);
+  }
+  for (struct IncludeGuard *g = pch->guards; g; g = g->next) {
+    struct PCHFileGuard fg;
+    fg.path_ofs = AppendStrToPCHBuffer(&st.strings, g->path, strlen(g->path));
+    fg.macro_ofs = g->macro ? AppendStrToPCHBuffer(&st.strings, g->macro,
+                                                   strlen(g->macro))
+                            : 0;
+    AppendToPCHBuffer(&guards, &fg, sizeof(fg));
+  }
+  for (struct PCHMacroUse *u = pch->uses; u; u = u->next) {
+    struct PCHFileMacroUse fu = {0};
+    fu.name_ofs = AppendStrToPCHBuffer(&st.strings, u->name, strlen(u->name));
+    fu.hash = u->hash;
+    AppendToPCHBuffer(&uses, &fu, sizeof(fu));
+  }
+
+  struct PCHFileHeader header = {0};
+  memcpy(header.magic, PCH_MAGIC, sizeof(header.magic));
+  header.version = PCH_VERSION;
+  header.header_size = sizeof(header);
+  header.flags_hash = flags_hash;
+  struct PCHBuffer file = {0};
+  AppendToPCHBuffer(&file, &header, sizeof(header));
+  AppendSection(&file, &header.deps, &deps, sizeof(struct PCHFileDependency));
+  AppendSection(&file, &header.tokens, &tokens, sizeof(struct PCHToken));
+  AppendSection(&file, &header.macros, &macros, sizeof(struct PCHFileMacro));
+  AppendSection(&file, &header.macro_tokens, &macro_tokens,
+                sizeof(struct PCHToken));
+  AppendSection(&file, &header.guards, &guards, sizeof(struct PCHFileGuard));
+  AppendSection(&file, &header.uses, &uses, sizeof(struct PCHFileMacroUse));
+  AppendSection(&file, &header.atoms, &st.atom_ofs, sizeof(unsigned int));
+  AppendSection(&file, &header.strings, &st.strings, 1);
+  header.body_hash = CalcHash(FNV_OFFSET_BASIS, file.data + sizeof(header),
+                              file.size - sizeof(header));
+  memcpy(file.data, &header, sizeof(header));
+  free(deps.data);
+  free(tokens.data);
+  free(macros.data);
+  free(macro_tokens.data);
+  free(guards.data);
+  free(uses.data);
+  FreePCHStringTable(&st);
+
+  // Write to a temporary file and rename it so that other compilers
+  // reading the same directory never see a partially written file.
+  // The address of the context tells compilations on threads apart.
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%lx.tmp", pch_path, getpid(),
+           (unsigned long)compiler);
+  FILE *fp = fopen(tmp_path, "wb");
+  bool is_written = false;
+  if (fp) {
+    is_written = fwrite(file.data, 1, file.size, fp) == file.size;
+    is_written = fclose(fp) == 0 && is_written;
+    is_written = is_written && rename(tmp_path, pch_path) == 0;
+    if (!is_written) remove(tmp_path);
+  }
+  free(file.data);
+  return is_written;
+}
+
+// Reader
+
+struct PCHMapping {
+  void *addr;
+  size_t size;
+  struct PCHMapping *next;
+};
+
+static const void *GetPCHSection(const char *file, size_t file_size,
+                                 struct PCHSection *section,
+                                 size_t elem_size) {
+  // Returns NULL if the section is out of the file.
+  if (section->ofs % PCH_ALIGN) return NULL;
+  if (section->ofs > file_size) return NULL;
+  if ((file_size - section->ofs) / elem_size < section->count) return NULL;
+  return file + section->ofs;
+}
+
+static const char *GetPCHString(struct PrecompiledHeader *pch,
+                                unsigned int ofs) {
+  // The string section ends with NUL, so any offset in it is terminated.
+  return ofs < pch->strings_size ? pch->strings + ofs : NULL;
+}
+
+static bool AreValidPCHTokens(struct PrecompiledHeader *pch,
+                              const struct PCHToken *pt, int count,
+                              int num_of_atoms) {
+  for (int i = 0; i < count; i++) {
+    if (pt[i].begin_ofs >= pch->strings_size || pt[i].length < 0 ||
+        (unsigned int)pt[i].length >= pch->strings_size - pt[i].begin_ofs ||
+        pt[i].token_type < 0 || pt[i].token_type > kTokenPCHIncludeEnd ||
+        pt[i].punct_id < kPunctNone || pt[i].punct_id >= kNumOfPunctuators ||
+        pt[i].atom_index < -1 || pt[i].atom_index >= num_of_atoms ||
+        (pt[i].token_type == kTokenPCHIncludeBegin && pt[i].atom_index < 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Node *CreateTokenFromPCH(struct PrecompiledHeader *pch,
+                                const struct PCHToken *pt) {
+  struct Node *t = AllocToken(pt->line, pch->strings + pt->begin_ofs,
+                              pt->length, (enum TokenType)pt->token_type);
+  t->punct_id = (enum PunctuatorID)pt->punct_id;
+  if (pt->atom_index >= 0) t->atom = pch->atoms[pt->atom_index];
+  return t;
+}
+
+static struct Node *CreateTokensFromPCH(struct PrecompiledHeader *pch,
+                                        const struct PCHToken *pt,
+                                        int count) {
+  struct Node *head = NULL;
+  struct Node **last_holder = &head;
+  for (int i = 0; i < count; i++) {
+    *last_holder = CreateTokenFromPCH(pch, &pt[i]);
+    last_holder = &(*last_holder)->next_token;
+  }
+  return head;
+}
+
+static struct PrecompiledHeader *ReadPCH(const char *file, size_t file_size,
+                                         const char *header_path,
+                                         unsigned long flags_hash) {
+  // Returns NULL if the file is broken or stale.
+  // Tokens of the returned PCH are the records in file.
+  struct PCHFileHeader header;
+  if (file_size < sizeof(header)) return NULL;
+  memcpy(&header, file, sizeof(header));
+  if (memcmp(header.magic, PCH_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != PCH_VERSION || header.header_size != sizeof(header) ||
+      header.flags_hash != flags_hash ||
+      header.body_hash != CalcHash(FNV_OFFSET_BASIS, file + sizeof(header),
+                                   file_size - sizeof(header))) {
+    return NULL;
+  }
+  const struct PCHFileDependency *deps = GetPCHSection(
+      file, file_size, &header.deps, sizeof(struct PCHFileDependency));
+  const struct PCHToken *tokens = GetPCHSection(file, file_size, &header.tokens,
+                                                sizeof(struct PCHToken));
+  const struct PCHFileMacro *macros = GetPCHSection(
+      file, file_size, &header.macros, sizeof(struct PCHFileMacro));
+  const struct PCHToken *macro_tokens = GetPCHSection(
+      file, file_size, &header.macro_tokens, sizeof(struct PCHToken));
+  const struct PCHFileGuard *guards = GetPCHSection(
+      file, file_size, &header.guards, sizeof(struct PCHFileGuard));
+  const struct PCHFileMacroUse *uses = GetPCHSection(
+      file, file_size, &header.uses, sizeof(struct PCHFileMacroUse));
+  const unsigned int *atoms =
+      GetPCHSection(file, file_size, &header.atoms, sizeof(unsigned int));
+  const char *strings = GetPCHSection(file, file_size, &header.strings, 1);
+  if (!deps || !tokens || !macros || !macro_tokens || !guards || !uses ||
+      !atoms || !strings || !header.strings.count ||
+      strings[header.strings.count - 1] || !header.deps.count) {
+    return NULL;
+  }
+
+  struct PrecompiledHeader *pch = ArenaAlloc(sizeof(struct PrecompiledHeader));
+  pch->strings = strings;
+  pch->strings_size = header.strings.count;
+  struct PCHDependency **dep_last_holder = &pch->deps;
+  for (unsigned int i = 0; i < header.deps.count; i++) {
+    const char *path = GetPCHString(pch, deps[i].path_ofs);
+    if (!path || (i == 0 && strcmp(path, header_path) != 0)) return NULL;
+    struct PCHDependency *d = ArenaAlloc(sizeof(struct PCHDependency));
+    d->path = InternCStr(path);
+    d->hash = deps[i].hash;
+    d->size = deps[i].size;
+    d->mtime.tv_sec = deps[i].mtime_sec;
+    d->mtime.tv_nsec = deps[i].mtime_nsec;
+    if (!IsPCHDependencyUpToDate(d)) return NULL;
+    *dep_last_holder = d;
+    dep_last_holder = &d->next;
+  }
+
+  // Each atom is interned once, not for each token.
+  pch->atoms = ArenaAlloc(sizeof(const char *) * (header.atoms.count + 1));
+  for (unsigned int i = 0; i < header.atoms.count; i++) {
+    const char *atom = GetPCHString(pch, atoms[i]);
+    if (!atom) return NULL;
+    pch->atoms[i] = InternCStr(atom);
+  }
+  if (!AreValidPCHTokens(pch, tokens, header.tokens.count,
+                         header.atoms.count) ||
+      !AreValidPCHTokens(pch, macro_tokens, header.macro_tokens.count,
+                         header.atoms.count)) {
+    return NULL;
+  }
+  pch->tokens = tokens;
+  pch->num_of_tokens = header.tokens.count;
+
+  pch->macros = AllocList();
+  struct Node **undef_last_holder = &pch->undefs;
+  for (unsigned int i = 0; i < header.macros.count; i++) {
+    const struct PCHFileMacro *fm = &macros[i];
+    const char *name = GetPCHString(pch, fm->name_ofs);
+    if (!name || fm->num_of_arg_tokens < 0 || fm->num_of_value_tokens < 0 ||
+        fm->first_token > header.macro_tokens.count ||
+        header.macro_tokens.count - fm->first_token <
+            (unsigned int)fm->num_of_arg_tokens + fm->num_of_value_tokens) {
+      return NULL;
+    }
+    if (fm->kind == kPCHMacroUndef) {
+      *undef_last_holder = CreateToken(name);
+      undef_last_holder = &(*undef_last_holder)->next_token;
+      continue;
+    }
+    const struct PCHToken *pt = &macro_tokens[fm->first_token];
+    struct Node *args = CreateTokensFromPCH(pch, pt, fm->num_of_arg_tokens);
+    struct Node *value = CreateTokensFromPCH(pch, pt + fm->num_of_arg_tokens,
+                                             fm->num_of_value_tokens);
+    if (fm->kind == kPCHMacroFunctionLike && !args) return NULL;
+    PushKeyValueToList(pch->macros, name, CreateMacroReplacement(args, value));
+  }
+  struct IncludeGuard **guard_last_holder = &pch->guards;
+  for (unsigned int i = 0; i < header.guards.count; i++) {
+    const char *path = GetPCHString(pch, guards[i].path_ofs);
+    const char *macro = GetPCHString(pch, guards[i].macro_ofs);
+    if (!path || !macro) return NULL;
+    struct IncludeGuard *g = ArenaAlloc(sizeof(struct IncludeGuard));
+    g->path = InternCStr(path);
+    g->macro = *macro ? InternCStr(macro) : NULL;
+    *guard_last_holder = g;
+    guard_last_holder = &g->next;
+  }
+  struct PCHMacroUse **use_last_holder = &pch->uses;
+  for (unsigned int i = 0; i < header.uses.count; i++) {
+    const char *name = GetPCHString(pch, uses[i].name_ofs);
+    if (!name) return NULL;
+    struct PCHMacroUse *u = ArenaAlloc(sizeof(struct PCHMacroUse));
+    u->name = InternCStr(name);
+    u->hash = uses[i].hash;
+    *use_last_holder = u;
+    use_last_holder = &u->next;
+  }
+  return pch;
+}
+
+struct PrecompiledHeader *LoadPCH(const char *pch_path,
+                                  const char *header_path,
+                                  unsigned long flags_hash) {
+  // Returns NULL if there is no valid PCH for header_path at pch_path.
+  // Tokens of the returned PCH point into the mapping of the file,
+  // which is kept until ReleasePCH() is called.
+  FILE *fp = fopen(pch_path, "rb");
+  if (!fp) return NULL;
+  long size = 0;
+  void *addr = MAP_FAILED;
+  if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0) {
+    addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  }
+  fclose(fp);
+  if (addr == MAP_FAILED) return NULL;
+  struct PrecompiledHeader *pch = ReadPCH(addr, size, header_path, flags_hash);
+  if (!pch) {
+    munmap(addr, size);
+    return NULL;
+  }
+  struct PCHMapping *m = ArenaAlloc(sizeof(struct PCHMapping));
+  m->addr = addr;
+  m->size = size;
+  m->next = compiler->pch_mappings;
+  compiler->pch_mappings = m;
+  return pch;
+}
+
+void ReleasePCH(void) {
+  // Mappings are recorded in an arena, so this should be called
+  // before ReleaseAllArenas().
+  for (struct PCHMapping *m = compiler->pch_mappings; m; m = m->next) {
+    munmap(m->addr, m->size);
+  }
+  compiler->pch_mappings = NULL;
+}
+
+// In-memory cache
+// The compile server keeps PCHs in kArenaCache between compilations, so
+// that they are neither loaded nor built again while the files which they
+// depend on are not changed.
+
+struct CachedPCH {
+  const char *header_path;  // atom of the resolved path
+  unsigned long flags_hash;
+  struct PrecompiledHeader *pch;
+  struct CachedPCH *next;
+};
+
+static bool IsPCHUpToDate(struct PrecompiledHeader *pch) {
+  for (struct PCHDependency *d = pch->deps; d; d = d->next) {
+    if (!IsPCHDependencyUpToDate(d)) return false;
+  }
+  return true;
+}
+
+struct PrecompiledHeader *FindCachedPCH(const char *header_path,
+                                        unsigned long flags_hash) {
+  // Returns NULL if the PCH is not cached or is stale.
+  for (struct CachedPCH *e = compiler->cached_pchs; e; e = e->next) {
+    if (e->header_path != header_path || e->flags_hash != flags_hash) continue;
+    return IsPCHUpToDate(e->pch) ? e->pch : NULL;
+  }
+  return NULL;
+}
+
+void AddCachedPCH(const char *header_path, unsigned long flags_hash,
+                  struct PrecompiledHeader *pch) {
+  // pch should be allocated in kArenaCache. It replaces the stale one.
+  for (struct CachedPCH *e = compiler->cached_pchs; e; e = e->next) {
+    if (e->header_path != header_path || e->flags_hash != flags_hash) continue;
+    e->pch = pch;
+    return;
+  }
+  enum ArenaKind prev_arena = SetCurrentArena(kArenaCache);
+  struct CachedPCH *e = ArenaAlloc(sizeof(struct CachedPCH));
+  SetCurrentArena(prev_arena);
+  e->header_path = header_path;
+  e->flags_hash = flags_hash;
+  e->pch = pch;
+  e->next = compiler->cached_pchs;
+  compiler->cached_pchs = e;
+}
@@ -14,18 +14,28 @@ static const char *CreateStrFromTokenRange(struct Node *begin,
   for (struct Node *t = begin; t && t != end; t = t->next_token) {
     len += t->length;
   }
-  return strndup(begin->begin, len);
+  return ArenaStrndup(begin->begin, len);
 }
 
 static void PreprocessRemoveBlock(void) {
+  // Removes tokens until #else or #endif which matches with the current block.
+  int depth = 0;
   for (struct Node *t = PeekToken(); t; t = t->next_token) {
-    if (!IsEqualTokenWithCStr(t, "#")) {
+    if (!IsPunctuator(t, kPunctHash)) {
       continue;
     }
     t = SkipDelimiterTokensInLogicalLine(t->next_token);
+    if (IsEqualTokenWithCStr(t, "ifdef") || IsEqualTokenWithCStr(t, "ifndef")) {
+      depth++;
+      continue;
+    }
     if (!IsEqualTokenWithCStr(t, "endif") && !IsEqualTokenWithCStr(t, "else")) {
       continue;
     }
+    if (depth) {
+      if (IsEqualTokenWithCStr(t, "endif")) depth--;
+      continue;
+    }
     RemoveTokensTo(t);
     break;
   }
@@ -36,20 +46,20 @@ static struct Node *TryReadIdentListWrappedByParens(struct Node **tp) {
   // ident_list without commas and tp is advanced to next token.
   // If not, this function returns NULL and tp is unchanged.
   struct Node *t = *tp;
-  if (!IsEqualTokenWithCStr(t, "(")) {
+  if (!IsPunctuator(t, kPunctLParen)) {
     return NULL;
   }
   struct Node *ident_list_head = NULL;
   struct Node **ident_list_last_holder = &ident_list_head;
   for (t = SkipDelimiterTokensInLogicalLine(t->next_token); t;
        t = SkipDelimiterTokensInLogicalLine(t->next_token)) {
-    if (IsEqualTokenWithCStr(t, ")")) break;
+    if (IsPunctuator(t, kPunctRParen)) break;
     *ident_list_last_holder = DuplicateToken(t);
     ident_list_last_holder = &(*ident_list_last_holder)->next_token;
     t = SkipDelimiterTokensInLogicalLine(t->next_token);
-    if (!IsEqualTokenWithCStr(t, ",")) break;
+    if (!IsPunctuator(t, kPunctComma)) break;
   }
-  if (!IsEqualTokenWithCStr(t, ")")) {
+  if (!IsPunctuator(t, kPunctRParen)) {
     return NULL;
   }
   // To distinguish function-like macro with zero args and
@@ -60,28 +70,462 @@ static struct Node *TryReadIdentListWrappedByParens(struct Node **tp) {
   return ident_list_head;
 }
 
+// Multiple-include optimization
+// Files which are wrapped entirely by #ifndef X / #define X ... #endif,
+// or which contain #pragma once, are recorded with their resolved path.
+// Including them again is skipped without reading the file when
+// the guard macro is still defined (or always for #pragma once).
+
+#define INCLUDE_GUARD_TABLE_SIZE 256
+
+static struct IncludeGuard **AllocIncludeGuardTable(void) {
+  return ArenaAlloc(sizeof(struct IncludeGuard *) * INCLUDE_GUARD_TABLE_SIZE);
+}
+
+static struct IncludeGuard **GetIncludeGuardBucket(const char *path) {
+  unsigned long v = (unsigned long)path;
+  unsigned int hash = (unsigned int)((v >> 3) ^ (v >> 17)) * 2654435761u;
+  return &compiler->include_guards[hash % INCLUDE_GUARD_TABLE_SIZE];
+}
+
+static struct IncludeGuard *FindIncludeGuard(const char *path) {
+  for (struct IncludeGuard *g = *GetIncludeGuardBucket(path); g; g = g->next) {
+    if (g->path == path) return g;
+  }
+  return NULL;
+}
+
+static void AddIncludeGuard(const char *path, const char *macro) {
+  struct IncludeGuard **bucket = GetIncludeGuardBucket(path);
+  struct IncludeGuard *g = ArenaAlloc(sizeof(struct IncludeGuard));
+  g->path = path;
+  g->macro = macro;
+  g->next = *bucket;
+  *bucket = g;
+}
+
+static const char *ResolveIncludePath(const char *path) {
+  // Returns an atom of the canonical path, to identify the same file
+  // included by different names.
+  char *resolved = realpath(path, NULL);
+  if (!resolved) return InternCStr(path);
+  const char *atom = InternCStr(resolved);
+  free(resolved);
+  return atom;
+}
+
+static struct Node *SkipToNextLine(struct Node *t) {
+  while (t && !IsEqualTokenWithCStr(t, "\n")) t = t->next_token;
+  return t ? t->next_token : NULL;
+}
+
+static const char *FindIncludeGuardMacro(struct Node *t,
+                                         bool *has_pragma_once) {
+  // Returns the atom of X if the whole of tokens t is wrapped by
+  // #ifndef X / #define X ... #endif, or NULL if not.
+  // Sets *has_pragma_once if t contains #pragma once.
+  const char *macro = NULL;
+  bool is_guarded = true;
+  bool expect_define = false;
+  bool is_closed = false;
+  int depth = 0;
+  bool is_line_begin = true;
+  while (t) {
+    if (IsTokenWithType(t, kTokenBlockCommentBegin)) {
+      while (t && !IsTokenWithType(t, kTokenBlockCommentEnd)) t = t->next_token;
+      if (t) t = t->next_token;
+      continue;
+    }
+    if (IsTokenWithType(t, kTokenLineComment)) {
+      while (t && !IsEqualTokenWithCStr(t, "\n")) t = t->next_token;
+      continue;
+    }
+    if (IsTokenWithType(t, kTokenDelimiter)) {
+      if (IsEqualTokenWithCStr(t, "\n")) is_line_begin = true;
+      t = t->next_token;
+      continue;
+    }
+    if (!is_line_begin || !IsPunctuator(t, kPunctHash)) {
+      // Tokens outside of #ifndef X ... #endif, or before #define X
+      if (depth == 0 || expect_define) is_guarded = false;
+      is_line_begin = false;
+      t = t->next_token;
+      continue;
+    }
+    struct Node *directive = SkipDelimiterTokensInLogicalLine(t->next_token);
+    struct Node *arg =
+        directive ? SkipDelimiterTokensInLogicalLine(directive->next_token)
+                  : NULL;
+    const char *arg_atom = arg ? arg->atom : NULL;
+    if (IsEqualTokenWithCStr(directive, "pragma") &&
+        IsEqualTokenWithCStr(arg, "once")) {
+      *has_pragma_once = true;
+    } else if (expect_define) {
+      expect_define = false;
+      if (!IsEqualTokenWithCStr(directive, "define") || arg_atom != macro)
+        is_guarded = false;
+    } else if (IsEqualTokenWithCStr(directive, "ifdef") ||
+               IsEqualTokenWithCStr(directive, "ifndef")) {
+      if (depth == 0) {
+        if (macro || is_closed || !IsEqualTokenWithCStr(directive, "ifndef") ||
+            !arg_atom) {
+          is_guarded = false;
+        }
+        macro = arg_atom;
+        expect_define = true;
+      }
+      depth++;
+    } else if (IsEqualTokenWithCStr(directive, "endif")) {
+      depth--;
+      if (depth == 0) is_closed = true;
+      if (depth < 0) is_guarded = false;
+    } else if (IsEqualTokenWithCStr(directive, "else")) {
+      if (depth == 1) is_guarded = false;
+    } else if (depth == 0) {
+      is_guarded = false;
+    }
+    t = SkipToNextLine(t);
+    is_line_begin = true;
+  }
+  return is_guarded && is_closed ? macro : NULL;
+}
+
+static bool ShouldSkipInclude(struct MacroTable *macros, const char *path) {
+  struct IncludeGuard *g = FindIncludeGuard(path);
+  if (!g) return false;
+  if (!g->macro) return true;
+  return FindMacroByName(macros, g->macro) != NULL;
+}
+
+static void RecordIncludeGuard(const char *path, struct Node *tokens) {
+  // tokens are the contents of the file at path before preprocessing.
+  if (FindIncludeGuard(path)) return;
+  bool has_pragma_once = false;
+  const char *macro = FindIncludeGuardMacro(tokens, &has_pragma_once);
+  if (has_pragma_once) {
+    AddIncludeGuard(path, NULL);
+  } else if (macro) {
+    AddIncludeGuard(path, macro);
+  }
+}
+
+// Precompiled headers
+// Headers included with <...> are preprocessed on their own, only with
+// the macros defined by compiler args, so that the result can be reused
+// by any translation unit compiled with the same flags. The result is
+// cached in --pch-dir and loaded instead of reading and preprocessing
+// the header again. The compile server also keeps them in memory.
+// While a PCH is built, macros which the header looks up before defining
+// them are recorded in its uses with their definitions at that time.
+// A PCH is applied only if they are still defined in the same way, and
+// the header is preprocessed as usual otherwise, so that the result is
+// the same as without the cache.
+// Files included by a header are kept in its PCH between
+// kTokenPCHIncludeBegin/End, and skipped when the PCH is applied after
+// the file has been included already, as an #include of them would be.
+// Their guard macros are tested there, so they are not in the uses.
+
+static bool IsPCHEnabled(void) {
+  return compiler->options.pch_dir || compiler->keeps_caches;
+}
+
+static void MarkMacroAsSeenByPCH(const char *name) {
+  // Lookups of name after this do not depend on the macros outside of
+  // the header being built.
+  if (!compiler->building_pch) return;
+  DefineMacro(compiler->pch_seen_macros, name,
+              CreateMacroReplacement(NULL, NULL));
+}
+
+static void RecordPCHMacroUse(struct MacroTable *macros, const char *name) {
+  assert(compiler->building_pch);
+  if (FindMacroByName(compiler->pch_seen_macros, name)) return;
+  MarkMacroAsSeenByPCH(name);
+  struct PCHMacroUse *u = ArenaAlloc(sizeof(struct PCHMacroUse));
+  u->name = name;
+  u->hash = CalcPCHMacroHash(FindMacroByName(macros, name));
+  u->next = compiler->building_pch->uses;
+  compiler->building_pch->uses = u;
+}
+
+static struct Node *LookupMacro(struct MacroTable *macros, struct Node *t) {
+  // FindMacro, which also records the use while building a PCH.
+  if (compiler->building_pch && IsToken(t) && t->atom &&
+      !IsTokenWithType(t, kTokenPCHIncludeBegin)) {
+    RecordPCHMacroUse(macros, t->atom);
+  }
+  return FindMacro(macros, t);
+}
+
+static bool IsPCHApplicable(struct MacroTable *macros,
+                            struct PrecompiledHeader *pch) {
+  for (struct PCHMacroUse *u = pch->uses; u; u = u->next) {
+    if (CalcPCHMacroHash(FindMacroByName(macros, u->name)) != u->hash)
+      return false;
+  }
+  return true;
+}
+
+static bool ShouldSkipPCHInclude(struct MacroTable *macros,
+                                 struct PrecompiledHeader *pch,
+                                 const char *path) {
+  // path is a file included by the header of pch.
+  if (ShouldSkipInclude(macros, path)) return true;
+  for (struct IncludeGuard *g = pch->guards; g; g = g->next) {
+    if (g->path == path && g->macro)
+      return FindMacroByName(macros, g->macro) != NULL;
+  }
+  return false;
+}
+
+static void AddPCHDependency(struct PrecompiledHeader *pch,
+                             const struct PCHDependency *dep) {
+  struct PCHDependency **last_holder = &pch->deps;
+  while (*last_holder) last_holder = &(*last_holder)->next;
+  struct PCHDependency *d = ArenaAlloc(sizeof(struct PCHDependency));
+  *d = *dep;
+  d->next = NULL;
+  *last_holder = d;
+}
+
+static const char *ReadPCHDependency(struct PrecompiledHeader *pch,
+                                     const char *path,
+                                     const char *resolved_path) {
+  // Reads the file at path, which pch depends on.
+  // Returns NULL if the file could not be opened.
+  struct PCHDependency d = {0};
+  d.path = resolved_path;
+  StatPCHDependency(&d);
+  const char *input = ReadFileFromPath(path);
+  if (!input) return NULL;
+  d.hash = CalcPCHContentHash(input);
+  AddPCHDependency(pch, &d);
+  return input;
+}
+
+static struct Node *CreatePCHIncludeBegin(const char *path) {
+  // path should be the resolved path atom of the included file.
+  struct Node *t = AllocToken(0, path, strlen(path), kTokenPCHIncludeBegin);
+  t->atom = path;
+  return t;
+}
+
+static struct Node *WrapWithPCHIncludeMarkers(const char *path,
+                                              struct Node *tokens) {
+  struct Node *begin = CreatePCHIncludeBegin(path);
+  struct Node **last_holder = &begin->next_token;
+  *last_holder = tokens;
+  while (*last_holder) last_holder = &(*last_holder)->next_token;
+  *last_holder = AllocToken(0, "", 0, kTokenPCHIncludeEnd);
+  return begin;
+}
+
+static int SkipPCHIncludeRegion(struct PrecompiledHeader *pch, int i) {
+  // Returns the index of kTokenPCHIncludeEnd which matches with
+  // kTokenPCHIncludeBegin at i.
+  int depth = 0;
+  for (; i < pch->num_of_tokens; i++) {
+    if (pch->tokens[i].token_type == kTokenPCHIncludeBegin) {
+      depth++;
+    } else if (pch->tokens[i].token_type == kTokenPCHIncludeEnd &&
+               --depth == 0) {
+      break;
+    }
+  }
+  return i;
+}
+
+static void PreprocessBlock(struct MacroTable *macros, int level);
+
+static struct PrecompiledHeader *BuildPCH(const char *path,
+                                          const char *resolved_path,
+                                          struct Node *token_include) {
+  struct PrecompiledHeader *pch = ArenaAlloc(sizeof(struct PrecompiledHeader));
+  const char *input = ReadPCHDependency(pch, path, resolved_path);
+  if (!input) ErrorWithToken(token_include, "File not found: %s", path);
+  struct Node *tokens = Tokenize(input);
+
+  struct PrecompiledHeader *saved_building_pch = compiler->building_pch;
+  struct IncludeGuard **saved_include_guards = compiler->include_guards;
+  struct MacroTable *saved_pch_seen_macros = compiler->pch_seen_macros;
+  struct Node **saved_pos = GetTokenStreamPos();
+  compiler->building_pch = pch;
+  compiler->pch_seen_macros = AllocMacroTable();
+  compiler->include_guards = AllocIncludeGuardTable();
+  RecordIncludeGuard(resolved_path, tokens);
+  struct MacroTable *macros = AllocMacroTable();
+  for (int i = 0; i < GetSizeOfList(compiler->predefined_macro_list); i++) {
+    struct Node *kv = GetNodeAt(compiler->predefined_macro_list, i);
+    DefineMacro(macros, kv->key, kv->value);
+  }
+  InitTokenStream(&tokens);
+  PreprocessBlock(macros, 0);
+  SetPCHTokens(pch, tokens);
+
+  // Keep only the differences from the predefined macros.
+  pch->macros = AllocList();
+  struct Node *macro_list = CreateMacroList(macros);
+  for (int i = 0; i < GetSizeOfList(macro_list); i++) {
+    struct Node *kv = GetNodeAt(macro_list, i);
+    if (FindMacroByName(compiler->predefined_macros, kv->key) == kv->value)
+      continue;
+    PushKeyValueToList(pch->macros, kv->key, kv->value);
+  }
+  struct Node **undef_last_holder = &pch->undefs;
+  for (int i = 0; i < GetSizeOfList(compiler->predefined_macro_list); i++) {
+    struct Node *kv = GetNodeAt(compiler->predefined_macro_list, i);
+    if (FindMacroByName(macros, kv->key)) continue;
+    *undef_last_holder = CreateToken(kv->key);
+    undef_last_holder = &(*undef_last_holder)->next_token;
+  }
+  for (int i = 0; i < INCLUDE_GUARD_TABLE_SIZE; i++) {
+    for (struct IncludeGuard *g = compiler->include_guards[i]; g; g = g->next) {
+      struct IncludeGuard *copied = ArenaAlloc(sizeof(struct IncludeGuard));
+      copied->path = g->path;
+      copied->macro = g->macro;
+      copied->next = pch->guards;
+      pch->guards = copied;
+    }
+  }
+
+  InitTokenStream(saved_pos);
+  compiler->include_guards = saved_include_guards;
+  compiler->building_pch = saved_building_pch;
+  compiler->pch_seen_macros = saved_pch_seen_macros;
+  return pch;
+}
+
+static struct PrecompiledHeader *LoadOrBuildPCH(const char *path,
+                                                const char *resolved_path,
+                                                struct Node *token_include) {
+  if (!compiler->options.pch_dir) {
+    return BuildPCH(path, resolved_path, token_include);
+  }
+  const char *pch_path = CreatePCHPath(resolved_path, compiler->pch_flags_hash);
+  struct PrecompiledHeader *pch =
+      LoadPCH(pch_path, resolved_path, compiler->pch_flags_hash);
+  if (pch) {
+    TRACE(kTracePreprocess, "PCH loaded: %s for %s\n", pch_path, path);
+    return pch;
+  }
+  pch = BuildPCH(path, resolved_path, token_include);
+  if (WritePCH(pch_path, pch, compiler->pch_flags_hash)) {
+    TRACE(kTracePreprocess, "PCH written: %s for %s\n", pch_path, path);
+  } else {
+    fprintf(stderr, "Failed to write PCH: %s\n", pch_path);
+  }
+  return pch;
+}
+
+static struct PrecompiledHeader *GetPCH(const char *path,
+                                        const char *resolved_path,
+                                        struct Node *token_include) {
+  if (!compiler->keeps_caches) {
+    return LoadOrBuildPCH(path, resolved_path, token_include);
+  }
+  struct PrecompiledHeader *pch =
+      FindCachedPCH(resolved_path, compiler->pch_flags_hash);
+  if (pch) {
+    TRACE(kTracePreprocess, "PCH cached: %s\n", path);
+    return pch;
+  }
+  enum ArenaKind prev_arena = SetCurrentArena(kArenaCache);
+  pch = LoadOrBuildPCH(path, resolved_path, token_include);
+  SetCurrentArena(prev_arena);
+  AddCachedPCH(resolved_path, compiler->pch_flags_hash, pch);
+  return pch;
+}
+
+static void ApplyPCH(struct MacroTable *macros, struct PrecompiledHeader *pch,
+                     const char *resolved_path) {
+  // The tokens are created from pch, which is not modified, and inserted
+  // after the current position since they are already preprocessed.
+  // Files included by the header are decided with the macros and guards
+  // before the ones of the header are applied.
+  struct Node *head = NULL;
+  struct Node **last_holder = &head;
+  bool keeps_markers = compiler->building_pch != NULL;
+  if (keeps_markers) {
+    *last_holder = CreatePCHIncludeBegin(resolved_path);
+    last_holder = &(*last_holder)->next_token;
+  }
+  for (int i = 0; i < pch->num_of_tokens; i++) {
+    const struct PCHToken *pt = &pch->tokens[i];
+    if (pt->token_type == kTokenPCHIncludeBegin &&
+        ShouldSkipPCHInclude(macros, pch, pch->atoms[pt->atom_index])) {
+      TRACE(kTracePreprocess, "Include skipped: %s\n",
+            pch->atoms[pt->atom_index]);
+      i = SkipPCHIncludeRegion(pch, i);
+      continue;
+    }
+    if (!keeps_markers && (pt->token_type == kTokenPCHIncludeBegin ||
+                           pt->token_type == kTokenPCHIncludeEnd)) {
+      continue;
+    }
+    *last_holder = CreateTokenFromPCH(pch, pt);
+    last_holder = &(*last_holder)->next_token;
+  }
+  if (keeps_markers) {
+    *last_holder = AllocToken(0, "", 0, kTokenPCHIncludeEnd);
+    last_holder = &(*last_holder)->next_token;
+  }
+  if (head) {
+    InsertTokens(head);
+    InitTokenStream(last_holder);
+  }
+  if (compiler->building_pch) {
+    // The header being built depends on what the applied one depends on.
+    for (struct IncludeGuard *g = pch->guards; g; g = g->next) {
+      if (g->macro) MarkMacroAsSeenByPCH(g->macro);
+    }
+    for (struct PCHMacroUse *u = pch->uses; u; u = u->next) {
+      RecordPCHMacroUse(macros, u->name);
+    }
+    for (int i = 0; i < GetSizeOfList(pch->macros); i++) {
+      MarkMacroAsSeenByPCH(GetNodeAt(pch->macros, i)->key);
+    }
+    for (struct Node *t = pch->undefs; t; t = t->next_token) {
+      MarkMacroAsSeenByPCH(t->atom);
+    }
+    for (struct PCHDependency *d = pch->deps; d; d = d->next) {
+      AddPCHDependency(compiler->building_pch, d);
+    }
+  }
+  for (int i = 0; i < GetSizeOfList(pch->macros); i++) {
+    struct Node *kv = GetNodeAt(pch->macros, i);
+    DefineMacro(macros, kv->key, kv->value);
+  }
+  for (struct Node *t = pch->undefs; t; t = t->next_token) {
+    UndefMacro(macros, t->atom);
+  }
+  for (struct IncludeGuard *g = pch->guards; g; g = g->next) {
+    if (!FindIncludeGuard(g->path)) AddIncludeGuard(g->path, g->macro);
+  }
+}
+
 static char *CreateJoinedString(const char *s1, const char *s2) {
   assert(s1 && s2);
-  char *s = malloc(strlen(s1) + strlen(s2) + 1);
-  assert(s);
+  char *s = ArenaAlloc(strlen(s1) + strlen(s2) + 1);
   strcpy(s, s1);
   strcat(s, s2);
   return s;
 }
 
-static void PreprocessBlock(struct Node *replacement_list, int level) {
+static void PreprocessBlock(struct MacroTable *macros, int level) {
   struct Node *t;
   while (PeekToken()) {
     if ((t = ConsumeTokenStr("__LINE__"))) {
       char s[32];
       snprintf(s, sizeof(s), "%d", t->line);
       t->token_type = kTokenIntegerConstant;
-      t->begin = t->src_str = strdup(s);
+      t->begin = ArenaStrdup(s);
       t->length = strlen(t->begin);
       continue;
     }
     if ((t = ReadToken(kTokenLineComment))) {
-      while (t && !IsEqualTokenWithCStr(t, "\n")) t = t->next_token;
+      while (t && !IsEqualTokenWithCStr(t, "\n") &&
+             !IsTokenWithType(t, kTokenPCHIncludeEnd))
+        t = t->next_token;
       RemoveTokensTo(t);
       continue;
     }
@@ -91,13 +535,15 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
       RemoveTokensTo(t);
       continue;
     }
-    if (IsEqualTokenWithCStr((t = PeekToken()), "#")) {
+    if (IsPunctuator((t = PeekToken()), kPunctHash)) {
       assert(t);
       t = SkipDelimiterTokensInLogicalLine(t->next_token);
       if (IsEqualTokenWithCStr(t, "define")) {
         assert(t);
         t = SkipDelimiterTokensInLogicalLine(t->next_token);
         struct Node *from = t;
+        assert(from);
+        if (!from->atom) ErrorWithToken(from, "Expected macro name here");
         t = t->next_token;
         struct Node *ident_list = TryReadIdentListWrappedByParens(&t);
         t = SkipDelimiterTokensInLogicalLine(t);
@@ -111,14 +557,29 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
         }
         assert(IsEqualTokenWithCStr(t, "\n"));
         RemoveTokensTo(t->next_token);
-        PushKeyValueToList(replacement_list, CreateTokenStr(from),
-                           CreateMacroReplacement(ident_list, to_token_head));
+        DefineMacro(macros, from->atom,
+                    CreateMacroReplacement(ident_list, to_token_head));
+        MarkMacroAsSeenByPCH(from->atom);
+        continue;
+      }
+      if (IsEqualTokenWithCStr(t, "undef")) {
+        struct Node *undef_token = t;
+        t = SkipDelimiterTokensInLogicalLine(t->next_token);
+        if (!t || !t->atom)
+          ErrorWithToken(undef_token, "Expected macro name after this");
+        UndefMacro(macros, t->atom);
+        MarkMacroAsSeenByPCH(t->atom);
+        t = SkipDelimiterTokensInLogicalLine(t->next_token);
+        if (!IsEqualTokenWithCStr(t, "\n"))
+          ErrorWithToken(undef_token, "Expected end of line after #undef");
+        RemoveTokensTo(t->next_token);
         continue;
       }
       if (IsEqualTokenWithCStr(t, "include")) {
         struct Node *token_include = t;
         const char *fname = NULL;
         const char *path = NULL;
+        bool is_system_header = false;
         t = SkipDelimiterTokensInLogicalLine(t->next_token);
         if (IsTokenWithType(t, kTokenStringLiteral)) {
           char *tmp_fname = CreateTokenStr(t);
@@ -128,11 +589,11 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
           RemoveTokensTo(t->next_token);
           path = CreateJoinedString(
               "./", fname);  // TODO: Make this relative to source, not cwd.
-        } else if (IsEqualTokenWithCStr(t, "<")) {
+        } else if (IsPunctuator(t, kPunctLt)) {
           struct Node *markL = t;
           t = t->next_token;
           struct Node *begin = t;
-          while (t && !IsEqualTokenWithCStr(t, ">")) {
+          while (t && !IsPunctuator(t, kPunctGt)) {
             t = t->next_token;
           }
           if (!t) {
@@ -142,35 +603,60 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
           struct Node *end = t;
           fname = CreateStrFromTokenRange(begin, end);
           RemoveTokensTo(end->next_token);
-          if (!include_path) {
+          if (!compiler->options.include_path) {
             ErrorWithToken(token_include,
                            "Include path is not provided in compiler args");
           }
-          path = CreateJoinedString(include_path, fname);
+          path = CreateJoinedString(compiler->options.include_path, fname);
+          is_system_header = true;
         } else {
           ErrorWithToken(t, "Expected < or \" here");
         }
         assert(path);
-        fprintf(stderr, "Include from: %s\n", path);
-        FILE *fp = fopen(path, "rb");
-        if (!fp) {
+        const char *resolved_path = ResolveIncludePath(path);
+        if (ShouldSkipInclude(macros, resolved_path)) {
+          TRACE(kTracePreprocess, "Include skipped: %s\n", path);
+          continue;
+        }
+        if (IsPCHEnabled() && is_system_header) {
+          struct PrecompiledHeader *pch =
+              GetPCH(path, resolved_path, token_include);
+          if (IsPCHApplicable(macros, pch)) {
+            ApplyPCH(macros, pch, resolved_path);
+            continue;
+          }
+          TRACE(kTracePreprocess, "PCH not applicable: %s\n", path);
+        }
+        TRACE(kTracePreprocess, "Include from: %s\n", path);
+        const char *include_input =
+            compiler->building_pch
+                ? ReadPCHDependency(compiler->building_pch, path,
+                                    resolved_path)
+                : ReadFileFromPath(path);
+        if (!include_input) {
           ErrorWithToken(token_include, "File not found: %s", path);
         }
-        const char *include_input = ReadFile(fp);
-        InsertTokens(Tokenize(include_input));
-        fclose(fp);
+        struct Node *include_tokens = Tokenize(include_input);
+        RecordIncludeGuard(resolved_path, include_tokens);
+        if (compiler->building_pch) {
+          struct IncludeGuard *g = FindIncludeGuard(resolved_path);
+          if (g && g->macro) MarkMacroAsSeenByPCH(g->macro);
+          include_tokens =
+              WrapWithPCHIncludeMarkers(resolved_path, include_tokens);
+        }
+        InsertTokens(include_tokens);
         continue;
       }
-      if (IsEqualTokenWithCStr(t, "ifdef")) {
+      if (IsEqualTokenWithCStr(t, "ifdef") ||
+          IsEqualTokenWithCStr(t, "ifndef")) {
         struct Node *ifdef_token = t;
         t = SkipDelimiterTokensInLogicalLine(t->next_token);
-        struct Node *e;
-        bool cond = (e = GetNodeByTokenKey(replacement_list, t));
-        // defined
+        bool cond = LookupMacro(macros, t) != NULL;
+        if (IsEqualTokenWithCStr(ifdef_token, "ifndef")) cond = !cond;
         t = SkipDelimiterTokensInLogicalLine(t->next_token);
         RemoveTokensTo(t);
         if (cond) {
-          PreprocessBlock(replacement_list, level + 1);
+          PreprocessBlock(macros, level + 1);
           if (IsEqualTokenWithCStr(PeekToken(), "else")) {
             RemoveCurrentToken();
             PreprocessRemoveBlock();
@@ -179,7 +665,7 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
           PreprocessRemoveBlock();
           if (IsEqualTokenWithCStr(PeekToken(), "else")) {
             RemoveCurrentToken();
-            PreprocessBlock(replacement_list, level + 1);
+            PreprocessBlock(macros, level + 1);
           }
         }
         t = PeekToken();
@@ -191,6 +677,12 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
         RemoveTokensTo(t);
         continue;
       }
+      if (IsEqualTokenWithCStr(t, "pragma")) {
+        // #pragma once is handled when the file is included.
+        // Other pragmas are ignored.
+        RemoveTokensTo(SkipToNextLine(t));
+        continue;
+      }
       if (IsEqualTokenWithCStr(t, "endif")) {
         if (level == 0) {
           ErrorWithToken(t, "Unexpected endif here");
@@ -208,7 +700,7 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
       ErrorWithToken(NextToken(), "Not a valid macro");
     }
     struct Node *e;
-    if ((e = GetNodeByTokenKey(replacement_list, (t = PeekToken())))) {
+    if ((e = LookupMacro(macros, (t = PeekToken())))) {
       assert(e->type == kNodeMacroReplacement);
       struct Node *rep = DuplicateTokenSequence(e->value);
       RemoveCurrentToken();
@@ -219,27 +711,27 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
       }
       // function-like macro case
       t = SkipDelimiterTokensInLogicalLine(t->next_token);
-      if (!IsEqualTokenWithCStr(t, "(")) ErrorWithToken(t, "Expected ( here");
+      if (!IsPunctuator(t, kPunctLParen)) ErrorWithToken(t, "Expected ( here");
       t = t->next_token;
       struct Node *it;
       struct Node *arg_rep_list = AllocList();
       for (it = e->arg_expr_list; it; it = it->next_token) {
-        if (IsEqualTokenWithCStr(it, ")")) break;
+        if (IsPunctuator(it, kPunctRParen)) break;
         struct Node *arg_token_head = NULL;
         struct Node **arg_token_last_holder = &arg_token_head;
         t = SkipDelimiterTokensInLogicalLine(t);
         for (; t; t = t->next_token) {
-          if (IsEqualTokenWithCStr(t, ")") || IsEqualTokenWithCStr(t, ","))
+          if (IsPunctuator(t, kPunctRParen) || IsPunctuator(t, kPunctComma))
             break;
           *arg_token_last_holder = DuplicateToken(t);
           arg_token_last_holder = &(*arg_token_last_holder)->next_token;
         }
-        PushKeyValueToList(arg_rep_list, CreateTokenStr(it),
+        PushKeyValueToList(arg_rep_list, it->atom,
                            CreateMacroReplacement(NULL, arg_token_head));
-        if (IsEqualTokenWithCStr(t, ")")) break;
+        if (IsPunctuator(t, kPunctRParen)) break;
         t = t->next_token;
       }
-      if (!IsEqualTokenWithCStr(t, ")")) ErrorWithToken(t, "Expected ) here");
+      if (!IsPunctuator(t, kPunctRParen)) ErrorWithToken(t, "Expected ) here");
       RemoveTokensTo(t->next_token);
       // Insert & replace args
       InsertTokensWithIdentReplace(rep, arg_rep_list);
@@ -249,7 +741,19 @@ static void PreprocessBlock(struct Node *replacement_list, int level) {
   }
 }
 
-void Preprocess(struct Node **head_holder, struct Node *replacement_list) {
+void Preprocess(struct Node **head_holder, struct MacroTable *macros) {
+  // macros should contain only the macros defined by compiler args here.
+  compiler->include_guards = AllocIncludeGuardTable();
+  if (IsPCHEnabled()) {
+    compiler->predefined_macro_list = CreateMacroList(macros);
+    compiler->predefined_macros = AllocMacroTable();
+    for (int i = 0; i < GetSizeOfList(compiler->predefined_macro_list); i++) {
+      struct Node *kv = GetNodeAt(compiler->predefined_macro_list, i);
+      DefineMacro(compiler->predefined_macros, kv->key, kv->value);
+    }
+    compiler->pch_flags_hash =
+        CalcPCHFlagsHash(compiler->predefined_macro_list);
+  }
   InitTokenStream(head_holder);
-  PreprocessBlock(replacement_list, 0);
+  PreprocessBlock(macros, 0);
 }
@@ -0,0 +1,290 @@
+#include "compilium.h"
+
+// Compile server (--server <socket>) and its client (--connect <socket>).
+// The server listens on a UNIX domain socket and compiles the requests one
+// by one in the same context, which is reset between them but keeps the
+// interned strings, the headers included with <...> (as PCHs in memory)
+// and the chunks of the arenas. The client is compilium itself: it parses
+// the args as usual, sends the options, the working directory and the
+// source, and writes the output returned by the server like a local
+// compilation, so that it can replace compilium in makefiles.
+//
+// A message is an int of the size of the rest, followed by its fields.
+// Ints are in the byte order of the machine, and a string is an int of
+// its length (-1 for NULL) followed by the bytes and a NUL.
+//
+//   request:  is_preprocess_only, is_object_output, is_alloc_report_enabled,
+//             is_stats_enabled, trace_categories, time_report, target_os,
+//             include_path, pch_dir, func_cache_dir, cwd, source
+//   response: status, diagnostics (written to stderr), output
+
+#define SERVER_BACKLOG 64
+#define SERVER_CACHE_LIMIT (512L * 1024 * 1024)  // bytes of kArenaCache
+#define MAX_MESSAGE_SIZE (1 << 30)
+
+struct MessageReader {
+  const char *p;
+  const char *end;
+  bool is_broken;
+};
+
+static void AppendMessageInt(struct ObjBuffer *b, int v) {
+  AppendToObjBuffer(b, &v, sizeof(v));
+}
+
+static void AppendMessageStr(struct ObjBuffer *b, const char *s, int size) {
+  // size is ignored if s is NULL.
+  AppendMessageInt(b, s ? size : -1);
+  if (!s) return;
+  AppendToObjBuffer(b, s, size);
+  AppendToObjBuffer(b, "", 1);
+}
+
+static int ReadMessageInt(struct MessageReader *r) {
+  int v = 0;
+  if (r->end - r->p < (long)sizeof(v)) {
+    r->is_broken = true;
+    return 0;
+  }
+  memcpy(&v, r->p, sizeof(v));
+  r->p += sizeof(v);
+  return v;
+}
+
+static const char *ReadMessageStr(struct MessageReader *r, int *size) {
+  // Returns NULL for NULL and broken strings. size can be NULL.
+  int len = ReadMessageInt(r);
+  if (len < 0) return NULL;
+  if (r->end - r->p <= len || r->p[len]) {
+    r->is_broken = true;
+    return NULL;
+  }
+  const char *s = r->p;
+  r->p += len + 1;
+  if (size) *size = len;
+  return s;
+}
+
+static bool WriteAllToFd(int fd, const char *p, long size) {
+  while (size) {
+    long written = write(fd, p, size);
+    if (written <= 0) return false;
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool ReadAllFromFd(int fd, char *p, long size) {
+  while (size) {
+    long n = read(fd, p, size);
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void BeginMessage(struct ObjBuffer *b) {
+  b->size = 0;
+  AppendMessageInt(b, 0);  // filled by SendMessage
+}
+
+static bool SendMessage(int fd, struct ObjBuffer *b) {
+  int size = b->size - sizeof(int);
+  memcpy(b->data, &size, sizeof(size));
+  return WriteAllToFd(fd, b->data, b->size);
+}
+
+static bool ReceiveMessage(int fd, struct ObjBuffer *b,
+                           struct MessageReader *r) {
+  // The contents are read into b, which is read by r.
+  int size;
+  if (!ReadAllFromFd(fd, (char *)&size, sizeof(size))) return false;
+  if (size < 0 || size > MAX_MESSAGE_SIZE) return false;
+  b->size = 0;
+  AppendToObjBuffer(b, NULL, size);
+  if (!ReadAllFromFd(fd, b->data, size)) return false;
+  r->p = b->data;
+  r->end = b->data + size;
+  r->is_broken = false;
+  return true;
+}
+
+static void SetSocketPath(struct sockaddr_un *addr, const char *path) {
+  *addr = (struct sockaddr_un){0};
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    Error("Socket path is too long: %s", path);
+  }
+  strcpy(addr->sun_path, path);
+}
+
+// Server
+
+static char *ReadWholeFile(FILE *fp, int *size) {
+  // Returns the contents of fp allocated with malloc.
+  long n = 0;
+  if (fseek(fp, 0, SEEK_END) == 0) n = ftell(fp);
+  if (n < 0 || fseek(fp, 0, SEEK_SET) != 0) n = 0;
+  char *s = malloc(n + 1);
+  assert(s);
+  *size = fread(s, 1, n, fp);
+  s[*size] = 0;
+  return s;
+}
+
+static void HandleCompileRequest(struct CompilerContext *c, int fd,
+                                 struct ObjBuffer *message) {
+  struct MessageReader r;
+  if (!ReceiveMessage(fd, message, &r)) return;
+  struct CompilerOptions options = {0};
+  options.is_preprocess_only = ReadMessageInt(&r);
+  options.is_object_output = ReadMessageInt(&r);
+  options.is_alloc_report_enabled = ReadMessageInt(&r);
+  options.is_stats_enabled = ReadMessageInt(&r);
+  options.trace_categories = ReadMessageInt(&r);
+  options.time_report = ReadMessageInt(&r);
+  options.target_os = ReadMessageStr(&r, NULL);
+  options.include_path = ReadMessageStr(&r, NULL);
+  options.pch_dir = ReadMessageStr(&r, NULL);
+  options.func_cache_dir = ReadMessageStr(&r, NULL);
+  const char *cwd = ReadMessageStr(&r, NULL);
+  const char *source = ReadMessageStr(&r, NULL);
+  if (r.is_broken || !cwd || !source) return;
+
+  // Diagnostics written to stderr during the compilation are captured in
+  // a temporary file and sent to the client.
+  FILE *diag_fp = tmpfile();
+  if (!diag_fp) Error("Failed to create a file for diagnostics");
+  fflush(stderr);
+  int saved_stderr = dup(2);
+  dup2(fileno(diag_fp), 2);
+  ResetCompilerContext(c, &options);
+  bool is_compiled = false;
+  if (chdir(cwd) != 0) {
+    fprintf(stderr, "Error: Failed to change the directory to %s\n", cwd);
+  } else {
+    is_compiled = CompileInContext(c, source);
+  }
+  fflush(stderr);
+  dup2(saved_stderr, 2);
+  close(saved_stderr);
+  int diag_size;
+  char *diag = ReadWholeFile(diag_fp, &diag_size);
+  fclose(diag_fp);
+
+  // The request is not used anymore, so its buffer is reused.
+  BeginMessage(message);
+  AppendMessageInt(message, is_compiled ? EXIT_SUCCESS : EXIT_FAILURE);
+  AppendMessageStr(message, diag, diag_size);
+  AppendMessageStr(message, is_compiled ? c->output.data : NULL,
+                   c->output.size);
+  SendMessage(fd, message);
+  free(diag);
+}
+
+_Noreturn void RunCompileServer(const char *socket_path) {
+  struct sockaddr_un addr;
+  SetSocketPath(&addr, socket_path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) Error("Failed to create a socket");
+  unlink(socket_path);
+  if (bind(fd, &addr, sizeof(addr)) != 0 || listen(fd, SERVER_BACKLOG) != 0) {
+    Error("Failed to listen on %s", socket_path);
+  }
+  // Clients which are gone should not stop the server.
+  signal(SIGPIPE, SIG_IGN);
+  static const struct CompilerOptions options;
+  struct CompilerContext *c = NULL;
+  struct ObjBuffer message = {0};
+  for (;;) {
+    int conn = accept(fd, NULL, NULL);
+    if (conn < 0) continue;
+    if (c && c->arenas[kArenaCache].num_of_reserved > SERVER_CACHE_LIMIT) {
+      DestroyCompilerContext(c);
+      c = NULL;
+    }
+    if (!c) {
+      c = CreateCompilerContext(&options);
+      c->keeps_caches = true;
+    }
+    HandleCompileRequest(c, conn, &message);
+    close(conn);
+  }
+}
+
+// Client
+
+static int ConnectToServer(const char *socket_path) {
+  // Returns -1 if the server is not available.
+  struct sockaddr_un addr;
+  SetSocketPath(&addr, socket_path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, &addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int SendCompileRequest(int fd, const struct CompilerOptions *options,
+                              const char *input_path,
+                              const char *output_path) {
+  // Returns the status of the compilation.
+  const char *source = ReadFileFromPath(input_path);
+  if (!source) Error("File not found: %s", input_path);
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) Error("Failed to get the current directory");
+  struct ObjBuffer message = {0};
+  BeginMessage(&message);
+  AppendMessageInt(&message, options->is_preprocess_only);
+  AppendMessageInt(&message, options->is_object_output);
+  AppendMessageInt(&message, options->is_alloc_report_enabled);
+  AppendMessageInt(&message, options->is_stats_enabled);
+  AppendMessageInt(&message, options->trace_categories);
+  AppendMessageInt(&message, options->time_report);
+  const char *strs[] = {options->target_os,      options->include_path,
+                        options->pch_dir,        options->func_cache_dir,
+                        cwd,                     source};
+  for (int i = 0; i < (int)(sizeof(strs) / sizeof(strs[0])); i++) {
+    AppendMessageStr(&message, strs[i], strs[i] ? strlen(strs[i]) : 0);
+  }
+  struct MessageReader r;
+  if (!SendMessage(fd, &message) || !ReceiveMessage(fd, &message, &r)) {
+    Error("Failed to communicate with the compile server");
+  }
+  int status = ReadMessageInt(&r);
+  int diag_size, output_size;
+  const char *diag = ReadMessageStr(&r, &diag_size);
+  const char *output = ReadMessageStr(&r, &output_size);
+  if (r.is_broken || !diag) Error("Broken response from the compile server");
+  fwrite(diag, 1, diag_size, stderr);
+  if (status == EXIT_SUCCESS && output) {
+    FILE *fp = output_path ? fopen(output_path, "wb") : stdout;
+    if (!fp) Error("Failed to open %s", output_path);
+    bool is_written = fwrite(output, 1, output_size, fp) == (size_t)output_size;
+    is_written = (output_path ? fclose(fp) : fflush(fp)) == 0 && is_written;
+    if (!is_written) Error("Failed to write the output");
+  }
+  free(message.data);
+  return status;
+}
+
+int CompileOnServer(const char *socket_path,
+                    const struct CompilerOptions *options,
+                    const char *input_path, const char *output_path) {
+  // Same as CompileFile(), but the compile server at socket_path compiles
+  // the file. It is compiled locally if the server is not running.
+  int fd = ConnectToServer(socket_path);
+  if (fd < 0) return CompileFile(options, input_path, output_path);
+  // The source is read in a context, which is only for the memory.
+  struct CompilerContext *c = CreateCompilerContext(options);
+  compiler = c;
+  int status = SendCompileRequest(fd, options, input_path, output_path);
+  compiler = NULL;
+  DestroyCompilerContext(c);
+  close(fd);
+  return status;
+}
@@ -0,0 +1,42 @@
+#include "compilium.h"
+
+// Hot-path counters (--stats), to measure where the lookups of the compiler
+// spend their time. The counters are compiled in only by the build with
+// -DCOMPILIUM_STATS (make compilium_stats), so that STAT_CALL and STAT_STEPS
+// cost nothing in the normal build. Each site counts its calls and the
+// steps it takes, whose unit is given below.
+
+#ifdef COMPILIUM_STATS
+static const char *stat_counter_names[kNumOfStatCounters] = {
+    [kStatTokenCompare] = "IsEqualTokenWithCStr",
+    [kStatListKeyLookup] = "GetNodeByTokenKey",
+    [kStatSymbolLookup] = "FindSymbol",
+    [kStatMacroProbe] = "FindMacroByName",
+    [kStatNodeAlloc] = "AllocNode",
+    [kStatArenaAlloc] = "ArenaAlloc",
+};
+
+static const char *stat_step_units[kNumOfStatCounters] = {
+    [kStatTokenCompare] = "bytes",     // of the string and the token
+    [kStatListKeyLookup] = "elements",  // of the list
+    [kStatSymbolLookup] = "entries",    // in the bucket
+    [kStatMacroProbe] = "entries",      // in the bucket, 0 if filtered out
+    [kStatNodeAlloc] = "bytes",
+    [kStatArenaAlloc] = "bytes",
+};
+
+void PrintStats(FILE *fp) {
+  fprintf(fp, "%-22s %12s %14s %10s %s\n", "counter", "calls", "steps",
+          "per call", "unit");
+  for (int i = 0; i < kNumOfStatCounters; i++) {
+    struct StatCounter *s = &compiler->stats[i];
+    fprintf(fp, "%-22s %12ld %14ld %10.2f %s\n", stat_counter_names[i],
+            s->calls, s->steps, s->calls ? (double)s->steps / s->calls : 0.0,
+            stat_step_units[i]);
+  }
+}
+#else
+void PrintStats(FILE *fp) {
+  fprintf(fp, "Stats are not compiled in (build with make compilium_stats)\n");
+}
+#endif
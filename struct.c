@@ -42,7 +42,7 @@ void AddMemberOfStructFromDecl(struct Node *struct_spec, struct Node *decl) {
   struct_member->struct_member_decl = decl;
   struct Node *type = CreateTypeFromDecl(decl);
   assert(type && type->left);
-  const char *name = CreateTokenStr(type->left);
+  const char *name = type->left->atom;
   struct Node *dict = struct_spec->struct_member_dict;
   PushKeyValueToList(dict, name, struct_member);
 }
@@ -59,13 +59,13 @@ struct Node *FindStructMember(struct Node *struct_type,
                            key_token);
 }
 
-void ResolveTypesOfMembersOfStruct(struct SymbolEntry *ctx, struct Node *spec) {
+void ResolveTypesOfMembersOfStruct(struct SymbolTable *ctx, struct Node *spec) {
   if (!spec) {
     // Skip resolving members since it is incomplete.
     return;
   }
   struct Node *dict = spec->struct_member_dict;
-  fprintf(stderr, "Resolving types of struct...\n");
+  TRACE(kTraceAnalyze, "Resolving types of struct...\n");
   struct Node *resolved_dict = AllocList();
   for (int i = 0; i < GetSizeOfList(dict); i++) {
     struct Node *kv = GetNodeAt(dict, i);
@@ -76,7 +76,7 @@ void ResolveTypesOfMembersOfStruct(struct SymbolEntry *ctx, struct Node *spec) {
     member_info->struct_member_ent_type = GetTypeWithoutAttr(type);
     member_info->struct_member_ent_ofs =
         CalcNextMemberOffset(resolved_dict, type);
-    PrintASTNode(member_info);
+    TRACE_AST(kTraceAnalyze, member_info);
     PushKeyValueToList(resolved_dict, kv->key, kv->value);
   }
   spec->struct_member_dict = resolved_dict;
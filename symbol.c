@@ -1,135 +1,255 @@
 #include "compilium.h"
 
-static void PushSymbol(struct SymbolEntry **prev, struct SymbolEntry *sym) {
-  sym->prev = *prev;
-  *prev = sym;
+// Symbols are kept in a hash table keyed by atom. Entries with the same key
+// are chained newest first, so inner declarations shadow outer ones.
+// All live entries are also linked by prev in the order of addition,
+// which is used to remove the entries of a scope when it is popped.
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 64
+
+struct SymbolScope {
+  struct SymbolEntry *saved_last;
+  struct SymbolScope *prev;
+};
+
+static unsigned int CalcSymbolHash(const char *key) {
+  // key is an atom, so its address identifies the name.
+  unsigned long v = (unsigned long)key;
+  return (unsigned int)((v >> 3) ^ (v >> 17)) * 2654435761u;
+}
+
+static struct SymbolEntry **GetSymbolBucket(struct SymbolTable *ctx,
+                                            const char *key) {
+  return &ctx->buckets[CalcSymbolHash(key) & (ctx->capacity - 1)];
+}
+
+static void ExpandSymbolTable(struct SymbolTable *ctx) {
+  ctx->capacity = ctx->capacity ? ctx->capacity * 2
+                                : SYMBOL_TABLE_INITIAL_CAPACITY;
+  ctx->buckets = ArenaAlloc(sizeof(struct SymbolEntry *) * ctx->capacity);
+  // Walk from the newest entry and append each of them to the tail of its
+  // bucket, to keep the newest-first order in the buckets.
+  for (struct SymbolEntry *e = ctx->last; e; e = e->prev) {
+    struct SymbolEntry **p = GetSymbolBucket(ctx, e->key);
+    while (*p) p = &(*p)->next_in_bucket;
+    e->next_in_bucket = NULL;
+    *p = e;
+  }
+}
+
+struct SymbolTable *AllocSymbolTable(void) {
+  struct SymbolTable *ctx = ArenaAlloc(sizeof(struct SymbolTable));
+  ExpandSymbolTable(ctx);
+  return ctx;
+}
+
+void PushSymbolScope(struct SymbolTable *ctx) {
+  assert(ctx);
+  struct SymbolScope *scope = ArenaAlloc(sizeof(struct SymbolScope));
+  scope->saved_last = ctx->last;
+  scope->prev = ctx->scope;
+  ctx->scope = scope;
 }
 
-static struct SymbolEntry *AllocSymbolEntry(enum SymbolType type,
+void PopSymbolScope(struct SymbolTable *ctx) {
+  // Removes the symbols added after the last PushSymbolScope.
+  assert(ctx && ctx->scope);
+  while (ctx->last != ctx->scope->saved_last) {
+    struct SymbolEntry *e = ctx->last;
+    struct SymbolEntry **bucket = GetSymbolBucket(ctx, e->key);
+    assert(*bucket == e);
+    *bucket = e->next_in_bucket;
+    ctx->last = e->prev;
+    ctx->num_of_entries--;
+  }
+  ctx->scope = ctx->scope->prev;
+}
+
+static void PushSymbol(struct SymbolTable *ctx, struct SymbolEntry *sym) {
+  if ((ctx->num_of_entries + 1) * 2 > ctx->capacity) ExpandSymbolTable(ctx);
+  struct SymbolEntry **bucket = GetSymbolBucket(ctx, sym->key);
+  sym->next_in_bucket = *bucket;
+  *bucket = sym;
+  sym->prev = ctx->last;
+  ctx->last = sym;
+  ctx->num_of_entries++;
+}
+
+static struct SymbolEntry *AllocSymbolEntry(struct SymbolTable *ctx,
+                                            enum SymbolType type,
                                             const char *key,
                                             struct Node *value) {
-  struct SymbolEntry *e = calloc(1, sizeof(struct SymbolEntry));
+  assert(key);
+  struct SymbolEntry *e = ArenaAlloc(sizeof(struct SymbolEntry));
   e->type = type;
   e->key = key;
   e->value = value;
+  e->last_local_var_ofs = GetLastLocalVarOffset(ctx);
   return e;
 }
 
-int GetLastLocalVarOffset(struct SymbolEntry *e) {
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolLocalVar) continue;
-    assert(e->value && e->value->type == kASTLocalVar);
-    return e->value->byte_offset;
+static struct Node *FindSymbol(struct SymbolTable *ctx, enum SymbolType type,
+                               struct Node *key_token) {
+  if (!ctx) return NULL;
+  const char *key = key_token->atom;
+  STAT_CALL(kStatSymbolLookup);
+  for (struct SymbolEntry *e = *GetSymbolBucket(ctx, key); e;
+       e = e->next_in_bucket) {
+    STAT_STEPS(kStatSymbolLookup, 1);
+    if (e->type != type) continue;
+    if (e->key != key) continue;
+    return e->value;
   }
-  return 0;
+  return NULL;
 }
 
-struct Node *AddLocalVar(struct SymbolEntry **ctx, const char *key,
+int GetLastLocalVarOffset(struct SymbolTable *ctx) {
+  if (!ctx->last) return 0;
+  return ctx->last->last_local_var_ofs;
+}
+
+struct Node *AddLocalVar(struct SymbolTable *ctx, const char *key,
                          struct Node *var_type) {
   assert(ctx);
-  int ofs = GetLastLocalVarOffset(*ctx);
+  int ofs = GetLastLocalVarOffset(ctx);
   ofs += GetSizeOfType(var_type);
   int align = GetSizeOfType(var_type);
   ofs = (ofs + align - 1) / align * align;
   struct Node *local_var = CreateASTLocalVar(ofs, var_type);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolLocalVar, key, local_var);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(ctx, kSymbolLocalVar, key, local_var);
+  e->last_local_var_ofs = ofs;
   PushSymbol(ctx, e);
   return local_var;
 }
 
-void AddGlobalVar(struct SymbolEntry **ctx, const char *key,
+void AddGlobalVar(struct SymbolTable *ctx, const char *key,
                   struct Node *var_type) {
-  fprintf(stderr, "Gvar: %s: ", key);
-  PrintASTNode(var_type);
-  fprintf(stderr, "\n");
+  if (IsTraceEnabled(kTraceAnalyze)) {
+    fprintf(stderr, "Gvar: %s: ", key);
+    PrintASTNode(var_type);
+    fprintf(stderr, "\n");
+  }
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolGlobalVar, key, var_type);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(ctx, kSymbolGlobalVar, key, var_type);
   PushSymbol(ctx, e);
 }
-void AddExternVar(struct SymbolEntry **ctx, const char *key,
+void AddExternVar(struct SymbolTable *ctx, const char *key,
                   struct Node *var_type) {
-  fprintf(stderr, "Evar: %s: ", key);
-  PrintASTNode(var_type);
-  fprintf(stderr, "\n");
+  if (IsTraceEnabled(kTraceAnalyze)) {
+    fprintf(stderr, "Evar: %s: ", key);
+    PrintASTNode(var_type);
+    fprintf(stderr, "\n");
+  }
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolExternVar, key, var_type);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(ctx, kSymbolExternVar, key, var_type);
   PushSymbol(ctx, e);
 }
 
-struct Node *FindExternVar(struct SymbolEntry *e, struct Node *key_token) {
+struct Node *FindExternVar(struct SymbolTable *ctx, struct Node *key_token) {
   // returns ASTNode which represents Type
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolExternVar) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
-    return e->value;
-  }
-  return NULL;
+  return FindSymbol(ctx, kSymbolExternVar, key_token);
 }
 
-struct Node *FindGlobalVar(struct SymbolEntry *e, struct Node *key_token) {
+struct Node *FindGlobalVar(struct SymbolTable *ctx, struct Node *key_token) {
   // returns ASTNode which represents Type
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolGlobalVar) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
-    return e->value;
-  }
-  return NULL;
+  return FindSymbol(ctx, kSymbolGlobalVar, key_token);
 }
 
-struct Node *FindLocalVar(struct SymbolEntry *e, struct Node *key_token) {
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolLocalVar) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
-    return e->value;
-  }
-  return NULL;
+struct Node *FindLocalVar(struct SymbolTable *ctx, struct Node *key_token) {
+  return FindSymbol(ctx, kSymbolLocalVar, key_token);
 }
 
-void AddFuncDef(struct SymbolEntry **ctx, const char *key,
+void AddFuncDef(struct SymbolTable *ctx, const char *key,
                 struct Node *func_def) {
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolFuncDef, key, func_def);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(ctx, kSymbolFuncDef, key, func_def);
   PushSymbol(ctx, e);
 }
 
-struct Node *FindFuncDef(struct SymbolEntry *e, struct Node *key_token) {
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolFuncDef) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
-    return e->value;
-  }
-  return NULL;
+struct Node *FindFuncDef(struct SymbolTable *ctx, struct Node *key_token) {
+  return FindSymbol(ctx, kSymbolFuncDef, key_token);
 }
 
-void AddFuncDeclType(struct SymbolEntry **ctx, const char *key,
+void AddFuncDeclType(struct SymbolTable *ctx, const char *key,
                      struct Node *func_decl) {
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolFuncDeclType, key, func_decl);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(ctx, kSymbolFuncDeclType, key, func_decl);
   PushSymbol(ctx, e);
 }
 
-struct Node *FindFuncDeclType(struct SymbolEntry *e, struct Node *key_token) {
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolFuncDeclType) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
-    return e->value;
-  }
-  return NULL;
+struct Node *FindFuncDeclType(struct SymbolTable *ctx,
+                              struct Node *key_token) {
+  return FindSymbol(ctx, kSymbolFuncDeclType, key_token);
 }
 
-void AddStructType(struct SymbolEntry **ctx, const char *key,
+void AddStructType(struct SymbolTable *ctx, const char *key,
                    struct Node *type) {
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolStructType, key, type);
+  struct SymbolEntry *e = AllocSymbolEntry(ctx, kSymbolStructType, key, type);
   PushSymbol(ctx, e);
-  PrintASTNode(type);
+  TRACE_AST(kTraceAnalyze, type);
 }
 
-struct Node *FindStructType(struct SymbolEntry *e, struct Node *key_token) {
-  for (; e; e = e->prev) {
-    if (e->type != kSymbolStructType) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
-    return e->value;
+struct Node *FindStructType(struct SymbolTable *ctx, struct Node *key_token) {
+  return FindSymbol(ctx, kSymbolStructType, key_token);
+}
+
+void TestSymbol() {
+  fprintf(stderr, "Testing Symbol...");
+
+  struct Node *int_type = CreateTypeBase(CreateToken("int"));
+  struct Node *char_type = CreateTypeBase(CreateToken("char"));
+  struct Node *a = CreateToken("a");
+  struct Node *b = CreateToken("b");
+  struct SymbolTable *ctx = AllocSymbolTable();
+
+  AddGlobalVar(ctx, a->atom, int_type);
+  assert(FindGlobalVar(ctx, a) == int_type);
+  assert(!FindLocalVar(ctx, a));
+  assert(GetLastLocalVarOffset(ctx) == 0);
+
+  PushSymbolScope(ctx);
+  struct Node *outer_a = AddLocalVar(ctx, a->atom, int_type);
+  assert(FindLocalVar(ctx, a) == outer_a);
+  assert(FindGlobalVar(ctx, a) == int_type);
+  assert(GetLastLocalVarOffset(ctx) == 4);
+
+  // Inner declarations shadow outer ones until the scope is popped
+  PushSymbolScope(ctx);
+  struct Node *inner_a = AddLocalVar(ctx, a->atom, char_type);
+  struct Node *inner_b = AddLocalVar(ctx, b->atom, int_type);
+  assert(FindLocalVar(ctx, a) == inner_a);
+  assert(FindLocalVar(ctx, b) == inner_b);
+  assert(GetLastLocalVarOffset(ctx) == 12);
+  PopSymbolScope(ctx);
+
+  assert(FindLocalVar(ctx, a) == outer_a);
+  assert(!FindLocalVar(ctx, b));
+  assert(GetLastLocalVarOffset(ctx) == 4);
+  PopSymbolScope(ctx);
+
+  assert(!FindLocalVar(ctx, a));
+  assert(GetLastLocalVarOffset(ctx) == 0);
+
+  // Entries should be kept after the table is expanded
+  PushSymbolScope(ctx);
+  char name[16];
+  for (int i = 0; i < SYMBOL_TABLE_INITIAL_CAPACITY * 4; i++) {
+    snprintf(name, sizeof(name), "v%d", i);
+    AddLocalVar(ctx, InternCStr(name), int_type);
   }
-  return NULL;
+  struct Node *v1 = FindLocalVar(ctx, CreateToken("v1"));
+  assert(v1 && GetLocalVarOffset(v1) == 8);
+  assert(FindGlobalVar(ctx, a) == int_type);
+  PopSymbolScope(ctx);
+  assert(!FindLocalVar(ctx, CreateToken("v1")));
+  assert(ctx->num_of_entries == 1);
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
 }
@@ -23,6 +23,29 @@ function test_result {
   fi
 }
 
+function test_object_result {
+  # Same as test_result, but compilium writes the object file (-c).
+  input="$1"
+  expected="$2"
+  expected_stdout="$3"
+  echo "input (-c) : " ${input}
+  printf "$expected_stdout" > expected.stdout
+  ./compilium --target-os Linux -c -o out.o <<< "$input" || { \
+    echo "$input" > failcase.c; \
+    echo "Compilation failed."; \
+    exit 1; }
+  gcc out.o
+  actual=0
+  ./a.out > out.stdout || actual=$?
+  if [ $expected = $actual ]; then
+      diff -u expected.stdout out.stdout \
+        && echo "PASS (-c) returns $expected" \
+        || { echo "FAIL (-c): stdout diff"; exit 1; }
+  else
+    echo "FAIL (-c): expected $expected but got $actual"; echo $input > failcase.c; exit 1;
+  fi
+}
+
 function test_expr_result {
   test_result "int main(){return $1;}" "$2" "" "$1"
 }
@@ -153,4 +176,148 @@ test_expr_result ' 0 ' 0
 test_expr_result '+ +1' 1
 test_expr_result '- -17' 17
 
+# Deep expression (passes over the AST should not use the C stack per level)
+deep_expr="a`printf '+a%.0s' {1..19999}`"
+(ulimit -s 256; test_stmt_result "int a; a = 1; return $deep_expr - 19958;" 42)
+
+# All the scratch registers in use, and running out of them
+test_stmt_result "int a; a = a = a = a = a = a = a = a = a = 42; return a;" 42
+status=0
+./compilium --target-os `uname` \
+  <<< "int main(){int a; a = a = a = a = a = a = a = a = a = a = 1;}" \
+  > /dev/null 2> regs.txt || status=$?
+[ $status = 1 ] && grep -q 'No free registers found' regs.txt \
+  && echo "PASS out of registers" \
+  || { echo "FAIL out of registers: exited with $status"; exit 1; }
+rm regs.txt
+
+# Multiple input files compiled by workers
+out_dir=`mktemp -d`
+./compilium --target-os `uname` -I include/ -j 2 -o $out_dir/ \
+  linkage_test/linkage_test.c linkage_test/external.c \
+  || { echo "FAIL multiple input files: compilation failed"; exit 1; }
+gcc -o $out_dir/a.out $out_dir/linkage_test.S $out_dir/external.S
+$out_dir/a.out > /dev/null \
+  && echo "PASS multiple input files" \
+  || { echo "FAIL multiple input files"; exit 1; }
+# Outputs which would overwrite each other or an input are rejected
+mkdir $out_dir/a $out_dir/b $out_dir/out
+echo "int f(){return 1;}" > $out_dir/a/x.c
+cp $out_dir/a/x.c $out_dir/b/x.c
+cp $out_dir/a/x.c $out_dir/y.S
+for args in "-o $out_dir/out/ $out_dir/a/x.c $out_dir/b/x.c" \
+            "$out_dir/a/x.c $out_dir/y.S"; do
+  ./compilium --target-os `uname` $args 2> /dev/null \
+    && { echo "FAIL colliding outputs: $args"; exit 1; }
+done
+[ ! -e $out_dir/out/x.S ] && cmp -s $out_dir/a/x.c $out_dir/y.S \
+  && echo "PASS colliding outputs" \
+  || { echo "FAIL colliding outputs: files were written"; exit 1; }
+rm -r $out_dir
+
+# Object output without an external assembler
+if [ `uname` = Linux ]; then
+test_object_result "`cat << EOS
+int printf(const char *fmt, ...);
+int counter;
+char flags[3];
+int shift(int v, int n) {
+  return (v << n) >> 1;
+}
+int main() {
+  int i;
+  for(i = 0; i < 300; i++) {
+    counter += i % 7;
+    if (i <= 250 || (i & 1)) flags[i % 3]++;
+  }
+  printf("%d %d %d\\t\\"%s\\"\\n", counter, flags[0], shift(5, 4), "ok");
+  return counter / 100 - 1 + (counter * 3 == 2694 || flags[1] == 0);
+}
+EOS
+`" 7 '897 92 40\t"ok"\n'
+fi
+
+# Time report (printed to stderr without changing the output)
+./compilium --target-os `uname` -I include/ examples/fib.c > expected.S
+./compilium --target-os `uname` -I include/ --time-report examples/fib.c \
+  2> time_report.txt | cmp -s - expected.S \
+  && grep -q '^generate ' time_report.txt && grep -q '^total ' time_report.txt \
+  || { echo "FAIL time report"; exit 1; }
+./compilium --target-os `uname` -I include/ --time-report=json examples/fib.c \
+  2> time_report.txt > /dev/null \
+  && grep -q '^{"input":"examples/fib.c","phases":\[{"name":"tokenize",' \
+    time_report.txt \
+  || { echo "FAIL time report (json)"; exit 1; }
+echo "PASS time report"
+rm expected.S time_report.txt
+
+# Stats (counters are compiled in only by make compilium_stats)
+./compilium --target-os `uname` -I include/ examples/fib.c > expected.S
+./compilium --target-os `uname` -I include/ --stats examples/fib.c \
+  2> stats.txt | cmp -s - expected.S && grep -q '^Stats' stats.txt \
+  || { echo "FAIL stats"; exit 1; }
+echo "PASS stats"
+rm expected.S stats.txt
+
+# Function cache (unchanged functions are reused, and the output is the same)
+cache_dir=`mktemp -d`
+func_cache_src() {
+  printf 'int puts(const char *s);\nint g(int v) { return v * %d; }\n' $1
+  printf 'int main() { puts("ok"); return g(3); }\n'
+}
+for n in 2 2 5; do
+  func_cache_src $n > $cache_dir/src.c
+  ./compilium --target-os `uname` $cache_dir/src.c > $cache_dir/expected.S
+  ./compilium --target-os `uname` --func-cache-dir $cache_dir/ \
+    --trace=codegen $cache_dir/src.c > $cache_dir/out.S 2> $cache_dir/trace.txt
+  cmp -s $cache_dir/expected.S $cache_dir/out.S \
+    || { echo "FAIL function cache: output differs"; exit 1; }
+done
+grep -q 'Function cached: main' $cache_dir/trace.txt \
+  && ! grep -q 'Function cached: g' $cache_dir/trace.txt \
+  || { echo "FAIL function cache: changed function is reused"; exit 1; }
+echo "PASS function cache"
+rm -r $cache_dir
+
+# Compile server (same outputs as local compilations, warm between requests)
+server_dir=`mktemp -d`
+./compilium --server $server_dir/sock &
+server_pid=$!
+for i in 1 2 3; do [ -S $server_dir/sock ] || sleep 0.2; done
+printf '#include <stdio.h>\nint main() { printf("ok\\n"); return 0; }\n' \
+  > $server_dir/ok.c
+./compilium --target-os `uname` -I include/ $server_dir/ok.c \
+  > $server_dir/local.S
+for i in 1 2; do
+  ./compilium --connect $server_dir/sock --target-os `uname` -I include/ \
+    -o $server_dir/server.S $server_dir/ok.c \
+    && cmp -s $server_dir/local.S $server_dir/server.S \
+    || { echo "FAIL compile server: output differs"; kill $server_pid; exit 1; }
+done
+# Headers cached by the server do not ignore macros defined before them
+mkdir $server_dir/inc
+printf '#ifdef BIG\nint val() { return 2; }\n#else\nint val() { return 1; }\n#endif\n' \
+  > $server_dir/inc/cfg.h
+printf '#define BIG\n#include <cfg.h>\nint main() { return val(); }\n' \
+  > $server_dir/big.c
+printf '#include <cfg.h>\nint main() { return val(); }\n' > $server_dir/small.c
+for f in small big; do
+  ./compilium --target-os `uname` -I $server_dir/inc/ $server_dir/$f.c \
+    > $server_dir/local.S
+  ./compilium --connect $server_dir/sock --target-os `uname` \
+    -I $server_dir/inc/ -o $server_dir/server.S $server_dir/$f.c \
+    && cmp -s $server_dir/local.S $server_dir/server.S \
+    || { echo "FAIL compile server: macros before <$f>"; kill $server_pid; exit 1; }
+done
+echo 'int main() { return ; ' > $server_dir/error.c
+COMPILIUM_SERVER=$server_dir/sock ./compilium $server_dir/error.c \
+  > /dev/null 2> $server_dir/error.txt \
+  && { echo "FAIL compile server: error not reported"; kill $server_pid; exit 1; }
+grep -q Error $server_dir/error.txt \
+  || { echo "FAIL compile server: no diagnostics"; kill $server_pid; exit 1; }
+kill $server_pid
+wait $server_pid 2> /dev/null || true
+echo "PASS compile server"
+rm -r $server_dir
+
 echo "All tests passed."
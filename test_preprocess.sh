@@ -199,6 +199,65 @@ EOS
 `" \
 'Simple macro replacement with multiple tokens'
 
+test_stdout \
+"`cat << EOS
+#define VALUE 1
+VALUE;
+#undef VALUE
+VALUE;
+#define VALUE 2
+VALUE;
+#ifdef VALUE
+int defined_after_redefinition;
+#endif
+#undef VALUE
+#ifdef VALUE
+int not_defined_after_undef;
+#endif
+int always_visible;
+EOS
+`" \
+"`cat << EOS
+1;
+VALUE;
+2;
+
+int defined_after_redefinition;
+
+
+int always_visible;
+
+EOS
+`" \
+'undef and redefinition'
+
+printf '#ifndef TESTINCLUDE_GUARD_H\n#define TESTINCLUDE_GUARD_H\nint guarded;\n#endif\n' > testinclude_guard.h
+printf '#pragma once\nint once;\n' > testinclude_once.h
+test_stdout \
+"`cat << EOS
+#include "testinclude_guard.h"
+#include "testinclude_guard.h"
+#include "testinclude_once.h"
+#include "testinclude_once.h"
+int always_visible;
+EOS
+`" \
+"`cat << EOS
+
+int guarded;
+
+
+
+int once;
+
+
+int always_visible;
+
+EOS
+`" \
+'include guard and pragma once'
+rm -f testinclude_guard.h testinclude_once.h
+
 test_stdout \
 "`cat << EOS
 #define hello
@@ -243,3 +302,82 @@ printf("Two %s %d", "1 + 1", 3);
 EOS
 `" \
 'Function-like macros with #expr macro'
+
+function test_pch {
+  # Output with precompiled headers should be the same as without them,
+  # both when they are written and when they are loaded.
+  input="$1"
+  testname="$2"
+  printf "%s" "$input" > testinput.c
+  ./compilium -E --target-os `uname` -I testpch_include/ \
+    < testinput.c > expected.stdout 2>/dev/null
+  for mode in written loaded; do
+    ./compilium -E --target-os `uname` -I testpch_include/ \
+      --pch-dir testpch_cache/ --trace=preprocess \
+      < testinput.c > out.stdout 2> out.stderr
+    grep -q "PCH $mode" out.stderr \
+      || { printf "\nFAIL $testname: PCH is not $mode\n"; exit 1; }
+    diff -y expected.stdout out.stdout \
+      && printf "\nPASS $testname (PCH $mode)\n" \
+      || { printf "\nFAIL $testname: stdout diff (PCH $mode)\n"; exit 1; }
+  done
+  rm -f out.stderr
+}
+
+rm -rf testpch_include testpch_cache
+mkdir testpch_include testpch_cache
+cp include/*.h testpch_include/
+test_pch \
+"`cat << EOS
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef va_start
+EOF_IS(EOF);
+#endif
+EOS
+`" \
+'precompiled headers'
+printf '#ifdef BIG\nint big;\n#else\nint small;\n#endif\n' \
+  > testpch_include/cfg.h
+test_pch \
+"`cat << EOS
+#include <stddef.h>
+#define BIG
+#include <cfg.h>
+EOS
+`" \
+'precompiled headers after a macro is defined'
+printf '#ifndef C_H\n#define C_H\nstruct S {int x;};\ntypedef int myint;\n#endif\n' \
+  > testpch_include/c.h
+printf '#include <c.h>\nint a;\n' > testpch_include/a.h
+printf '#include <c.h>\nint b;\n' > testpch_include/b.h
+test_pch \
+"`cat << EOS
+#include <a.h>
+#include <b.h>
+EOS
+`" \
+'precompiled headers including the same guarded header'
+test_pch \
+"`cat << EOS
+#include <stdio.h>
+#define UNUSED
+#include <string.h>
+EOS
+`" \
+'precompiled headers after unrelated macros are defined'
+./compilium -E --target-os `uname` -I testpch_include/ \
+  --pch-dir testpch_cache/ --trace=preprocess < testinput.c 2>&1 >/dev/null \
+  | grep "Include from" \
+  && { printf "\nFAIL precompiled headers are not used\n"; exit 1; }
+echo '#define HEADER_CHANGED' >> testpch_include/stdarg.h
+test_pch \
+"`cat << EOS
+#include <stdio.h>
+#ifdef HEADER_CHANGED
+int header_changed;
+#endif
+EOS
+`" \
+'precompiled headers with a changed header'
+rm -rf testpch_include testpch_cache
@@ -0,0 +1,155 @@
+#include "compilium.h"
+
+// Time report of the phases of a compilation (--time-report[=json]).
+// Wall and CPU time of each phase are measured with clock_gettime(), where
+// the CPU time is of the thread running the compilation, so that reports of
+// compilations on workers (-j) are not mixed. Tokens and nodes are counted
+// only when the report is enabled, so the cost is two calls per phase.
+// Tokenizing headers is counted in preprocess, which includes them.
+
+static const char *phase_names[kNumOfPhases] = {
+    [kPhaseTokenize] = "tokenize", [kPhasePreprocess] = "preprocess",
+    [kPhaseParse] = "parse",       [kPhaseOptimize] = "optimize",
+    [kPhaseAnalyze] = "analyze",   [kPhaseGenerate] = "generate",
+    [kPhaseAssemble] = "assemble",
+};
+
+static double GetClockInSec(int clock_id) {
+  struct timespec ts;
+  if (clock_gettime(clock_id, &ts) != 0) return 0;
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool IsTimeReportEnabled(void) {
+  return compiler->options.time_report != kTimeReportNone;
+}
+
+void BeginPhase(enum Phase phase) {
+  if (!IsTimeReportEnabled()) return;
+  struct PhaseStat *s = &compiler->phase_stats[phase];
+  s->wall -= GetClockInSec(CLOCK_MONOTONIC);
+  s->cpu -= GetClockInSec(CLOCK_THREAD_CPUTIME_ID);
+  s->nodes = compiler->num_of_nodes;  // to count nodes allocated in it
+}
+
+static long CountTokens(struct Node *t) {
+  long n = 0;
+  for (; t; t = t->next_token) n++;
+  return n;
+}
+
+void EndPhase(enum Phase phase, struct Node *tokens) {
+  // tokens is the output of tokenize and preprocess, or NULL. Parse is
+  // counted with the preprocessed tokens and the nodes allocated by it,
+  // which are the AST handled by the later phases.
+  if (!IsTimeReportEnabled()) return;
+  struct PhaseStat *stats = compiler->phase_stats;
+  struct PhaseStat *s = &stats[phase];
+  s->wall += GetClockInSec(CLOCK_MONOTONIC);
+  s->cpu += GetClockInSec(CLOCK_THREAD_CPUTIME_ID);
+  s->is_done = true;
+  s->tokens = tokens ? CountTokens(tokens) : 0;
+  if (phase == kPhaseParse) {
+    s->tokens = stats[kPhasePreprocess].tokens;
+    s->nodes = compiler->num_of_nodes - s->nodes;
+  } else if (phase > kPhaseParse && phase != kPhaseAssemble) {
+    s->nodes = stats[kPhaseParse].nodes;
+  } else {
+    s->nodes = 0;
+  }
+}
+
+static double GetThroughput(long count, double sec) {
+  return count && sec > 0 ? count / sec : 0;
+}
+
+static void AppendReport(struct ObjBuffer *b, const char *fmt, ...) {
+  char line[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int size = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  assert(0 <= size && size < (int)sizeof(line));
+  AppendToObjBuffer(b, line, size);
+}
+
+static void AppendReportJSONString(struct ObjBuffer *b, const char *s) {
+  AppendToObjBuffer(b, "\"", 1);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      AppendReport(b, "\\%c", *s);
+    } else if ((unsigned char)*s < 0x20) {
+      AppendReport(b, "\\u%04x", *s);
+    } else {
+      AppendToObjBuffer(b, s, 1);
+    }
+  }
+  AppendToObjBuffer(b, "\"", 1);
+}
+
+static void AppendTableRow(struct ObjBuffer *b, const char *name,
+                           struct PhaseStat *s) {
+  AppendReport(b, "%-10s %10.3f %10.3f %10ld %10ld %12.0f %12.0f\n", name,
+               s->wall * 1e3, s->cpu * 1e3, s->tokens, s->nodes,
+               GetThroughput(s->tokens, s->wall),
+               GetThroughput(s->nodes, s->wall));
+}
+
+static void AppendJSONPhase(struct ObjBuffer *b, const char *name,
+                            struct PhaseStat *s) {
+  AppendReport(b,
+               "{\"name\":\"%s\",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+               "\"tokens\":%ld,\"nodes\":%ld,\"tokens_per_sec\":%.0f,"
+               "\"nodes_per_sec\":%.0f}",
+               name, s->wall * 1e3, s->cpu * 1e3, s->tokens, s->nodes,
+               GetThroughput(s->tokens, s->wall),
+               GetThroughput(s->nodes, s->wall));
+}
+
+void PrintTimeReport(FILE *fp) {
+  // The report is written at once, since workers (-j) may print theirs at
+  // the same time. JSON is a line of an object for each compilation.
+  const char *input = compiler->input_file_path;
+  if (!input) input = "<source>";
+  bool is_json = compiler->options.time_report == kTimeReportJSON;
+  struct PhaseStat total = {0};
+  struct ObjBuffer b = {0};
+  if (is_json) {
+    AppendReport(&b, "{\"input\":");
+    AppendReportJSONString(&b, input);
+    AppendReport(&b, ",\"phases\":[");
+  } else {
+    AppendReport(&b, "time report: ");
+    AppendToObjBuffer(&b, input, strlen(input));
+    AppendReport(&b, "\n%-10s %10s %10s %10s %10s %12s %12s\n", "phase",
+                 "wall ms", "cpu ms", "tokens", "nodes", "tokens/s",
+                 "nodes/s");
+  }
+  for (int i = 0; i < kNumOfPhases; i++) {
+    struct PhaseStat *s = &compiler->phase_stats[i];
+    if (!s->is_done) continue;
+    if (is_json) {
+      if (total.is_done) AppendToObjBuffer(&b, ",", 1);
+      AppendJSONPhase(&b, phase_names[i], s);
+    } else {
+      AppendTableRow(&b, phase_names[i], s);
+    }
+    total.is_done = true;
+    total.wall += s->wall;
+    total.cpu += s->cpu;
+  }
+  // The throughput of the whole compilation is of the preprocessed tokens
+  // and the AST.
+  total.tokens = compiler->phase_stats[kPhasePreprocess].tokens;
+  total.nodes = compiler->phase_stats[kPhaseParse].nodes;
+  if (is_json) {
+    AppendReport(&b, "],\"total\":");
+    AppendJSONPhase(&b, "total", &total);
+    AppendReport(&b, "}\n");
+  } else {
+    AppendTableRow(&b, "total", &total);
+  }
+  fwrite(b.data, 1, b.size, fp);
+  fflush(fp);
+  free(b.data);
+}
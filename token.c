@@ -6,21 +6,27 @@ bool IsTokenWithType(struct Node *n, enum TokenType token_type) {
   return IsToken(n) && n->token_type == token_type;
 }
 
-struct Node *AllocToken(const char *src_str, int line, const char *begin,
-                        int length, enum TokenType type) {
-  struct Node *t = AllocNode(kNodeToken);
+// Tokens are packed into the current arena with only TOKEN_NODE_SIZE bytes.
+static struct Node *AllocTokenNode(void) {
+  struct Node *t = ArenaAlloc(TOKEN_NODE_SIZE);
+  t->type = kNodeToken;
+  return t;
+}
+
+struct Node *AllocToken(int line, const char *begin, int length,
+                        enum TokenType type) {
+  struct Node *t = AllocTokenNode();
   t->begin = begin;
   t->length = length;
   t->token_type = type;
-  t->src_str = src_str;
   t->line = line;
   return t;
 }
 
 struct Node *DuplicateToken(struct Node *base_token) {
   assert(IsToken(base_token));
-  struct Node *t = AllocNode(kNodeToken);
-  memcpy(t, base_token, sizeof(*t));
+  struct Node *t = AllocTokenNode();
+  memcpy(t, base_token, TOKEN_NODE_SIZE);
   t->next_token = NULL;
   return t;
 }
@@ -38,12 +44,15 @@ struct Node *DuplicateTokenSequence(struct Node *base_head) {
 
 char *CreateTokenStr(struct Node *t) {
   assert(IsToken(t));
-  return strndup(t->begin, t->length);
+  return ArenaStrndup(t->begin, t->length);
 }
 
 int IsEqualTokenWithCStr(struct Node *t, const char *s) {
-  return IsToken(t) && strlen(s) == (unsigned)t->length &&
-         strncmp(t->begin, s, t->length) == 0;
+  if (!IsToken(t)) return 0;
+  size_t len = strlen(s);
+  STAT_CALL(kStatTokenCompare);
+  STAT_STEPS(kStatTokenCompare, len + (len == (unsigned)t->length ? len : 0));
+  return len == (unsigned)t->length && strncmp(t->begin, s, t->length) == 0;
 }
 
 void PrintTokenSequence(struct Node *t) {
@@ -64,8 +73,9 @@ void OutputTokenSequenceAsCSource(struct Node *t) {
     if (t->token_type == kTokenZeroWidthNoBreakSpace) {
       continue;
     }
-    fprintf(stdout, "%.*s", t->length, t->begin);
+    EmitStrN(t->begin, t->length);
   }
+  FlushEmitter();
 }
 
 void PrintToken(struct Node *t) {
@@ -93,79 +103,85 @@ static bool ShouldRemoveToken(struct Node *t) {
 
 // Token stream
 
-static struct Node **next_token_holder;
-
 void InitTokenStream(struct Node **head_token_holder) {
   assert(head_token_holder);
-  next_token_holder = head_token_holder;
+  compiler->next_token_holder = head_token_holder;
+}
+
+struct Node **GetTokenStreamPos(void) {
+  // Returns the current position, which can be restored by InitTokenStream.
+  return compiler->next_token_holder;
 }
 
 static void AdvanceTokenStream(void) {
-  if (!*next_token_holder) return;
-  next_token_holder = &(*next_token_holder)->next_token;
+  if (!*compiler->next_token_holder) return;
+  compiler->next_token_holder = &(*compiler->next_token_holder)->next_token;
 }
 
 struct Node *PeekToken(void) {
-  assert(next_token_holder);
-  return *next_token_holder;
+  assert(compiler->next_token_holder);
+  return *compiler->next_token_holder;
 }
 
 struct Node *ReadToken(enum TokenType type) {
-  struct Node *t = *next_token_holder;
+  struct Node *t = *compiler->next_token_holder;
   if (!t || !IsTokenWithType(t, type)) return NULL;
   return t;
 }
 
 struct Node *ConsumeToken(enum TokenType type) {
-  struct Node *t = *next_token_holder;
+  struct Node *t = *compiler->next_token_holder;
   if (!t || !IsTokenWithType(t, type)) return NULL;
   AdvanceTokenStream();
   return t;
 }
 
 struct Node *ConsumeTokenStr(const char *s) {
-  struct Node *t = *next_token_holder;
+  struct Node *t = *compiler->next_token_holder;
   if (!t || !IsEqualTokenWithCStr(t, s)) return NULL;
   AdvanceTokenStream();
   return t;
 }
 
 struct Node *ExpectTokenStr(const char *s) {
-  struct Node *t = *next_token_holder;
+  struct Node *t = *compiler->next_token_holder;
   if (!t) Error("Expect token %s but got EOF", s);
   if (!ConsumeTokenStr(s)) ErrorWithToken(t, "Expected token %s here", s);
   return t;
 }
 
-struct Node *ConsumePunctuator(const char *s) {
-  struct Node *t = *next_token_holder;
-  if (!t || !IsTokenWithType(t, kTokenPunctuator) ||
-      !IsEqualTokenWithCStr(t, s))
-    return NULL;
+bool IsPunctuator(struct Node *t, enum PunctuatorID id) {
+  return IsToken(t) && t->punct_id == id;
+}
+
+struct Node *ConsumePunctuator(enum PunctuatorID id) {
+  struct Node *t = *compiler->next_token_holder;
+  if (!t || t->punct_id != id) return NULL;
   AdvanceTokenStream();
   return t;
 }
 
-struct Node *ExpectPunctuator(const char *s) {
-  struct Node *t = *next_token_holder;
-  if (!t) Error("Expect token %s but got EOF", s);
-  if (!ConsumePunctuator(s)) ErrorWithToken(t, "Expected token %s here", s);
+struct Node *ExpectPunctuator(enum PunctuatorID id) {
+  struct Node *t = *compiler->next_token_holder;
+  if (!t) Error("Expect token %s but got EOF", GetPunctuatorStr(id));
+  if (!ConsumePunctuator(id))
+    ErrorWithToken(t, "Expected token %s here", GetPunctuatorStr(id));
   return t;
 }
 
 struct Node *NextToken(void) {
-  struct Node *t = *next_token_holder;
+  struct Node *t = *compiler->next_token_holder;
   AdvanceTokenStream();
   return t;
 }
 
 void RemoveCurrentToken(void) {
-  if (!*next_token_holder) return;
-  *next_token_holder = (*next_token_holder)->next_token;
+  if (!*compiler->next_token_holder) return;
+  *compiler->next_token_holder = (*compiler->next_token_holder)->next_token;
 }
 
 void RemoveTokensTo(struct Node *end) {
-  while (*next_token_holder && *next_token_holder != end) {
+  while (*compiler->next_token_holder && *compiler->next_token_holder != end) {
     RemoveCurrentToken();
   }
 }
@@ -176,7 +192,7 @@ void InsertTokens(struct Node *seq_first) {
   struct Node *seq_last = seq_first;
   while (seq_last->next_token) seq_last = seq_last->next_token;
   seq_last->next_token = PeekToken();
-  *next_token_holder = seq_first;
+  *compiler->next_token_holder = seq_first;
 }
 
 static struct Node *CreateStringLiteralOfTokens(struct Node *head) {
@@ -185,8 +201,7 @@ static struct Node *CreateStringLiteralOfTokens(struct Node *head) {
   for (struct Node *t = head; t; t = t->next_token) {
     len += t->length;
   }
-  char *s = malloc(len + 1 + 2);
-  assert(s);
+  char *s = ArenaAlloc(len + 1 + 2);
   char *p = s;
   *p = '"';
   p++;
@@ -199,7 +214,7 @@ static struct Node *CreateStringLiteralOfTokens(struct Node *head) {
   *p = '"';
   p++;
   *p = 0;
-  return AllocToken(s, 0, s, len + 2, kTokenStringLiteral);
+  return AllocToken(0, s, len + 2, kTokenStringLiteral);
 }
 
 void InsertTokensWithIdentReplace(struct Node *seq, struct Node *rep_list) {
@@ -207,10 +222,10 @@ void InsertTokensWithIdentReplace(struct Node *seq, struct Node *rep_list) {
   // if seq contains token in rep_list, replace it with tokens rep_list[token];
   // elements of seq will be inserted directly.
   if (!IsToken(seq)) return;
-  struct Node **next_holder = next_token_holder;
+  struct Node **next_holder = compiler->next_token_holder;
   while (seq) {
     struct Node *e;
-    if (IsEqualTokenWithCStr(seq, "#") && seq->next_token &&
+    if (IsPunctuator(seq, kPunctHash) && seq->next_token &&
         (e = GetNodeByTokenKey(rep_list, seq->next_token))) {
       struct Node *st = CreateStringLiteralOfTokens(e->value);
       seq = seq->next_token->next_token;
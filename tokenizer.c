@@ -1,214 +1,308 @@
 #include "compilium.h"
 
-struct Node *CreateNextToken(const char *p, const char *src, int *line) {
-  assert(line);
-  if (!*p) return NULL;
-  if (*p == ' ') {
-    return AllocToken(src, *line, p, 1, kTokenDelimiter);
-  }
-  if (*p == '\n') {
-    (*line)++;
-    return AllocToken(src, *line, p, 1, kTokenDelimiter);
-  }
-  if (p[0] == '\\' && p[1] == '\n') {
-    (*line)++;
-    return AllocToken(src, *line, p, 2, kTokenZeroWidthNoBreakSpace);
+enum CharClass {
+  kCharUnknown,
+  kCharSpace,
+  kCharNewline,
+  kCharBackslash,
+  kCharZero,
+  kCharNonZeroDigit,
+  kCharIdent,
+  kCharCharQuote,
+  kCharStringQuote,
+  kCharPunctuator,
+};
+
+// Class of each ASCII char. Non-ASCII chars are always kCharUnknown.
+#define UN kCharUnknown
+#define SP kCharSpace
+#define NL kCharNewline
+#define BS kCharBackslash
+#define ZE kCharZero
+#define DI kCharNonZeroDigit
+#define ID kCharIdent
+#define CQ kCharCharQuote
+#define SQ kCharStringQuote
+#define PU kCharPunctuator
+static const unsigned char char_class_table[128] = {
+    UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, NL, UN, UN, UN, UN, UN,  // 0x00
+    UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, UN, UN,  // 0x10
+    SP, PU, SQ, PU, UN, PU, PU, CQ, PU, PU, PU, PU, PU, PU, PU, PU,  // 0x20
+    ZE, DI, DI, DI, DI, DI, DI, DI, DI, DI, PU, PU, PU, PU, PU, PU,  // 0x30
+    UN, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  // 0x40
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, PU, BS, PU, PU, ID,  // 0x50
+    UN, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  // 0x60
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, PU, PU, PU, PU, UN,  // 0x70
+};
+#undef UN
+#undef SP
+#undef NL
+#undef BS
+#undef ZE
+#undef DI
+#undef ID
+#undef CQ
+#undef SQ
+#undef PU
+
+static enum CharClass GetCharClass(char c) {
+  unsigned char uc = c;
+  return uc < 128 ? char_class_table[uc] : kCharUnknown;
+}
+
+static bool IsIdentChar(char c) {
+  enum CharClass cc = GetCharClass(c);
+  return cc == kCharIdent || cc == kCharZero || cc == kCharNonZeroDigit;
+}
+
+// Spellings which begin with the same char are listed longest first,
+// so the first match is the longest match.
+struct PunctuatorSpelling {
+  const char *str;
+  int length;
+  enum TokenType type;
+  enum PunctuatorID id;
+};
+#define PUNCT(s, id) \
+  { s, sizeof(s) - 1, kTokenPunctuator, id }
+static const struct PunctuatorSpelling punctuator_table[128][5] = {
+    ['#'] = {PUNCT("##", kPunctHashHash), PUNCT("#", kPunctHash)},
+    ['&'] = {PUNCT("&&", kPunctAndAnd), PUNCT("&", kPunctAnd)},
+    ['|'] = {PUNCT("||", kPunctOrOr), PUNCT("|", kPunctOr)},
+    ['<'] = {PUNCT("<<=", kPunctShlAssign), PUNCT("<<", kPunctShl),
+             PUNCT("<=", kPunctLe), PUNCT("<", kPunctLt)},
+    ['>'] = {PUNCT(">>=", kPunctShrAssign), PUNCT(">>", kPunctShr),
+             PUNCT(">=", kPunctGe), PUNCT(">", kPunctGt)},
+    ['='] = {PUNCT("==", kPunctEq), PUNCT("=", kPunctAssign)},
+    ['!'] = {PUNCT("!=", kPunctNe), PUNCT("!", kPunctNot)},
+    ['^'] = {PUNCT("^", kPunctXor)},
+    ['+'] = {PUNCT("++", kPunctInc), PUNCT("+=", kPunctAddAssign),
+             PUNCT("+", kPunctPlus)},
+    ['-'] = {PUNCT("--", kPunctDec), PUNCT("-=", kPunctSubAssign),
+             PUNCT("->", kPunctArrow), PUNCT("-", kPunctMinus)},
+    ['*'] = {{"*/", 2, kTokenBlockCommentEnd, kPunctNone},
+             PUNCT("*=", kPunctMulAssign),
+             PUNCT("*", kPunctStar)},
+    ['/'] = {{"//", 2, kTokenLineComment, kPunctNone},
+             {"/*", 2, kTokenBlockCommentBegin, kPunctNone},
+             PUNCT("/=", kPunctDivAssign),
+             PUNCT("/", kPunctSlash)},
+    ['%'] = {PUNCT("%=", kPunctModAssign), PUNCT("%", kPunctPercent)},
+    ['~'] = {PUNCT("~", kPunctTilde)},
+    ['?'] = {PUNCT("?", kPunctQuestion)},
+    [':'] = {PUNCT(":", kPunctColon)},
+    [','] = {PUNCT(",", kPunctComma)},
+    [';'] = {PUNCT(";", kPunctSemicolon)},
+    ['{'] = {PUNCT("{", kPunctLBrace)},
+    ['}'] = {PUNCT("}", kPunctRBrace)},
+    ['('] = {PUNCT("(", kPunctLParen)},
+    [')'] = {PUNCT(")", kPunctRParen)},
+    ['.'] = {PUNCT("...", kPunctEllipsis), PUNCT(".", kPunctDot)},
+    ['['] = {PUNCT("[", kPunctLBracket)},
+    [']'] = {PUNCT("]", kPunctRBracket)},
+};
+#undef PUNCT
+
+// Spellings of keywords, in the order of kTokenKw* in enum TokenType.
+static const char *const keyword_spellings[] = {
+    "break",  "char",   "const",   "continue", "else", "extern",
+    "for",    "if",     "int",     "long",     "return", "sizeof",
+    "static", "struct", "typedef", "unsigned", "void", "while",
+};
+#define NUM_OF_KEYWORDS \
+  ((int)(sizeof(keyword_spellings) / sizeof(keyword_spellings[0])))
+
+// Perfect hash of keywords:
+// (length + KEYWORD_HASH_MULTIPLIER * (first char + last char)) % 32
+// The table below is printed by ./compilium --run-unittest=Tokenizer, which
+// searches a multiplier mapping every keyword into a distinct slot.
+// Run it after adding a keyword, and paste the output here.
+#define KEYWORD_TABLE_SIZE 32
+#define KEYWORD_HASH_MULTIPLIER 3
+struct KeywordEntry {
+  const char *str;
+  enum TokenType type;
+};
+static const struct KeywordEntry keyword_table[KEYWORD_TABLE_SIZE] = {
+    [0] = {"continue", kTokenKwContinue},
+    [2] = {"else", kTokenKwElse},
+    [3] = {"char", kTokenKwChar},
+    [6] = {"return", kTokenKwReturn},
+    [8] = {"static", kTokenKwStatic},
+    [10] = {"const", kTokenKwConst},
+    [11] = {"for", kTokenKwFor},
+    [12] = {"break", kTokenKwBreak},
+    [15] = {"if", kTokenKwIf},
+    [17] = {"sizeof", kTokenKwSizeof},
+    [18] = {"void", kTokenKwVoid},
+    [19] = {"unsigned", kTokenKwUnsigned},
+    [21] = {"typedef", kTokenKwTypedef},
+    [25] = {"while", kTokenKwWhile},
+    [26] = {"int", kTokenKwInt},
+    [27] = {"struct", kTokenKwStruct},
+    [29] = {"long", kTokenKwLong},
+    [31] = {"extern", kTokenKwExtern},
+};
+
+static unsigned int CalcKeywordHash(const char *p, int length,
+                                    unsigned int multiplier) {
+  return (length + multiplier * ((unsigned char)p[0] +
+                                 (unsigned char)p[length - 1])) %
+         KEYWORD_TABLE_SIZE;
+}
+
+static enum TokenType GetIdentTokenType(const char *p, int length) {
+  const struct KeywordEntry *e =
+      &keyword_table[CalcKeywordHash(p, length, KEYWORD_HASH_MULTIPLIER)];
+  if (e->str && strncmp(e->str, p, length) == 0 && !e->str[length])
+    return e->type;
+  return kTokenIdent;
+}
+
+static struct Node *CreateNextPunctuatorToken(const char *p, int line) {
+  const struct PunctuatorSpelling *cands =
+      punctuator_table[(unsigned char)*p];
+  for (; cands->str; cands++) {
+    if (strncmp(p, cands->str, cands->length) == 0) {
+      struct Node *t = AllocToken(line, p, cands->length, cands->type);
+      t->punct_id = cands->id;
+      return t;
+    }
   }
-  if ('1' <= *p && *p <= '9') {
-    int length = 0;
-    while ('0' <= p[length] && p[length] <= '9') {
-      length++;
+  return AllocToken(line, p, 1, kTokenUnknownChar);
+}
+
+const char *GetPunctuatorStr(enum PunctuatorID id) {
+  // For error messages. Returns NULL for kPunctNone.
+  for (int c = 0; c < 128; c++) {
+    for (const struct PunctuatorSpelling *e = punctuator_table[c]; e->str;
+         e++) {
+      if (e->type == kTokenPunctuator && e->id == id) return e->str;
     }
-    return AllocToken(src, *line, p, length, kTokenIntegerConstant);
-  } else if ('0' == *p) {
-    int length = 0;
-    if (p[1] == 'x') {
-      // Hexadecimal
-      length += 2;
-      while (('0' <= p[length] && p[length] <= '9') ||
-             ('A' <= p[length] && p[length] <= 'F') ||
-             ('a' <= p[length] && p[length] <= 'f')) {
+  }
+  return NULL;
+}
+
+struct Node *CreateNextToken(const char *p, int *line) {
+  assert(line);
+  if (!*p) return NULL;
+  int length = 0;
+  switch (GetCharClass(*p)) {
+    case kCharSpace:
+      return AllocToken(*line, p, 1, kTokenDelimiter);
+    case kCharNewline:
+      (*line)++;
+      return AllocToken(*line, p, 1, kTokenDelimiter);
+    case kCharBackslash:
+      if (p[1] != '\n') break;
+      (*line)++;
+      return AllocToken(*line, p, 2, kTokenZeroWidthNoBreakSpace);
+    case kCharNonZeroDigit:
+      while (GetCharClass(p[length]) == kCharZero ||
+             GetCharClass(p[length]) == kCharNonZeroDigit) {
         length++;
       }
-    } else {
-      // Octal
-      while ('0' <= p[length] && p[length] <= '7') {
+      return AllocToken(*line, p, length, kTokenIntegerConstant);
+    case kCharZero:
+      if (p[1] == 'x') {
+        // Hexadecimal
+        length += 2;
+        while (('0' <= p[length] && p[length] <= '9') ||
+               ('A' <= p[length] && p[length] <= 'F') ||
+               ('a' <= p[length] && p[length] <= 'f')) {
+          length++;
+        }
+      } else {
+        // Octal
+        while ('0' <= p[length] && p[length] <= '7') {
+          length++;
+        }
+      }
+      return AllocToken(*line, p, length, kTokenIntegerConstant);
+    case kCharIdent: {
+      while (IsIdentChar(p[length])) {
         length++;
       }
+      struct Node *t =
+          AllocToken(*line, p, length, GetIdentTokenType(p, length));
+      t->atom = InternStr(p, length);
+      return t;
     }
-    return AllocToken(src, *line, p, length, kTokenIntegerConstant);
-  } else if (('A' <= *p && *p <= 'Z') || ('a' <= *p && *p <= 'z') ||
-             *p == '_') {
-    int length = 0;
-    while (('A' <= p[length] && p[length] <= 'Z') ||
-           ('a' <= p[length] && p[length] <= 'z') || p[length] == '_' ||
-           ('0' <= p[length] && p[length] <= '9')) {
-      length++;
-    }
-    struct Node *t = AllocToken(src, *line, p, length, kTokenIdent);
-    if (IsEqualTokenWithCStr(t, "break")) t->token_type = kTokenKwBreak;
-    if (IsEqualTokenWithCStr(t, "char")) t->token_type = kTokenKwChar;
-    if (IsEqualTokenWithCStr(t, "const")) t->token_type = kTokenKwConst;
-    if (IsEqualTokenWithCStr(t, "continue")) t->token_type = kTokenKwContinue;
-    if (IsEqualTokenWithCStr(t, "else")) t->token_type = kTokenKwElse;
-    if (IsEqualTokenWithCStr(t, "extern")) t->token_type = kTokenKwExtern;
-    if (IsEqualTokenWithCStr(t, "for")) t->token_type = kTokenKwFor;
-    if (IsEqualTokenWithCStr(t, "if")) t->token_type = kTokenKwIf;
-    if (IsEqualTokenWithCStr(t, "int")) t->token_type = kTokenKwInt;
-    if (IsEqualTokenWithCStr(t, "long")) t->token_type = kTokenKwLong;
-    if (IsEqualTokenWithCStr(t, "return")) t->token_type = kTokenKwReturn;
-    if (IsEqualTokenWithCStr(t, "sizeof")) t->token_type = kTokenKwSizeof;
-    if (IsEqualTokenWithCStr(t, "static")) t->token_type = kTokenKwStatic;
-    if (IsEqualTokenWithCStr(t, "struct")) t->token_type = kTokenKwStruct;
-    if (IsEqualTokenWithCStr(t, "typedef")) t->token_type = kTokenKwTypedef;
-    if (IsEqualTokenWithCStr(t, "unsigned")) t->token_type = kTokenKwUnsigned;
-    if (IsEqualTokenWithCStr(t, "void")) t->token_type = kTokenKwVoid;
-    if (IsEqualTokenWithCStr(t, "while")) t->token_type = kTokenKwWhile;
-    return t;
-  } else if ('\'' == *p) {
-    int length = 1;
-    while (p[length] && p[length] != '\'') {
-      if (p[length] == '\\' && p[length + 1]) {
+    case kCharCharQuote:
+      length = 1;
+      while (p[length] && p[length] != '\'') {
+        if (p[length] == '\\' && p[length + 1]) {
+          length++;
+        }
         length++;
       }
+      if (p[length] != '\'') {
+        Error("Expected end of char literal (')");
+      }
       length++;
-    }
-    if (p[length] != '\'') {
-      Error("Expected end of char literal (')");
-    }
-    length++;
-    return AllocToken(src, *line, p, length, kTokenCharLiteral);
-  } else if ('"' == *p) {
-    int length = 1;
-    while (p[length] && p[length] != '"') {
-      if (p[length] == '\\' && p[length + 1]) {
+      return AllocToken(*line, p, length, kTokenCharLiteral);
+    case kCharStringQuote:
+      length = 1;
+      while (p[length] && p[length] != '"') {
+        if (p[length] == '\\' && p[length + 1]) {
+          length++;
+        }
         length++;
       }
-      length++;
-    }
-    if (p[length] != '"') {
-      Error("Expected end of string literal (\")");
-    }
-    length++;
-    return AllocToken(src, *line, p, length, kTokenStringLiteral);
-  } else if ('#' == *p) {
-    if (p[1] == '#') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('&' == *p) {
-    if (p[1] == '&') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('|' == *p) {
-    if (p[1] == '|') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('<' == *p) {
-    if (p[1] == '<') {
-      if (p[2] == '=') {
-        return AllocToken(src, *line, p, 3, kTokenPunctuator);
+      if (p[length] != '"') {
+        Error("Expected end of string literal (\")");
       }
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    } else if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('>' == *p) {
-    if (p[1] == '>') {
-      if (p[2] == '=') {
-        return AllocToken(src, *line, p, 3, kTokenPunctuator);
-      }
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    } else if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('=' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('!' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('^' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('+' == *p) {
-    if (p[1] == '+') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('-' == *p) {
-    if (p[1] == '-' || p[1] == '=' || p[1] == '>') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('*' == *p) {
-    if (p[1] == '/') {
-      return AllocToken(src, *line, p, 2, kTokenBlockCommentEnd);
-    }
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('/' == *p) {
-    if (p[1] == '/') {
-      return AllocToken(src, *line, p, 2, kTokenLineComment);
-    }
-    if (p[1] == '*') {
-      return AllocToken(src, *line, p, 2, kTokenBlockCommentBegin);
-    }
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('%' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('~' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('?' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (':' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (',' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (';' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('{' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('}' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('(' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (')' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('.' == *p) {
-    if (p[1] == '.' && p[2] == '.') {
-      return AllocToken(src, *line, p, 3, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('[' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (']' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
+      length++;
+      return AllocToken(*line, p, length, kTokenStringLiteral);
+    case kCharPunctuator:
+      return CreateNextPunctuatorToken(p, *line);
+    case kCharUnknown:
+      break;
   }
-  return AllocToken(src, *line, p, 1, kTokenUnknownChar);
+  return AllocToken(*line, p, 1, kTokenUnknownChar);
 }
 
 struct Node *CreateToken(const char *input) {
   int line = 1;
-  return CreateNextToken(input, input, &line);
+  return CreateNextToken(input, &line);
+}
+
+// Source buffers passed to Tokenize, to find the beginning of the line of
+// a token when printing errors. Tokens do not hold it to keep them small.
+struct SourceRange {
+  const char *begin;
+  const char *end;
+};
+
+static void AddSourceRange(const char *begin, const char *end) {
+  struct CompilerContext *c = compiler;
+  if (c->num_of_source_ranges == c->source_ranges_capacity) {
+    c->source_ranges_capacity = (c->source_ranges_capacity + 1) * 2;
+    c->source_ranges =
+        realloc(c->source_ranges,
+                sizeof(struct SourceRange) * c->source_ranges_capacity);
+    assert(c->source_ranges);
+  }
+  c->source_ranges[c->num_of_source_ranges].begin = begin;
+  c->source_ranges[c->num_of_source_ranges].end = end;
+  c->num_of_source_ranges++;
+}
+
+const char *FindSourceBegin(const char *p) {
+  // Returns the beginning of the source buffer which contains p,
+  // or NULL if p is not in the sources given to Tokenize.
+  struct SourceRange *ranges = compiler->source_ranges;
+  for (int i = 0; i < compiler->num_of_source_ranges; i++) {
+    if (ranges[i].begin <= p && p < ranges[i].end) return ranges[i].begin;
+  }
+  return NULL;
+}
+
+void ReleaseSourceRanges(void) {
+  free(compiler->source_ranges);
+  compiler->source_ranges = NULL;
+  compiler->num_of_source_ranges = 0;
+  compiler->source_ranges_capacity = 0;
 }
 
 struct Node *Tokenize(const char *input) {
@@ -218,10 +312,62 @@ struct Node *Tokenize(const char *input) {
   const char *p = input;
   struct Node *t;
   int line = 1;
-  while ((t = CreateNextToken(p, input, &line))) {
+  while ((t = CreateNextToken(p, &line))) {
     *last_next_token = t;
     last_next_token = &t->next_token;
     p = t->begin + t->length;
   }
+  AddSourceRange(input, p);
   return token_head;
 }
+
+static bool IsKeywordHashPerfect(unsigned int multiplier) {
+  bool is_used[KEYWORD_TABLE_SIZE] = {false};
+  for (int i = 0; i < NUM_OF_KEYWORDS; i++) {
+    const char *s = keyword_spellings[i];
+    unsigned int h = CalcKeywordHash(s, strlen(s), multiplier);
+    if (is_used[h]) return false;
+    is_used[h] = true;
+  }
+  return true;
+}
+
+static void PrintKeywordTable(void) {
+  // Prints the definitions of the keyword table to be pasted above.
+  unsigned int multiplier = 1;
+  while (multiplier < 256 && !IsKeywordHashPerfect(multiplier)) multiplier++;
+  if (multiplier == 256) {
+    fprintf(stderr, "No multiplier found. Enlarge KEYWORD_TABLE_SIZE.\n");
+    return;
+  }
+  fprintf(stderr, "#define KEYWORD_HASH_MULTIPLIER %u\n", multiplier);
+  for (unsigned int h = 0; h < KEYWORD_TABLE_SIZE; h++) {
+    for (int i = 0; i < NUM_OF_KEYWORDS; i++) {
+      const char *s = keyword_spellings[i];
+      if (CalcKeywordHash(s, strlen(s), multiplier) != h) continue;
+      fprintf(stderr, "    [%u] = {\"%s\", kTokenKw%c%s},\n", h, s,
+              s[0] - 'a' + 'A', s + 1);
+    }
+  }
+}
+
+void TestTokenizer() {
+  fprintf(stderr, "Testing Tokenizer...");
+
+  // Every keyword should be in its own slot of keyword_table.
+  assert(NUM_OF_KEYWORDS == kTokenKwWhile - kTokenKwBreak + 1);
+  for (int i = 0; i < NUM_OF_KEYWORDS; i++) {
+    const char *s = keyword_spellings[i];
+    if ((int)GetIdentTokenType(s, strlen(s)) != kTokenKwBreak + i) {
+      fprintf(stderr, "keyword_table is outdated for %s. Replace it with:\n",
+              s);
+      PrintKeywordTable();
+      exit(EXIT_FAILURE);
+    }
+  }
+  assert(GetIdentTokenType("main", 4) == kTokenIdent);
+  assert(GetIdentTokenType("in", 2) == kTokenIdent);
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
+}
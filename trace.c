@@ -0,0 +1,38 @@
+#include "compilium.h"
+
+// Diagnostic output for debugging the compiler, enabled per category by
+// --trace=<category>[,<category>...]. TRACE and TRACE_AST (in compilium.h)
+// test the bit of the category before evaluating their arguments, so
+// a disabled category costs only that test. The enabled categories are
+// an option of each compilation (CompilerOptions.trace_categories).
+
+static const char *trace_category_names[kNumOfTraceCategories] = {
+    [kTracePreprocess] = "preprocess", [kTraceParse] = "parse",
+    [kTraceOptimize] = "optimize",     [kTraceAnalyze] = "analyze",
+    [kTraceCodegen] = "codegen",
+};
+
+static enum TraceCategory FindTraceCategory(const char *name, int len) {
+  for (int i = 0; i < kNumOfTraceCategories; i++) {
+    const char *s = trace_category_names[i];
+    if ((int)strlen(s) == len && strncmp(s, name, len) == 0) return i;
+  }
+  Error("Unknown trace category: %.*s", len, name);
+}
+
+unsigned int ParseTraceCategories(const char *list) {
+  // Returns the bits of the categories in list, which is comma-separated
+  // names of categories, or "all".
+  assert(list);
+  if (strcmp(list, "all") == 0) return (1u << kNumOfTraceCategories) - 1;
+  unsigned int categories = 0;
+  const char *p = list;
+  for (;;) {
+    const char *end = strchr(p, ',');
+    int len = end ? end - p : (int)strlen(p);
+    categories |= 1u << FindTraceCategory(p, len);
+    if (!end) break;
+    p = end + 1;
+  }
+  return categories;
+}
@@ -0,0 +1,88 @@
+#include "compilium.h"
+
+// Explicit-stack traversal of the AST.
+// Passes used to recurse once per level of nesting, so a long chain like
+// 1 + 1 + ... + 1 (a left-deep tree) overflowed the C stack. Traverse keeps
+// the nodes being visited in a heap-allocated stack of frames instead, and
+// calls the step function of the pass on the frame at the top:
+//
+//   step(f, arg) either returns VisitChild(f, resume_step, child, param)
+//   to visit child and be called again with f->step == resume_step, or
+//   returns false when f->node is done. f->step is 0 on the first call,
+//   and f->child is the child visited last when f is resumed.
+//
+// Code which ran between the recursive calls runs between the steps, so
+// the order of side effects (e.g. emitted code) does not change. Values
+// which must survive a visit of a child are kept in the frame, not in
+// local variables of the step function.
+//
+// The stack is kept in the context and reused by the next traversal, so
+// it is released with the context even when Error() jumps out of a pass.
+// A traversal started by a step (e.g. PrintASTNode for a trace) gets a
+// stack of its own from the current arena, since the frames of the outer
+// one must not move while the step is running.
+
+#define TRAVERSE_STACK_INITIAL_CAPACITY 64
+
+bool VisitChild(struct TraverseFrame *f, int resume_step, struct Node *child,
+                int param) {
+  f->step = resume_step;
+  f->child = child;
+  f->child_param = param;
+  return true;
+}
+
+bool VisitNextElement(struct TraverseFrame *f, int resume_step,
+                      struct Node *list, int param) {
+  // Visits the elements of list one by one, resuming f at resume_step after
+  // each of them. Returns false when all of them have been visited.
+  if (f->i >= GetSizeOfList(list)) return false;
+  return VisitChild(f, resume_step, GetNodeAt(list, f->i++), param);
+}
+
+static void PushTraverseFrame(struct TraverseStack *s, int depth,
+                              struct Node *node, int param,
+                              bool is_in_arena) {
+  // Frames may move when the stack grows, so pointers to them are valid
+  // only until the next push.
+  if (depth == s->capacity) {
+    int capacity =
+        s->capacity ? s->capacity * 2 : TRAVERSE_STACK_INITIAL_CAPACITY;
+    if (is_in_arena) {
+      struct TraverseFrame *frames =
+          ArenaAlloc(sizeof(struct TraverseFrame) * capacity);
+      if (depth) memcpy(frames, s->frames, sizeof(*frames) * depth);
+      s->frames = frames;
+    } else {
+      s->frames = realloc(s->frames, sizeof(struct TraverseFrame) * capacity);
+      assert(s->frames);
+    }
+    s->capacity = capacity;
+  }
+  s->frames[depth] = (struct TraverseFrame){.node = node, .param = param};
+}
+
+void Traverse(struct Node *root, int param,
+              bool (*step)(struct TraverseFrame *f, void *arg), void *arg) {
+  bool is_nested = compiler->is_traversing;
+  struct TraverseStack nested_stack = {0};
+  struct TraverseStack *s =
+      is_nested ? &nested_stack : &compiler->traverse_stack;
+  compiler->is_traversing = true;
+  int depth = 0;
+  PushTraverseFrame(s, depth++, root, param, is_nested);
+  while (depth) {
+    struct TraverseFrame *f = &s->frames[depth - 1];
+    if (!step(f, arg)) {
+      depth--;
+      continue;
+    }
+    PushTraverseFrame(s, depth++, f->child, f->child_param, is_nested);
+  }
+  compiler->is_traversing = is_nested;
+}
+
+void ReleaseTraverseStack(void) {
+  free(compiler->traverse_stack.frames);
+  compiler->traverse_stack = (struct TraverseStack){0};
+}
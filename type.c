@@ -166,7 +166,7 @@ struct Node *CreateTypeFromDecltor(struct Node *decltor, struct Node *type) {
   return type;
 }
 
-static struct Node *CreateBaseTypeFromDeclSpecs(struct SymbolEntry *ctx,
+static struct Node *CreateBaseTypeFromDeclSpecs(struct SymbolTable *ctx,
                                                 struct Node *decl_specs) {
   // 6.2.5 Types
   assert(IsASTList(decl_specs));
@@ -215,7 +215,7 @@ static struct Node *CreateBaseTypeFromDeclSpecs(struct SymbolEntry *ctx,
   assert(false);
 }
 
-struct Node *CreateTypeInContext(struct SymbolEntry *ctx,
+struct Node *CreateTypeInContext(struct SymbolTable *ctx,
                                  struct Node *decl_specs,
                                  struct Node *decltor) {
   struct Node *type = CreateBaseTypeFromDeclSpecs(ctx, decl_specs);
@@ -232,7 +232,7 @@ struct Node *CreateTypeFromDecl(struct Node *decl) {
   return CreateType(decl->op, decl->right);
 }
 
-struct Node *CreateTypeFromDeclInContext(struct SymbolEntry *ctx,
+struct Node *CreateTypeFromDeclInContext(struct SymbolTable *ctx,
                                          struct Node *decl) {
   assert(decl && decl->type == kASTDecl);
   return CreateTypeInContext(ctx, decl->op, decl->right);